@@ -5,13 +5,40 @@
 #include <fstream>
 #include <cstddef>
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "tree_shape.hpp"
+#include "tree_stats.hpp"
+#include "tree_iterator.hpp"
+#include "tree_traversal.hpp"
+#include "tree_sink.hpp"
+#include "tree_graphviz.hpp"
+#include "tree_links.hpp"
+#include "tree_snapshot.hpp"
+#include "key_prefix.hpp"
+#include "node_pool.hpp"
+#include "frozen_index.hpp"
+#include "parallel_build.hpp"
 
 using namespace std;
 
 /// @brief A class template for creating AVL trees for any given
 /// data type.
 /// @tparam T The type for the data to be stored in the tree.
-template <class T>
+/// @tparam Compare Ordering of the values. A transparent comparator such
+/// as the default less<> enables lookups with other key types.
+/// @tparam Alloc Node allocator template, see node_pool.hpp.
+/// @tparam Stats Operation statistics policy, see tree_stats.hpp.
+template <class T, class Compare = less<>, template <class> class Alloc = NodePool, class Stats = NullStats>
 class AVLTree
 {
 private:
@@ -21,10 +48,15 @@ private:
     struct Node
     {
         U data{};
-        size_t count{0};        // Count of duplicate values
-        long balance_factor{0}; // AVL balance factor
+        size_t count{0};         // Count of duplicate values
+        long balance_factor{0};  // AVL balance factor
+        long height{0};          // Height of the subtree rooted at this node
+        size_t subtree_size{0};  // Values in the subtree, duplicates included
+        size_t subtree_nodes{0}; // Nodes in the subtree
+        [[no_unique_address]] KeyPrefix<U, key_prefix_enabled_v<U, Compare>> prefix; // Leading key bytes, see key_prefix.hpp
         Node *left{nullptr};
         Node *right{nullptr};
+        Node *parent{nullptr}; // nullptr for the root
 
         // Constructor for creating a new node
         Node() {}
@@ -35,75 +67,258 @@ private:
         /// @param t_right Node pointer to right child.
         /// @param t_count Number of occurrence of the value.
         /// @param t_balance_factor Balance factor.
-        Node(U t_data, Node *t_left = nullptr, Node *t_right = nullptr, size_t t_count = 1, long t_balance_factor = 0) : data(t_data), left(t_left), right(t_right), count(t_count), balance_factor(t_balance_factor) {}
+        Node(U t_data, Node *t_left = nullptr, Node *t_right = nullptr, size_t t_count = 1, long t_balance_factor = 0) : data(std::move(t_data)), count(t_count), balance_factor(t_balance_factor), subtree_size(t_count + (t_left ? t_left->subtree_size : 0) + (t_right ? t_right->subtree_size : 0)), subtree_nodes(1 + (t_left ? t_left->subtree_nodes : 0) + (t_right ? t_right->subtree_nodes : 0)), prefix(data), left(t_left), right(t_right) {}
     };
 
     Node<T> *m_root{nullptr};
     size_t m_size{0};
+    Alloc<Node<T>> m_pool; // Allocator the nodes come from
+    vector<Node<T> **> m_path; // Links followed by the last insert, reused between calls
+    Compare m_compare;         // Ordering of the values
+    [[no_unique_address]] mutable Stats m_stats; // Operation counters; empty unless enabled
+
+    /// @brief Compares two values with m_compare, counting the comparison.
+    template <class A, class B>
+    bool less_than(const A &t_lhs, const B &t_rhs) const
+    {
+        m_stats.comparison();
+        return m_compare(t_lhs, t_rhs);
+    }
 
-    /// @brief Calculates the sum of the heights of each node of a subtree.
-    /// @param t_node_ptr Pointer to root of subtree.
-    /// @return Sum of the heights of the tree.
-    void sum_heights(Node<T> *t_node_ptr, size_t &total_height);
+    /// @brief Whether lookups with keys of type K compare the cached key
+    /// prefixes of the nodes before the keys themselves.
+    template <class K>
+    static constexpr bool compares_prefix = key_prefix_enabled_v<T, Compare> && is_convertible_v<const K &, string_view>;
+
+    /// @brief Prefix of a lookup key, computed once per lookup.
+    /// @return The prefix, or 0 if prefixes are not compared.
+    template <class K>
+    static uint64_t probe_prefix(const K &t_key)
+    {
+        if constexpr (compares_prefix<K>)
+            return key_prefix(string_view(t_key));
+        else
+            return 0;
+    }
+
+    /// @brief Orders a key against the value of a node. With cached
+    /// prefixes a single integer compare decides unless the prefixes tie.
+    /// @param t_key Key to compare.
+    /// @param t_prefix probe_prefix(t_key).
+    /// @param t_node_ptr Pointer to node.
+    /// @return Negative if the key is ordered first, positive if after, 0 if
+    /// equivalent.
+    template <class K>
+    int compare_to_node(const K &t_key, uint64_t t_prefix, const Node<T> *t_node_ptr) const
+    {
+        if constexpr (compares_prefix<K>)
+        {
+            m_stats.comparison();
+            if (t_prefix != t_node_ptr->prefix.value)
+                return t_prefix < t_node_ptr->prefix.value ? -1 : 1;
+            return string_view(t_key).compare(string_view(t_node_ptr->data));
+        }
+        else
+        {
+            if (less_than(t_key, t_node_ptr->data))
+                return -1;
+            return less_than(t_node_ptr->data, t_key) ? 1 : 0;
+        }
+    }
 
     /// @brief Inserts a node into the tree.
     /// @param t_node_ptr Pointer to the root of the subtree.
-    /// @param t_data Data for node to store.
-    void insert_node(Node<T> *&t_node_ptr, T t_data);
+    /// @param t_data Data for node to store; forwarded into a new node.
+    template <class V>
+    void insert_node(Node<T> *&t_node_ptr, V &&t_data);
 
     /// @brief Destroys a subtree.
     /// @param t_node_ptr Pointer to root of subtree.
     void destroy_subtree(Node<T> *&t_node_ptr);
 
-    /// @brief Inorder print of values.
-    /// @param t_node_ptr
-    void in_order(Node<T> *t_node_ptr);
-
-    /// @brief Preorder print of values.
-    /// @param t_node_ptr
-    void pre_order(Node<T> *t_node_ptr);
-
-    /// @brief Postorder print of values.
-    /// @param t_node_ptr
-    void post_order(Node<T> *t_node_ptr);
-
-    /// @brief Remove a node with the specified value.
-    /// @param t_data Value of node to be removed.
+    /// @brief Removes one occurrence of a value.
+    /// @param t_data Value to be removed.
     /// @param t_node_ptr Pointer to root of subtree.
-    void remove_node(T t_data, Node<T> *&t_node_ptr);
-
-    /// @brief Deletes a node.
+    /// @return true if the value was in the subtree, false otherwise.
+    template <class K>
+    bool remove_node(const K &t_data, Node<T> *&t_node_ptr);
+
+    /// @brief Removes the values within an inclusive range of keys.
+    /// @param t_lo Lower bound, inclusive.
+    /// @param t_hi Upper bound, inclusive.
+    /// @return Number of values removed, duplicates included.
+    template <class K>
+    size_t erase_range_nodes(const K &t_lo, const K &t_hi);
+
+    /// @brief Finds the node holding a value.
+    /// @param t_data Value to look for.
+    /// @return Pointer to node, nullptr if the value is not in the tree.
+    template <class K>
+    Node<T> *find_node(const K &t_data) const;
+
+    /// @brief Unlinks and frees a node, then rebalances its ancestors.
     /// @param t_node_ptr Pointer to node.
-    void delete_node(Node<T> *&t_node_ptr);
+    /// @param t_root Pointer to root of the subtree holding the node.
+    void delete_node(Node<T> *t_node_ptr, Node<T> *&t_root);
 
     /// @brief Calculates height of the subtree.
     /// @param t_node_ptr Pointer to root of the subtree.
     /// @return Height of the subtree.
     size_t sub_tree_height(Node<T> *t_node_ptr);
 
-    /// @brief Computes the avl values.
-    /// @param t_node_ptr Pointer to root of subtree.
-    void compute_avl_values(Node<T> *&t_node_ptr);
-
-    /// @brief Checks if subtree is left heavy.
-    /// @param t_node_ptr Pointer to root of subtree.
-    /// @return true if left heavy, false otherwise.
-    bool left_heavy(Node<T> *t_node_ptr);
+    /// @brief Refreshes the cached height, balance factor and subtree size
+    /// of a node from the cached values of its children.
+    /// @param t_node_ptr Pointer to node.
+    void update_avl_values(Node<T> *t_node_ptr);
 
-    /// @brief Checks if subtree is right heavy.
+    /// @brief Restores the AVL property at a node whose children are
+    /// already balanced, using a single or double rotation.
     /// @param t_node_ptr Pointer to root of subtree.
-    /// @return true if right heavy, false otherwise.
-    bool right_heavy(Node<T> *t_node_ptr);
+    void rebalance(Node<T> *&t_node_ptr);
+
+    /// @brief Builds a perfectly balanced subtree from a sorted, duplicate
+    /// free range of keys.
+    /// @param t_keys Sorted distinct keys; moved from.
+    /// @param t_counts Number of occurrences of each key.
+    /// @param t_lo Index of the first key of the range.
+    /// @param t_hi Index one past the last key of the range.
+    /// @return Pointer to root of the new subtree.
+    Node<T> *build_subtree(vector<T> &t_keys, vector<size_t> &t_counts, size_t t_lo, size_t t_hi);
+
+    /// @brief Folds runs of equal keys of a sorted vector into one key each.
+    /// @param t_keys Sorted keys; shrunk to the distinct keys.
+    /// @param t_counts Filled with the number of occurrences of each key.
+    void fold_duplicates(vector<T> &t_keys, vector<size_t> &t_counts) const;
+
+    /// @brief Links already constructed nodes, ordered by key, into a
+    /// perfectly balanced subtree. The top t_spawn_depth levels hand their
+    /// left half to another thread.
+    /// @param t_nodes Nodes in key order.
+    /// @param t_lo Index of the first node of the range.
+    /// @param t_hi Index one past the last node of the range.
+    /// @param t_spawn_depth Number of levels that fork.
+    /// @return Pointer to root of the new subtree.
+    Node<T> *link_subtree(Node<T> **t_nodes, size_t t_lo, size_t t_hi, size_t t_spawn_depth);
+
+    /// @brief Undoes a failed parallel build: destroys the nodes that were
+    /// constructed and returns every allocated slot to the pool.
+    /// @param t_nodes Slots in key order, nullptr where none was allocated.
+    /// @param t_offsets Index of the first slot of each bucket.
+    /// @param t_built Number of nodes constructed in each bucket.
+    void release_nodes(const vector<Node<T> *> &t_nodes, const vector<size_t> &t_offsets, const vector<size_t> &t_built);
+
+    /// @brief Finds the first node not ordered before a key, or after it.
+    /// @param t_key Key to compare with.
+    /// @param t_strict false for the first node >= key, true for > key.
+    /// @return Pointer to node, nullptr if there is none.
+    template <class K>
+    Node<T> *bound_node(const K &t_key, bool t_strict) const;
+
+    /// @brief Counts the values ordered before a key.
+    /// @param t_key Key to compare with.
+    /// @param t_inclusive Whether values equal to the key are counted too.
+    /// @return Number of values less than (or equal to) the key.
+    template <class K>
+    size_t count_before(const K &t_key, bool t_inclusive) const;
+
+    /// @brief Runs a group of lookups level by level, prefetching the next
+    /// node of each lookup so their cache misses overlap.
+    /// @param t_keys Keys to look up.
+    /// @param t_results One result per key; set to t_found(node) for found
+    /// keys and to R{} otherwise.
+    /// @param t_group Number of lookups advanced together.
+    /// @param t_found Maps the node holding a key to its result.
+    /// @throws invalid_argument if t_results is not as long as t_keys.
+    template <class K, class R, class Found>
+    void lookup_batch(span<const K> t_keys, span<R> t_results, size_t t_group, Found t_found) const;
+
+    /// @brief Height of a subtree; -1 for an empty one.
+    static long node_height(const Node<T> *t_node_ptr) { return t_node_ptr ? t_node_ptr->height : -1; }
+
+    /// @brief Joins two subtrees and a pivot ordered between them into one
+    /// subtree in O(|height difference| + 1): the pivot is hung into the
+    /// inner spine of the taller subtree where the heights meet, then the
+    /// spine is rebalanced back up as after an insert.
+    /// @param t_left Root of the subtree of smaller values, may be nullptr.
+    /// @param t_pivot Node ordered between the subtrees; its links are
+    /// overwritten.
+    /// @param t_right Root of the subtree of greater values, may be nullptr.
+    /// @return Root of the joined subtree.
+    Node<T> *join_nodes(Node<T> *t_left, Node<T> *t_pivot, Node<T> *t_right);
+
+    /// @brief Joins two subtrees without a pivot, using the smallest node
+    /// of the right subtree as one.
+    /// @param t_left Root of the subtree of smaller values, may be nullptr.
+    /// @param t_right Root of the subtree of greater values, may be nullptr.
+    /// @return Root of the joined subtree.
+    Node<T> *join_nodes(Node<T> *t_left, Node<T> *t_right);
+
+    /// @brief Splits a subtree at a key in O(log n). The ancestors of the
+    /// position of the key are joined, bottom-up, onto the side they belong
+    /// to together with their other subtree.
+    /// @param t_root Root of the subtree; its nodes end up in the results.
+    /// @param t_key Key to split at.
+    /// @param t_less Set to the subtree of values ordered before the key.
+    /// @param t_greater Set to the subtree of values ordered after the key.
+    /// @return The detached node equivalent to the key, nullptr if none.
+    template <class K>
+    Node<T> *split_nodes(Node<T> *t_root, const K &t_key, Node<T> *&t_less, Node<T> *&t_greater);
+
+    enum class SetOperation
+    {
+        unite,
+        intersect,
+        subtract
+    };
 
-    /// @brief Writes GraphViz IDs to an output stream.
-    /// @param t_node_ptr Pointer to root of subtree.
-    /// @param VizOut Output stream.
-    void graph_viz_ids(Node<T> *t_node_ptr, ofstream &VizOut);
+    /// @brief State shared by the threads of one set operation. The pool
+    /// is not thread-safe, so copies of the other tree's nodes go into
+    /// storage taken up front, and nodes dropped from this tree are freed
+    /// once the threads are done.
+    struct SetOperationState
+    {
+        vector<Node<T> *> slots;   // Storage for copies of nodes of the other tree
+        atomic<size_t> used{0};    // Slots handed out
+        mutex dropped_mutex;       // Guards dropped
+        vector<Node<T> *> dropped; // Roots of subtrees to free
+    };
 
-    /// @brief Writes GraphViz connections to an output stream.
-    /// @param t_node_ptr Pointer to root of subtree.
-    /// @param VizOut Output stream.
-    void graph_viz_connections(Node<T> *t_node_ptr, ofstream &VizOut);
+    /// @brief Copies a subtree of another tree, shape included, into slots.
+    /// @param t_node_ptr Root of the subtree to copy.
+    /// @param t_state State providing the slots.
+    /// @return Root of the copy.
+    Node<T> *copy_subtree(const Node<T> *t_node_ptr, SetOperationState &t_state);
+
+    /// @brief Adds or subtracts the count of one node of another tree in
+    /// place, along a single path, without splitting the subtree.
+    /// @param t_root Root of the subtree of this tree; updated if the
+    /// insertion of a new node rotates it.
+    /// @param t_theirs Node of the other tree.
+    /// @param t_op SetOperation::unite or SetOperation::subtract.
+    /// @param t_state State providing the slots.
+    /// @return false if a node would have to be removed, which is left to
+    /// the caller; the subtree is then unchanged.
+    bool merge_in_place(Node<T> *&t_root, const Node<T> *t_theirs, SetOperation t_op, SetOperationState &t_state);
+
+    /// @brief Combines a subtree of this tree with a subtree of another one
+    /// by splitting this side at the root of the other and recursing on
+    /// both halves, the top t_spawn_depth levels on two threads, then
+    /// joining the results. Costs O(m log(n/m + 1)) for subtrees of m <= n
+    /// nodes.
+    /// @param t_mine Root of the subtree of this tree; its nodes are reused.
+    /// @param t_theirs Root of the subtree of the other tree; only read.
+    /// @param t_op Operation to perform.
+    /// @param t_state State of the operation.
+    /// @param t_spawn_depth Number of levels that fork.
+    /// @return Root of the resulting subtree.
+    Node<T> *set_operation(Node<T> *t_mine, const Node<T> *t_theirs, SetOperation t_op, SetOperationState &t_state, size_t t_spawn_depth);
+
+    /// @brief Runs a set operation against another tree on t_threads
+    /// threads and settles the storage afterwards.
+    /// @param t_other Other tree.
+    /// @param t_op Operation to perform.
+    /// @param t_threads Number of threads; 0 uses every hardware thread.
+    void run_set_operation(const AVLTree &t_other, SetOperation t_op, size_t t_threads);
 
     /// @brief Performs left rotation on the subtree.
     /// @param node Pointer to root of subtree.
@@ -114,10 +329,51 @@ private:
     void rotate_right(Node<T> *&t_node_ptr);
 
 public:
+    /// @brief Bidirectional in-order iterator; one step per distinct value,
+    /// with the number of occurrences available through count().
+    using iterator = TreeIterator<Node<T>, T>;
+    using const_iterator = iterator;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = reverse_iterator;
+
+    iterator begin() const { return iterator::first(&m_root); }
+    iterator end() const { return iterator(nullptr, &m_root); }
+    reverse_iterator rbegin() const { return reverse_iterator(end()); }
+    reverse_iterator rend() const { return reverse_iterator(begin()); }
+
+    /// @brief First value not less than a key, in O(log n).
+    /// @param t_data Value to compare with.
+    /// @return Iterator to the value, end() if there is none.
+    iterator lower_bound(const T &t_data) const { return iterator(bound_node(t_data, false), &m_root); }
+
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    iterator lower_bound(const K &t_key) const { return iterator(bound_node(t_key, false), &m_root); }
+
+    /// @brief First value greater than a key, in O(log n).
+    /// @param t_data Value to compare with.
+    /// @return Iterator to the value, end() if there is none.
+    iterator upper_bound(const T &t_data) const { return iterator(bound_node(t_data, true), &m_root); }
+
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    iterator upper_bound(const K &t_key) const { return iterator(bound_node(t_key, true), &m_root); }
+
+    /// @brief Range of values equivalent to a key; at most one node.
+    /// @param t_data Value to compare with.
+    /// @return Pair of lower_bound and upper_bound.
+    pair<iterator, iterator> equal_range(const T &t_data) const { return {lower_bound(t_data), upper_bound(t_data)}; }
+
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    pair<iterator, iterator> equal_range(const K &t_key) const { return {lower_bound(t_key), upper_bound(t_key)}; }
+
     /// @brief Computes the averahe node height of the tree.
     /// @return Average node height.
     double average_height();
 
+    /// @brief Gathers height, depth and level statistics of the tree in a
+    /// single linear pass.
+    /// @return Shape report of the tree.
+    TreeShape shape() { return compute_shape(m_root); }
+
     /// @brief Computes the balance factor of a specific node.
     /// @param t_node_ptr Pointer to node.
     /// @return Balance factor.
@@ -129,336 +385,1431 @@ public:
     /// @brief Delete the AVLTree object.
     ~AVLTree() { clear(); }
 
-    /// @brief Clears the tree.
-    void clear() { destroy_subtree(m_root); }
+    /// @brief Clears the tree. With a pooling allocator and trivially
+    /// destructible data the node storage is dropped block by block.
+    void clear();
 
     /// @brief Insert a value into the tree.
     /// @param t_data Value to be inserted.
-    void insert(T t_data)
-    {
-        insert_node(m_root, t_data);
-        compute_avl_values(m_root);
-    }
+    void insert(const T &t_data) { insert_node(m_root, t_data); }
+
+    /// @brief Insert a value into the tree, moving it into the new node.
+    /// @param t_data Value to be inserted.
+    void insert(T &&t_data) { insert_node(m_root, std::move(t_data)); }
+
+    /// @brief Insert a value built from the given arguments. The value is
+    /// moved into a node only if it is not already in the tree.
+    /// @param t_args Arguments forwarded to the constructor of T.
+    template <class... Args>
+    void emplace(Args &&...t_args) { insert_node(m_root, T(std::forward<Args>(t_args)...)); }
+
+    /// @brief Replaces the contents of the tree with the values of a range.
+    /// Sorted input is turned into a perfectly balanced tree in O(n);
+    /// unsorted input is sorted first. Equal values share one node.
+    /// @param t_first Iterator to the first value.
+    /// @param t_last Iterator one past the last value.
+    template <class InputIt>
+    void build(InputIt t_first, InputIt t_last);
+
+    /// @brief Parallel build. The input is split by key range with sampled
+    /// splitters; sorting, duplicate folding, node construction and linking
+    /// of the resulting subtrees then run on t_threads threads. An exception
+    /// thrown on any thread, by a comparison, a copy or an allocation, is
+    /// rethrown here once every thread has stopped; the tree is then
+    /// unchanged or empty.
+    /// @param t_first Iterator to the first value.
+    /// @param t_last Iterator one past the last value.
+    /// @param t_threads Number of threads; 0 uses every hardware thread.
+    template <class InputIt>
+    void build(InputIt t_first, InputIt t_last, size_t t_threads);
+
+    /// @brief Moves the values not ordered before a key, the key included,
+    /// into another tree in O(log n); this tree keeps the smaller values.
+    /// The nodes move without being copied, so the allocator of t_greater
+    /// shares the storage of this one; nodes it frees go back to this
+    /// tree's allocator, and clearing t_greater destroys them one by one.
+    /// @param t_key Key to split at.
+    /// @param t_greater Tree receiving the values >= t_key; its previous
+    /// contents are cleared.
+    /// @throws invalid_argument if t_greater is this tree.
+    void split(const T &t_key, AVLTree &t_greater);
+
+    /// @brief Replaces the contents of the tree with the values of two
+    /// trees and a pivot ordered between them, in O(log n). The nodes move
+    /// without being copied and both trees are left empty; either may be
+    /// this tree.
+    /// @param t_left Tree of values ordered before the pivot.
+    /// @param t_pivot Value ordered between the trees.
+    /// @param t_right Tree of values ordered after the pivot.
+    /// @throws invalid_argument if the values are not ordered that way.
+    void join(AVLTree &t_left, T t_pivot, AVLTree &t_right);
+
+    /// @brief Adds the values of another tree; the counts of values in both
+    /// are summed. Runs in parallel and costs O(m log(n/m + 1)) for trees
+    /// of m <= n nodes, plus the copies of the values new to this tree.
+    /// @param t_other Tree to add; unchanged.
+    /// @param t_threads Number of threads; 0 uses every hardware thread.
+    void union_with(const AVLTree &t_other, size_t t_threads = 0);
+
+    /// @brief Keeps only the values also in another tree, each with the
+    /// smaller of its two counts. Runs in parallel like union_with.
+    /// @param t_other Tree to intersect with; unchanged.
+    /// @param t_threads Number of threads; 0 uses every hardware thread.
+    void intersect_with(const AVLTree &t_other, size_t t_threads = 0);
+
+    /// @brief Subtracts the counts of the values of another tree, dropping
+    /// values whose count reaches zero. Runs in parallel like union_with.
+    /// @param t_other Tree to subtract; unchanged.
+    /// @param t_threads Number of threads; 0 uses every hardware thread.
+    void difference_with(const AVLTree &t_other, size_t t_threads = 0);
 
     /// @brief Print the values in the tree inorder.
-    void in_order_print() { in_order(m_root); };
+    void in_order_print() { dump(cout, TraversalOrder::in_order); };
 
     /// @brief Print the values in the tree in preorder.
-    void pre_order_print() { pre_order(m_root); };
+    void pre_order_print() { dump(cout, TraversalOrder::pre_order); };
 
     /// @brief Print the values in the tree in postorder.
-    void post_order_print() { post_order(m_root); };
+    void post_order_print() { dump(cout, TraversalOrder::post_order); };
+
+    /// @brief Calls t_visit(value, count) for every distinct value, in the
+    /// given order, without recursion.
+    /// @param t_order Traversal order.
+    /// @param t_visit Callable taking (const T &, size_t count).
+    template <class Visit>
+    void visit(TraversalOrder t_order, Visit &&t_visit) const
+    {
+        visit_nodes(m_root, t_order, [&](const Node<T> &t_node, size_t)
+                    { t_visit(t_node.data, t_node.count); });
+    }
+
+    /// @brief Writes every node to a stream through a block-buffered sink.
+    /// The text format matches the print functions, "value (bf/count)" per
+    /// line; csv and ndjson carry value, count, balance_factor and depth.
+    /// @param t_out Destination stream.
+    /// @param t_order Traversal order.
+    /// @param t_format Output format.
+    void dump(ostream &t_out, TraversalOrder t_order = TraversalOrder::in_order, DumpFormat t_format = DumpFormat::text) const;
+
+    /// @brief Check if a value exists in the tree.
+    /// @param t_data Value to be checked.
+    /// @return true if value exists, false otherwise.
+    bool search_value(const T &t_data) const { return find_node(t_data) != nullptr; }
+
+    /// @brief Check if a key comparing equivalent to a value exists in the
+    /// tree, without converting the key to T.
+    /// @param t_key Key to be checked.
+    /// @return true if value exists, false otherwise.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    bool search_value(const K &t_key) const { return find_node(t_key) != nullptr; }
 
     /// @brief Check if a value exists in the tree.
     /// @param t_data Value to be checked.
     /// @return true if value exists, false otherwise.
-    bool search_value(T t_data);
+    bool contains(const T &t_data) const { return find_node(t_data) != nullptr; }
+
+    /// @brief Check if a key exists in the tree; see search_value.
+    /// @param t_key Key to be checked.
+    /// @return true if value exists, false otherwise.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    bool contains(const K &t_key) const { return find_node(t_key) != nullptr; }
+
+    /// @brief Default and maximum number of lookups interleaved by the
+    /// batch functions.
+    static constexpr size_t default_batch_group = 16;
+    static constexpr size_t max_batch_group = 64;
+
+    /// @brief Checks many values at once, overlapping the memory latency of
+    /// independent lookups.
+    /// @param t_keys Values to be checked.
+    /// @param t_results t_results[i] is set to whether t_keys[i] exists.
+    /// @param t_group Number of lookups in flight, at most max_batch_group.
+    /// @throws invalid_argument if t_results is not as long as t_keys.
+    void contains_batch(span<const T> t_keys, span<bool> t_results, size_t t_group = default_batch_group) const
+    {
+        lookup_batch(t_keys, t_results, t_group, [](const Node<T> *) { return true; });
+    }
+
+    /// @brief Batched contains for keys of another type; needs a
+    /// transparent comparator.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    void contains_batch(span<const K> t_keys, span<bool> t_results, size_t t_group = default_batch_group) const
+    {
+        lookup_batch(t_keys, t_results, t_group, [](const Node<T> *) { return true; });
+    }
+
+    /// @brief Looks up the number of occurrences of many values at once.
+    /// @param t_keys Values to be counted.
+    /// @param t_counts t_counts[i] is set to the count of t_keys[i].
+    /// @param t_group Number of lookups in flight, at most max_batch_group.
+    /// @throws invalid_argument if t_counts is not as long as t_keys.
+    void count_batch(span<const T> t_keys, span<size_t> t_counts, size_t t_group = default_batch_group) const
+    {
+        lookup_batch(t_keys, t_counts, t_group, [](const Node<T> *t_node_ptr) { return t_node_ptr->count; });
+    }
 
-    /// @brief Remove a value from the tree.
+    /// @brief Batched count for keys of another type; needs a transparent
+    /// comparator.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    void count_batch(span<const K> t_keys, span<size_t> t_counts, size_t t_group = default_batch_group) const
+    {
+        lookup_batch(t_keys, t_counts, t_group, [](const Node<T> *t_node_ptr) { return t_node_ptr->count; });
+    }
+
+    /// @brief Remove one occurrence of a value from the tree in O(log n);
+    /// the node goes once its count reaches zero.
     /// @param t_data Value to be removed.
-    void remove(T t_data) { remove_node(t_data, m_root); };
+    /// @return true if the value was in the tree, false otherwise.
+    bool remove(const T &t_data) { return remove_node(t_data, m_root); };
+
+    /// @brief Remove one occurrence of the value comparing equivalent to a
+    /// key.
+    /// @param t_key Key of the value to be removed.
+    /// @return true if the value was in the tree, false otherwise.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    bool remove(const K &t_key) { return remove_node(t_key, m_root); };
+
+    /// @brief Removes every value v with lo <= v <= hi, duplicates included,
+    /// by splitting the range out and joining the rest back together, in
+    /// O(log n + k) for k nodes removed.
+    /// @param t_lo Lower bound, inclusive.
+    /// @param t_hi Upper bound, inclusive.
+    /// @return Number of values removed, duplicates included.
+    size_t erase_range(const T &t_lo, const T &t_hi) { return erase_range_nodes(t_lo, t_hi); }
+
+    /// @brief erase_range for keys of another type; needs a transparent
+    /// comparator.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    size_t erase_range(const K &t_lo, const K &t_hi) { return erase_range_nodes(t_lo, t_hi); }
 
     /// @brief Calculates the height of the tree.
     /// @return Height of the tree.
     size_t height() { return sub_tree_height(m_root); }
 
-    /// @brief Writes GraphViz code for a graph of the tree to a file.
+    /// @brief Copies the keys and counts into an immutable index laid out
+    /// for cache-friendly lookups. Use it once the tree is no longer
+    /// modified.
+    /// @return Frozen index with the same contains/count semantics.
+    FrozenIndex<T, Compare> freeze() const;
+
+    /// @brief Writes GraphViz code for a graph of the tree to a file in
+    /// one buffered pass; see write_graph_viz.
     /// @param file_path File path.
-    void graph_viz(string file_path);
+    /// @param t_options Depth, sampling and chain limits for large trees.
+    void graph_viz(string file_path, const GraphVizOptions &t_options = {}) const;
+
+    /// @brief Writes the tree to a binary snapshot file that load rebuilds
+    /// it from; see tree_snapshot.hpp for the format. Pointer keys do not
+    /// compile, since only their addresses would be stored.
+    /// @param file_path File path.
+    /// @throws runtime_error if the file cannot be written.
+    void save(const string &file_path) const;
+
+    /// @brief Replaces the contents of the tree with a snapshot written by
+    /// save, restoring the exact shape in linear time without comparing
+    /// keys. Keys are copied out of the file.
+    /// @param file_path File path.
+    /// @throws runtime_error if the file cannot be read, fails its checksum,
+    /// is not an AVL snapshot of this key type or holds an unbalanced tree
+    /// or keys out of order under Compare; the tree is then empty.
+    void load(const string &file_path);
+
+    /// @brief load from snapshot bytes already in memory, e.g. a mapped
+    /// file. Keys of view types such as string_view point into t_bytes,
+    /// which then has to outlive the tree; see MappedTree.
+    /// @param t_bytes Whole snapshot.
+    /// @throws runtime_error as load.
+    void load_snapshot(string_view t_bytes);
 
     /// @brief Size of the tree, meaning number of nodes.
     /// @return Size of the tree.
     size_t size();
+
+    /// @brief Number of values in the tree, duplicates included.
+    /// @return Sum of the counts of all nodes.
+    size_t total_count() const { return m_root ? m_root->subtree_size : 0; }
+
+    /// @brief Counts the values less than a key, duplicates included, in
+    /// O(log n) using the subtree sizes.
+    /// @param t_data Value to rank.
+    /// @return Number of values ordered before t_data.
+    size_t rank(const T &t_data) const { return count_before(t_data, false); }
+
+    /// @brief rank for keys of another type; needs a transparent comparator.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    size_t rank(const K &t_key) const { return count_before(t_key, false); }
+
+    /// @brief Finds the k-th smallest value in O(log n), counting each
+    /// duplicate separately, so select(rank(x)) == x for values in the tree.
+    /// @param t_index Zero-based position in sorted order.
+    /// @return Reference to the value at that position.
+    /// @throws out_of_range if t_index >= total_count().
+    const T &select(size_t t_index) const;
+
+    /// @brief Counts the values v with lo <= v <= hi in O(log n).
+    /// @param t_lo Lower bound, inclusive.
+    /// @param t_hi Upper bound, inclusive.
+    /// @return Number of values in the range, duplicates included.
+    size_t count_range(const T &t_lo, const T &t_hi) const
+    {
+        size_t upper = count_before(t_hi, true);
+        size_t lower = count_before(t_lo, false);
+        return upper > lower ? upper - lower : 0;
+    }
+
+    /// @brief count_range for keys of another type; needs a transparent
+    /// comparator.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    size_t count_range(const K &t_lo, const K &t_hi) const
+    {
+        size_t upper = count_before(t_hi, true);
+        size_t lower = count_before(t_lo, false);
+        return upper > lower ? upper - lower : 0;
+    }
+
+    /// @brief Counters gathered by the Stats policy since the last reset.
+    /// All zero with the default NullStats.
+    /// @return Copy of the counters.
+    StatsSnapshot stats() const { return m_stats.snapshot(); }
+
+    /// @brief Zeroes the counters of the Stats policy.
+    void reset_stats() { m_stats.reset(); }
 };
 
-template <class T>
-double AVLTree<T>::average_height()
+template <class T, class Compare, template <class> class Alloc, class Stats>
+double AVLTree<T, Compare, Alloc, Stats>::average_height()
 {
-    size_t total = 0;
-    sum_heights(this->m_root, total);
+    return shape().average_height;
+}
 
-    double avg_height = (double)total / (double)(this->size());
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::clear()
+{
+    auto scope = m_stats.begin(TreeOp::clear);
+    // Nodes taken over by split have to go back to their pool one by one
+    if constexpr (Alloc<Node<T>>::bulk_release && is_trivially_destructible_v<T>)
+        if (!m_pool.holds_foreign_nodes())
+        {
+            m_stats.deallocation(m_size);
+            m_root = nullptr;
+            m_size = 0;
+            m_pool.release();
+            return;
+        }
+    destroy_subtree(m_root);
+    m_pool.release();
+}
 
-    return avg_height;
+// destroy_subtree deletes each node without recursion or an explicit
+// stack; see destroy_links.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::destroy_subtree(Node<T> *&t_node_ptr)
+{
+    destroy_links(t_node_ptr, [this](Node<T> *t_node)
+                  {
+        m_pool.destroy(t_node);
+        m_stats.deallocation();
+        m_size -= 1; });
 }
 
-template <class T>
-void AVLTree<T>::sum_heights(Node<T> *t_node_ptr, size_t &total_height)
+// The insert_node method will be passed a pointer (m_root initially) and
+// a value to be added to the tree. It walks down iteratively, recording
+// the links it follows, then rebalances back up that path only until a
+// subtree's height is unchanged, so an insert costs O(log n).
+///////////////////////////////////////////////////////////////////////////////
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class V>
+void AVLTree<T, Compare, Alloc, Stats>::insert_node(Node<T> *&t_node_ptr, V &&t_data)
 {
-    if (!t_node_ptr)
+    auto scope = m_stats.begin(TreeOp::insert);
+    m_path.clear();
+    uint64_t prefix = probe_prefix(t_data);
+    Node<T> **link = &t_node_ptr;
+    while (*link)
     {
-        return;
+        m_path.push_back(link);
+        m_stats.visit();
+        (*link)->subtree_size++; // The value lands below this node either way
+        int order = compare_to_node(t_data, prefix, *link);
+        if (order < 0) // insert in the left subtree
+            link = &(*link)->left;
+        else if (order > 0) // insert in the right subtree
+            link = &(*link)->right;
+        else
+        {
+            (*link)->count++; // Update count of duplicate t_data
+            m_stats.path_depth(m_path.size());
+            return; // Shape unchanged, nothing to rebalance
+        }
     }
+    m_stats.path_depth(m_path.size());
 
-    sum_heights(t_node_ptr->left, total_height);
-    total_height += sub_tree_height(t_node_ptr);
-    sum_heights(t_node_ptr->right, total_height);
+    *link = m_pool.create(std::forward<V>(t_data)); // Insertion position found
+    (*link)->parent = m_path.empty() ? nullptr : *m_path.back();
+    m_stats.allocation();
+    m_size += 1;
+
+    while (!m_path.empty())
+    {
+        Node<T> *&ancestor = *m_path.back();
+        m_path.pop_back();
+        long old_height = ancestor->height;
+        rebalance(ancestor);
+        if (ancestor->height == old_height)
+            break;
+    }
+    for (Node<T> **ancestor : m_path) // Above the rebalanced part only the node count changes
+        (*ancestor)->subtree_nodes++;
 }
 
-template <class T>
-void AVLTree<T>::destroy_subtree(Node<T> *&t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::dump(ostream &t_out, TraversalOrder t_order, DumpFormat t_format) const
 {
-    if (t_node_ptr)
+    BufferedSink sink(t_out);
+    switch (t_format)
     {
-        destroy_subtree(t_node_ptr->left);
-        destroy_subtree(t_node_ptr->right);
-        delete t_node_ptr;
-        t_node_ptr = nullptr;
-        m_size -= 1;
+    case DumpFormat::text:
+        visit_nodes(m_root, t_order, [&](const Node<T> &t_node, size_t)
+                    {
+            sink.write_text(t_node.data);
+            sink.write(" (");
+            sink.write_integer(t_node.balance_factor);
+            sink.put('/');
+            sink.write_integer(t_node.count);
+            sink.write(")\n"); });
+        break;
+    case DumpFormat::csv:
+        sink.write("value,count,balance_factor,depth\n");
+        visit_nodes(m_root, t_order, [&](const Node<T> &t_node, size_t t_depth)
+                    {
+            sink.write_csv(t_node.data);
+            sink.put(',');
+            sink.write_integer(t_node.count);
+            sink.put(',');
+            sink.write_integer(t_node.balance_factor);
+            sink.put(',');
+            sink.write_integer(t_depth);
+            sink.put('\n'); });
+        break;
+    case DumpFormat::ndjson:
+        visit_nodes(m_root, t_order, [&](const Node<T> &t_node, size_t t_depth)
+                    {
+            sink.write("{\"value\":");
+            sink.write_json(t_node.data);
+            sink.write(",\"count\":");
+            sink.write_integer(t_node.count);
+            sink.write(",\"balance_factor\":");
+            sink.write_integer(t_node.balance_factor);
+            sink.write(",\"depth\":");
+            sink.write_integer(t_depth);
+            sink.write("}\n"); });
+        break;
     }
 }
 
-// The insert_node method is a recursive private method that will be passed
-// a pointer (m_root initially) and an integer to be added to the tree.
-///////////////////////////////////////////////////////////////////////////////
-template <class T>
-void AVLTree<T>::insert_node(Node<T> *&t_node_ptr, T t_data)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+typename AVLTree<T, Compare, Alloc, Stats>::template Node<T> *AVLTree<T, Compare, Alloc, Stats>::find_node(const K &t_data) const
 {
-    if (!t_node_ptr) // Insertion position found
+    auto scope = m_stats.begin(TreeOp::search);
+    uint64_t prefix = probe_prefix(t_data);
+    Node<T> *t_node_ptr = m_root;
+    size_t depth = 0;
+    while (t_node_ptr)
     {
-        t_node_ptr = new Node<T>(t_data);
-        m_size += 1;
+        m_stats.visit();
+        depth++;
+        int order = compare_to_node(t_data, prefix, t_node_ptr);
+        if (order < 0)
+            t_node_ptr = t_node_ptr->left;
+        else if (order > 0)
+            t_node_ptr = t_node_ptr->right;
+        else
+            break;
     }
-    else if (t_data == t_node_ptr->data)
-        t_node_ptr->count++;            // Update count of duplicate t_data
-    else if (t_data < t_node_ptr->data) // insert in the left subtree
-        insert_node(t_node_ptr->left, t_data);
-    else // insert in the right subtree
-        insert_node(t_node_ptr->right, t_data);
+    m_stats.path_depth(depth);
+    return t_node_ptr;
 }
 
-// Prints the in_order traversal of the tree.
-template <class T>
-void AVLTree<T>::in_order(Node<T> *t_node_ptr)
+// Walks down to the node holding t_data. A duplicate only loses one from
+// its count, which the subtree sizes of its ancestors follow; the last
+// occurrence takes the node with it.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+bool AVLTree<T, Compare, Alloc, Stats>::remove_node(const K &t_data, Node<T> *&t_node_ptr)
 {
-    if (t_node_ptr)
+    auto scope = m_stats.begin(TreeOp::remove);
+    uint64_t prefix = probe_prefix(t_data);
+    Node<T> *node = t_node_ptr;
+    size_t depth = 0;
+    while (node)
+    {
+        m_stats.visit();
+        depth++;
+        int order = compare_to_node(t_data, prefix, node);
+        if (order == 0)
+            break;
+        node = order < 0 ? node->left : node->right;
+    }
+    m_stats.path_depth(depth);
+    if (!node)
+        return false;
+
+    if (node->count > 1)
     {
-        in_order(t_node_ptr->left);
-        cout << t_node_ptr->data << " "
-             << "(" << t_node_ptr->balance_factor << "/" << t_node_ptr->count << ")\n";
-        in_order(t_node_ptr->right);
+        node->count--;
+        for (; node; node = node->parent)
+            node->subtree_size--;
     }
+    else
+        delete_node(node, t_node_ptr);
+    return true;
 }
 
-// Prints the post_order traversal of the tree.
-template <class T>
-void AVLTree<T>::post_order(Node<T> *t_node_ptr)
+// A node with two children is replaced by its in-order successor, which is
+// relinked rather than copied so other nodes keep their addresses. The
+// lowest node whose subtree lost a node is where the retrace starts: it
+// refreshes and rebalances every ancestor up to the root, one path, so a
+// delete costs O(log n).
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::delete_node(Node<T> *t_node_ptr, Node<T> *&t_root)
 {
-    if (t_node_ptr)
+    Node<T> *parent = t_node_ptr->parent;
+    Node<T> *&link = parent_link(t_node_ptr, t_root);
+    Node<T> *retrace; // Lowest node whose subtree changed
+    if (!t_node_ptr->left || !t_node_ptr->right)
+    {
+        splice_link(link);
+        retrace = parent;
+    }
+    else
+    {
+        Node<T> *successor = leftmost(t_node_ptr->right);
+        if (successor == t_node_ptr->right)
+            retrace = successor;
+        else
+        {
+            retrace = successor->parent;
+            retrace->left = successor->right;
+            if (successor->right)
+                successor->right->parent = retrace;
+            successor->right = t_node_ptr->right;
+            successor->right->parent = successor;
+        }
+        successor->left = t_node_ptr->left;
+        successor->left->parent = successor;
+        successor->parent = parent;
+        link = successor;
+    }
+    m_pool.destroy(t_node_ptr);
+    m_stats.deallocation();
+    m_size -= 1;
+
+    while (retrace)
     {
-        post_order(t_node_ptr->left);
-        post_order(t_node_ptr->right);
-        cout << t_node_ptr->data << " "
-             << "(" << t_node_ptr->balance_factor << "/" << t_node_ptr->count << ")\n";
+        Node<T> *up = retrace->parent;
+        rebalance(up ? (up->left == retrace ? up->left : up->right) : t_root);
+        retrace = up;
     }
 }
 
-// Prints the post_order traversal of the tree.
-template <class T>
-void AVLTree<T>::pre_order(Node<T> *t_node_ptr)
+// Heights are cached in the nodes, so this is O(1).
+template <class T, class Compare, template <class> class Alloc, class Stats>
+size_t AVLTree<T, Compare, Alloc, Stats>::sub_tree_height(Node<T> *t_node_ptr)
 {
-    if (t_node_ptr)
+    if (!t_node_ptr)
+        return 0;
+
+    return t_node_ptr->height;
+}
+
+// Credit to:  Terry Griffin
+// Creates GraphViz code so the tree can be visualized. Each node is
+// labelled with its value, balance factor and count.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::graph_viz(string file_path, const GraphVizOptions &t_options) const
+{
+    write_graph_viz_file(file_path, m_root, t_options, [](BufferedSink &t_sink, const Node<T> &t_node)
+                         {
+        t_sink.write_dot(t_node.data);
+        t_sink.write("\\nBF| ");
+        t_sink.write_integer(t_node.balance_factor);
+        t_sink.write("\\nC|");
+        t_sink.write_integer(t_node.count); });
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::save(const string &file_path) const
+{
+    static_assert(snapshot_key_v<T>, "pointer keys would be saved as addresses");
+    ofstream out(file_path, ios::binary | ios::trunc);
+    if (!out || !write_snapshot<T>(m_root, m_size, SnapshotKind::avl, out))
+        throw runtime_error("AVLTree::save: cannot write " + file_path);
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::load(const string &file_path)
+{
+    static_assert(snapshot_key_v<T>, "pointer keys would be loaded as addresses from another process");
+    static_assert(!snapshot_view_key_v<T>, "keys would point into a temporary buffer; use load_snapshot on a mapped file");
+    ifstream in(file_path, ios::binary);
+    if (!in)
     {
-        cout << t_node_ptr->data << " "
-             << "(" << t_node_ptr->balance_factor << "/" << t_node_ptr->count << ")\n";
-        pre_order(t_node_ptr->left);
-        pre_order(t_node_ptr->right);
+        clear();
+        throw runtime_error("AVLTree::load: cannot read " + file_path);
     }
+    string bytes(istreambuf_iterator<char>(in), {});
+    load_snapshot(bytes);
 }
 
-template <class T>
-bool AVLTree<T>::search_value(T t_data)
+// The nodes come back in preorder, where every node precedes its
+// children, so walking them backwards refreshes the cached values of each
+// node after those of its children. The stored balance factors must agree
+// with the heights this recomputes and stay within one, and the keys must
+// be strictly increasing under m_compare, since duplicates share a node.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::load_snapshot(string_view t_bytes)
 {
-    Node<T> *t_node_ptr = m_root;
-    while (t_node_ptr)
+    clear();
+    auto scope = m_stats.begin(TreeOp::build);
+    vector<Node<T> *> nodes;
+    m_root = read_snapshot<T>(t_bytes, SnapshotKind::avl, [this](T t_key, const SnapshotRecord &t_record)
+                              {
+        Node<T> *node = m_pool.create(std::move(t_key));
+        node->count = t_record.count;
+        node->balance_factor = t_record.balance_factor;
+        return node; }, nodes);
+    m_size = nodes.size();
+    m_stats.allocation(m_size);
+
+    SnapshotOrderCheck<Node<T>> order;
+    for (size_t i = nodes.size(); i-- > 0;)
     {
-        if (t_node_ptr->data == t_data)
-            return true;
-        else if (t_data < t_node_ptr->data)
-            t_node_ptr = t_node_ptr->left;
-        else
-            t_node_ptr = t_node_ptr->right;
+        long stored = nodes[i]->balance_factor;
+        update_avl_values(nodes[i]);
+        if (nodes[i]->balance_factor != stored || nodes[i]->balance_factor < -1 || nodes[i]->balance_factor > 1)
+        {
+            clear();
+            throw runtime_error("AVLTree::load: balance factors do not match the shape");
+        }
+        if (!order.visit(nodes[i], [this](const T &t_lhs, const T &t_rhs)
+                         { return less_than(t_lhs, t_rhs); }))
+        {
+            clear();
+            throw runtime_error("AVLTree::load: keys are not in order");
+        }
+    }
+}
+
+// Rotates the subtree left, promoting the right child. Only the two
+// nodes whose children change need their cached values refreshed.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::rotate_left(Node<T> *&t_node_ptr)
+{
+    Node<T> *node = t_node_ptr;
+    rotate_link_left(t_node_ptr);
+    update_avl_values(node);
+    update_avl_values(t_node_ptr);
+}
+
+// Rotates the subtree right, promoting the left child.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::rotate_right(Node<T> *&t_node_ptr)
+{
+    Node<T> *node = t_node_ptr;
+    rotate_link_right(t_node_ptr);
+    update_avl_values(node);
+    update_avl_values(t_node_ptr);
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+long AVLTree<T, Compare, Alloc, Stats>::balance_factor(Node<T> *t_node_ptr)
+{
+    long leftheight = t_node_ptr->left ? t_node_ptr->left->height : -1;
+    long rightheight = t_node_ptr->right ? t_node_ptr->right->height : -1;
+    return leftheight - rightheight;
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::update_avl_values(Node<T> *t_node_ptr)
+{
+    long leftheight = t_node_ptr->left ? t_node_ptr->left->height : -1;
+    long rightheight = t_node_ptr->right ? t_node_ptr->right->height : -1;
+    t_node_ptr->height = max(leftheight, rightheight) + 1;
+    t_node_ptr->balance_factor = leftheight - rightheight;
+    t_node_ptr->subtree_size = t_node_ptr->count + (t_node_ptr->left ? t_node_ptr->left->subtree_size : 0) + (t_node_ptr->right ? t_node_ptr->right->subtree_size : 0);
+    t_node_ptr->subtree_nodes = 1 + (t_node_ptr->left ? t_node_ptr->left->subtree_nodes : 0) + (t_node_ptr->right ? t_node_ptr->right->subtree_nodes : 0);
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::rebalance(Node<T> *&t_node_ptr)
+{
+    update_avl_values(t_node_ptr);
+    if (t_node_ptr->balance_factor > 1)
+    {
+        bool left_right = t_node_ptr->left->balance_factor < 0;
+        if (left_right)
+            rotate_left(t_node_ptr->left);
+        rotate_right(t_node_ptr);
+        m_stats.rotation(left_right);
     }
-    return false;
+    else if (t_node_ptr->balance_factor < -1)
+    {
+        bool right_left = t_node_ptr->right->balance_factor > 0;
+        if (right_left)
+            rotate_right(t_node_ptr->right);
+        rotate_left(t_node_ptr);
+        m_stats.rotation(right_left);
+    }
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class InputIt>
+void AVLTree<T, Compare, Alloc, Stats>::build(InputIt t_first, InputIt t_last)
+{
+    vector<T> keys(t_first, t_last);
+    if (!is_sorted(keys.begin(), keys.end(), m_compare))
+        sort(keys.begin(), keys.end(), m_compare);
+
+    vector<size_t> counts;
+    fold_duplicates(keys, counts);
+
+    clear();
+    auto scope = m_stats.begin(TreeOp::build);
+    m_root = build_subtree(keys, counts, 0, keys.size());
+    m_stats.allocation(keys.size());
+    m_size = keys.size();
 }
 
-template <class T>
-void AVLTree<T>::remove_node(T t_data, Node<T> *&t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class InputIt>
+void AVLTree<T, Compare, Alloc, Stats>::build(InputIt t_first, InputIt t_last, size_t t_threads)
 {
-    if (t_data < t_node_ptr->data)
-        remove_node(t_data, t_node_ptr->left);
-    else if (t_data > t_node_ptr->data)
-        remove_node(t_data, t_node_ptr->right);
+    if constexpr (!is_base_of_v<random_access_iterator_tag, typename iterator_traits<InputIt>::iterator_category>)
+    {
+        vector<T> values(t_first, t_last);
+        build(values.begin(), values.end(), t_threads);
+    }
     else
-        delete_node(t_node_ptr);
+    {
+        t_threads = resolve_thread_count(t_threads);
+        vector<vector<T>> buckets = parallel_sorted_buckets<T>(t_first, t_last, m_compare, t_threads);
+
+        // Equal keys never straddle buckets, so each bucket folds its own
+        vector<vector<size_t>> counts(buckets.size());
+        parallel_for(buckets.size(), t_threads, [&](size_t bucket)
+                     { fold_duplicates(buckets[bucket], counts[bucket]); });
+
+        vector<size_t> offsets(buckets.size() + 1, 0);
+        for (size_t bucket = 0; bucket < buckets.size(); bucket++)
+            offsets[bucket + 1] = offsets[bucket] + buckets[bucket].size();
+        size_t unique = offsets.back();
+
+        // The pool is not thread-safe: take the storage up front, then
+        // construct the nodes concurrently. If anything throws, the nodes
+        // built so far are destroyed and all the storage goes back to the
+        // pool, leaving the tree empty.
+        clear();
+        auto scope = m_stats.begin(TreeOp::build);
+        vector<Node<T> *> nodes(unique, nullptr);
+        vector<size_t> built(buckets.size(), 0); // Nodes constructed per bucket
+        try
+        {
+            for (Node<T> *&node : nodes)
+                node = m_pool.allocate();
+            parallel_for(buckets.size(), t_threads, [&](size_t bucket)
+                         {
+                for (size_t i = 0; i < buckets[bucket].size(); i++)
+                {
+                    Node<T> *node = new (nodes[offsets[bucket] + i]) Node<T>(std::move(buckets[bucket][i]));
+                    node->count = counts[bucket][i];
+                    built[bucket]++;
+                }
+                vector<T>().swap(buckets[bucket]); });
+
+            size_t spawn_depth = 0;
+            while (((size_t)1 << spawn_depth) < t_threads)
+                spawn_depth++;
+            m_root = link_subtree(nodes.data(), 0, unique, spawn_depth);
+        }
+        catch (...)
+        {
+            release_nodes(nodes, offsets, built);
+            throw;
+        }
+        m_stats.allocation(unique);
+        m_size = unique;
+    }
 }
 
-template <class T>
-void AVLTree<T>::delete_node(Node<T> *&t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::fold_duplicates(vector<T> &t_keys, vector<size_t> &t_counts) const
 {
-    Node<T> *temp_node_ptr;
-    if (t_node_ptr == nullptr)
-        cout << "Cannot delete empty node.\n";
-    else if (t_node_ptr->right == nullptr)
+    t_counts.clear();
+    size_t unique = 0;
+    for (size_t i = 0; i < t_keys.size(); i++)
     {
-        temp_node_ptr = t_node_ptr;
-        t_node_ptr = t_node_ptr->left;
-        delete temp_node_ptr;
-        m_size -= 1;
+        if (unique && !m_compare(t_keys[unique - 1], t_keys[i]))
+            t_counts[unique - 1]++;
+        else
+        {
+            if (unique != i)
+                t_keys[unique] = std::move(t_keys[i]);
+            t_counts.push_back(1);
+            unique++;
+        }
     }
-    else if (t_node_ptr->left == nullptr)
+    t_keys.resize(unique);
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::release_nodes(const vector<Node<T> *> &t_nodes, const vector<size_t> &t_offsets, const vector<size_t> &t_built)
+{
+    for (size_t bucket = 0; bucket < t_built.size(); bucket++)
+        for (size_t i = 0; i < t_built[bucket]; i++)
+            t_nodes[t_offsets[bucket] + i]->~Node<T>();
+    for (Node<T> *node : t_nodes)
+        if (node)
+            m_pool.deallocate(node);
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+typename AVLTree<T, Compare, Alloc, Stats>::template Node<T> *AVLTree<T, Compare, Alloc, Stats>::link_subtree(Node<T> **t_nodes, size_t t_lo, size_t t_hi, size_t t_spawn_depth)
+{
+    if (t_lo == t_hi)
+        return nullptr;
+
+    size_t mid = t_lo + (t_hi - t_lo) / 2;
+    Node<T> *node = t_nodes[mid];
+    if (t_spawn_depth > 0)
     {
-        temp_node_ptr = t_node_ptr;
-        t_node_ptr = t_node_ptr->right;
-        delete temp_node_ptr;
-        m_size -= 1;
+        auto left = async(launch::async, [=, this]()
+                          { return link_subtree(t_nodes, t_lo, mid, t_spawn_depth - 1); });
+        node->right = link_subtree(t_nodes, mid + 1, t_hi, t_spawn_depth - 1);
+        node->left = left.get();
     }
     else
     {
-        temp_node_ptr = t_node_ptr->right;
-        while (temp_node_ptr->left)
-            temp_node_ptr = temp_node_ptr->left;
-        temp_node_ptr->left = t_node_ptr->left;
-        temp_node_ptr = t_node_ptr;
-        t_node_ptr = t_node_ptr->right;
-        delete temp_node_ptr;
-        m_size -= 1;
+        node->left = link_subtree(t_nodes, t_lo, mid, 0);
+        node->right = link_subtree(t_nodes, mid + 1, t_hi, 0);
     }
-    compute_avl_values(t_node_ptr);
+    if (node->left)
+        node->left->parent = node;
+    if (node->right)
+        node->right->parent = node;
+    update_avl_values(node);
+    return node;
 }
 
-template <class T>
-size_t AVLTree<T>::sub_tree_height(Node<T> *t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+typename AVLTree<T, Compare, Alloc, Stats>::template Node<T> *AVLTree<T, Compare, Alloc, Stats>::build_subtree(vector<T> &t_keys, vector<size_t> &t_counts, size_t t_lo, size_t t_hi)
 {
-	if(!t_node_ptr)
-	return 0;
+    if (t_lo == t_hi)
+        return nullptr;
+
+    size_t mid = t_lo + (t_hi - t_lo) / 2;
+    Node<T> *node = m_pool.create(std::move(t_keys[mid]));
+    node->count = t_counts[mid];
+    node->left = build_subtree(t_keys, t_counts, t_lo, mid);
+    node->right = build_subtree(t_keys, t_counts, mid + 1, t_hi);
+    if (node->left)
+        node->left->parent = node;
+    if (node->right)
+        node->right->parent = node;
+    update_avl_values(node);
+    return node;
+}
 
-	if(!t_node_ptr->left && !t_node_ptr->right)
-	return 0;
+// Both trees are detached before anything is freed, so either may be this
+// tree. This tree's pool adopts the pools of the two trees before they are
+// cleared, so the storage of the moved nodes lives and is recycled here.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::join(AVLTree &t_left, T t_pivot, AVLTree &t_right)
+{
+    Node<T> *left_max = t_left.m_root;
+    while (left_max && left_max->right)
+        left_max = left_max->right;
+    Node<T> *right_min = t_right.m_root;
+    while (right_min && right_min->left)
+        right_min = right_min->left;
+    if ((left_max && !less_than(left_max->data, t_pivot)) || (right_min && !less_than(t_pivot, right_min->data)))
+        throw invalid_argument("AVLTree::join: values must be ordered left < pivot < right");
+
+    Node<T> *left = t_left.m_root;
+    Node<T> *right = t_right.m_root;
+    t_left.m_root = nullptr;
+    t_left.m_size = 0;
+    t_right.m_root = nullptr;
+    t_right.m_size = 0;
+    if (&t_left != this && &t_right != this)
+        clear();
+    m_pool.adopt(t_left.m_pool);
+    m_pool.adopt(t_right.m_pool);
+    if (&t_left != this)
+        t_left.clear();
+    if (&t_right != this)
+        t_right.clear();
+
+    auto scope = m_stats.begin(TreeOp::split_join);
+    Node<T> *pivot = m_pool.create(std::move(t_pivot));
+    m_stats.allocation();
+    m_root = join_nodes(left, pivot, right);
+    m_size = m_root->subtree_nodes;
+}
 
-	size_t left_height = sub_tree_height(t_node_ptr->left);
-	size_t right_height = sub_tree_height(t_node_ptr->right);
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::split(const T &t_key, AVLTree &t_greater)
+{
+    if (&t_greater == this)
+        throw invalid_argument("AVLTree::split: cannot split a tree into itself");
+    t_greater.clear();
+
+    auto scope = m_stats.begin(TreeOp::split_join);
+    Node<T> *less;
+    Node<T> *greater;
+    Node<T> *found = split_nodes(m_root, t_key, less, greater);
+    if (found)
+        greater = join_nodes(nullptr, found, greater);
+    m_root = less;
+    m_size = less ? less->subtree_nodes : 0;
+    t_greater.m_root = greater;
+    t_greater.m_size = greater ? greater->subtree_nodes : 0;
+    t_greater.m_pool.share(m_pool);
+}
 
-	return max(left_height, right_height) + 1;
+// The range is cut out with two splits, its nodes freed, and the values
+// on either side joined back together.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+size_t AVLTree<T, Compare, Alloc, Stats>::erase_range_nodes(const K &t_lo, const K &t_hi)
+{
+    if (!m_root || less_than(t_hi, t_lo))
+        return 0;
+
+    auto scope = m_stats.begin(TreeOp::remove);
+    size_t before = m_root->subtree_size;
+    Node<T> *less;
+    Node<T> *rest;
+    Node<T> *range;
+    Node<T> *greater;
+    Node<T> *first = split_nodes(m_root, t_lo, less, rest);
+    Node<T> *last = split_nodes(rest, t_hi, range, greater);
+    destroy_subtree(range);
+    if (first)
+        destroy_subtree(first);
+    if (last)
+        destroy_subtree(last);
+    m_root = join_nodes(less, greater);
+    m_size = m_root ? m_root->subtree_nodes : 0;
+    return before - (m_root ? m_root->subtree_size : 0);
 }
 
-// Credit to:  Terry Griffin
-// Method to help create GraphViz code so the expression tree can
-// be visualized. This method prints out all the unique node id's
-// by traversing the tree.
-// Recivies a node pointer to m_root and performs a simple recursive
-// tree traversal.
-//////////////////////////////////////////////////////////////////////
-template <class T>
-void AVLTree<T>::graph_viz_ids(Node<T> *t_node_ptr, ofstream &VizOut)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+typename AVLTree<T, Compare, Alloc, Stats>::template Node<T> *AVLTree<T, Compare, Alloc, Stats>::join_nodes(Node<T> *t_left, Node<T> *t_pivot, Node<T> *t_right)
+{
+    if (t_left)
+        t_left->parent = nullptr;
+    if (t_right)
+        t_right->parent = nullptr;
+    long left_height = node_height(t_left);
+    long right_height = node_height(t_right);
+    if (left_height - right_height <= 1 && right_height - left_height <= 1)
+    {
+        t_pivot->left = t_left;
+        t_pivot->right = t_right;
+        t_pivot->parent = nullptr;
+        if (t_left)
+            t_left->parent = t_pivot;
+        if (t_right)
+            t_right->parent = t_pivot;
+        update_avl_values(t_pivot);
+        return t_pivot;
+    }
+
+    // Walk down the inner spine of the taller subtree to the first subtree
+    // at most one level taller than the shorter one; the pivot takes its
+    // place with that subtree and the shorter one as children
+    bool left_taller = left_height > right_height;
+    Node<T> *root = left_taller ? t_left : t_right;
+    long shorter_height = left_taller ? right_height : left_height;
+    Node<T> *parent = nullptr;
+    Node<T> *node = root;
+    while (node_height(node) > shorter_height + 1)
+    {
+        m_stats.visit();
+        parent = node;
+        node = left_taller ? node->right : node->left;
+    }
+    if (left_taller)
+    {
+        t_pivot->left = node;
+        t_pivot->right = t_right;
+        parent->right = t_pivot;
+    }
+    else
+    {
+        t_pivot->left = t_left;
+        t_pivot->right = node;
+        parent->left = t_pivot;
+    }
+    t_pivot->parent = parent;
+    if (t_pivot->left)
+        t_pivot->left->parent = t_pivot;
+    if (t_pivot->right)
+        t_pivot->right->parent = t_pivot;
+    update_avl_values(t_pivot);
+
+    // Every node of the spine walked gained values, so all of them are
+    // refreshed, rotating where the pivot made them too tall
+    while (parent)
+    {
+        Node<T> *up = parent->parent;
+        rebalance(up ? (left_taller ? up->right : up->left) : root);
+        parent = up;
+    }
+    return root;
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+typename AVLTree<T, Compare, Alloc, Stats>::template Node<T> *AVLTree<T, Compare, Alloc, Stats>::join_nodes(Node<T> *t_left, Node<T> *t_right)
 {
-    if (t_node_ptr)
+    if (!t_left || !t_right)
+    {
+        Node<T> *root = t_left ? t_left : t_right;
+        if (root)
+            root->parent = nullptr;
+        return root;
+    }
+
+    // Unlink the smallest node of the right subtree and rebalance its left
+    // spine as a remove would
+    t_right->parent = nullptr;
+    Node<T> *pivot = leftmost(t_right);
+    Node<T> *parent = pivot->parent;
+    if (pivot->right)
+        pivot->right->parent = parent;
+    if (parent)
+        parent->left = pivot->right;
+    else
+        t_right = pivot->right;
+    while (parent)
     {
-        graph_viz_ids(t_node_ptr->left, VizOut);
-        VizOut << " node" << t_node_ptr->data << " [label=\"" << t_node_ptr->data << "\\nBF| " << t_node_ptr->balance_factor << "\\nC|" << t_node_ptr->count << "\"]" << '\n';
-        graph_viz_ids(t_node_ptr->right, VizOut);
+        Node<T> *up = parent->parent;
+        rebalance(up ? up->left : t_right);
+        parent = up;
     }
+    return join_nodes(t_left, pivot, t_right);
 }
 
-template <class T>
-void AVLTree<T>::graph_viz_connections(Node<T> *t_node_ptr, ofstream &VizOut)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+typename AVLTree<T, Compare, Alloc, Stats>::template Node<T> *AVLTree<T, Compare, Alloc, Stats>::split_nodes(Node<T> *t_root, const K &t_key, Node<T> *&t_less, Node<T> *&t_greater)
 {
-    if (t_node_ptr)
+    if (t_root)
+        t_root->parent = nullptr;
+    uint64_t prefix = probe_prefix(t_key);
+    Node<T> *parent = nullptr;
+    Node<T> *node = t_root;
+    bool from_left = false; // Whether node is the left child of parent
+    while (node)
+    {
+        m_stats.visit();
+        int order = compare_to_node(t_key, prefix, node);
+        if (order == 0)
+            break;
+        parent = node;
+        from_left = order < 0;
+        node = from_left ? node->left : node->right;
+    }
+
+    t_less = node ? node->left : nullptr;
+    t_greater = node ? node->right : nullptr;
+    if (node)
     {
-        if (t_node_ptr->left)
-            VizOut << "  node" << t_node_ptr->data << "->"
-                   << " node" << t_node_ptr->left->data << '\n';
-        if (t_node_ptr->right)
-            VizOut << "  node" << t_node_ptr->data << "->"
-                   << " node" << t_node_ptr->right->data << '\n';
-        graph_viz_connections(t_node_ptr->left, VizOut);
-        graph_viz_connections(t_node_ptr->right, VizOut);
+        node->left = nullptr;
+        node->right = nullptr;
+        node->parent = nullptr;
+        update_avl_values(node);
     }
+    while (parent)
+    {
+        Node<T> *up = parent->parent;
+        bool up_from_left = up && up->left == parent;
+        if (from_left)
+            t_greater = join_nodes(t_greater, parent, parent->right);
+        else
+            t_less = join_nodes(parent->left, parent, t_less);
+        parent = up;
+        from_left = up_from_left;
+    }
+    if (t_less)
+        t_less->parent = nullptr;
+    if (t_greater)
+        t_greater->parent = nullptr;
+    return node;
 }
 
-template <class T>
-void AVLTree<T>::graph_viz(string file_path)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::union_with(const AVLTree &t_other, size_t t_threads)
 {
-    ofstream VizOut;
-    VizOut.open(file_path);
-    VizOut << "digraph g { \n";
-    graph_viz_ids(m_root, VizOut);
-    graph_viz_connections(m_root, VizOut);
-    VizOut << "} \n";
-    VizOut.close();
+    run_set_operation(t_other, SetOperation::unite, t_threads);
 }
 
-template <class T>
-bool AVLTree<T>::left_heavy(Node<T> *t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::intersect_with(const AVLTree &t_other, size_t t_threads)
 {
-    return (sub_tree_height(t_node_ptr->left) > sub_tree_height(t_node_ptr->right));
+    run_set_operation(t_other, SetOperation::intersect, t_threads);
 }
 
-template <class T>
-bool AVLTree<T>::right_heavy(Node<T> *t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::difference_with(const AVLTree &t_other, size_t t_threads)
 {
-    return (sub_tree_height(t_node_ptr->right) > sub_tree_height(t_node_ptr->left));
+    run_set_operation(t_other, SetOperation::subtract, t_threads);
 }
 
-template <class T>
-void AVLTree<T>::rotate_left(Node<T> *&t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void AVLTree<T, Compare, Alloc, Stats>::run_set_operation(const AVLTree &t_other, SetOperation t_op, size_t t_threads)
 {
-    if (t_node_ptr->right != nullptr && left_heavy(t_node_ptr->right))
+    if (&t_other == this)
+    {
+        // Every value meets itself: counts double, stay or drop out
+        if (t_op == SetOperation::subtract)
+            clear();
+        else if (t_op == SetOperation::unite)
+        {
+            vector<Node<T> *> stack;
+            if (m_root)
+                stack.push_back(m_root);
+            while (!stack.empty())
+            {
+                Node<T> *node = stack.back();
+                stack.pop_back();
+                node->count *= 2;
+                node->subtree_size *= 2;
+                if (node->left)
+                    stack.push_back(node->left);
+                if (node->right)
+                    stack.push_back(node->right);
+            }
+        }
+        return;
+    }
+
+    auto scope = m_stats.begin(TreeOp::set_operation);
+    SetOperationState state;
+    if (t_op == SetOperation::unite)
     {
-        rotate_right(t_node_ptr->right);
+        state.slots.resize(t_other.m_size);
+        for (Node<T> *&slot : state.slots)
+            slot = m_pool.allocate();
     }
 
-    Node<T> *Temp;
-    Temp = t_node_ptr->right;
-    t_node_ptr->right = Temp->left;
-    Temp->left = t_node_ptr;
-    t_node_ptr = Temp;
+    // Stats policies are not thread-safe, so a counting tree stays on the
+    // calling thread
+    size_t spawn_depth = 0;
+    if constexpr (!Stats::enabled)
+    {
+        t_threads = resolve_thread_count(t_threads);
+        while (((size_t)1 << spawn_depth) < t_threads)
+            spawn_depth++;
+    }
+    m_root = set_operation(m_root, t_other.m_root, t_op, state, spawn_depth);
+
+    for (size_t i = state.used; i < state.slots.size(); i++)
+        m_pool.deallocate(state.slots[i]);
+    m_stats.allocation(state.used);
+    for (Node<T> *root : state.dropped)
+        destroy_subtree(root);
+    m_size = m_root ? m_root->subtree_nodes : 0;
+}
 
-    compute_avl_values(t_node_ptr);
+template <class T, class Compare, template <class> class Alloc, class Stats>
+typename AVLTree<T, Compare, Alloc, Stats>::template Node<T> *AVLTree<T, Compare, Alloc, Stats>::copy_subtree(const Node<T> *t_node_ptr, SetOperationState &t_state)
+{
+    if (!t_node_ptr)
+        return nullptr;
+
+    Node<T> *node = new (t_state.slots[t_state.used++]) Node<T>(t_node_ptr->data);
+    node->count = t_node_ptr->count;
+    node->left = copy_subtree(t_node_ptr->left, t_state);
+    node->right = copy_subtree(t_node_ptr->right, t_state);
+    if (node->left)
+        node->left->parent = node;
+    if (node->right)
+        node->right->parent = node;
+    update_avl_values(node);
+    return node;
 }
 
-template <class T>
-void AVLTree<T>::rotate_right(Node<T> *&t_node_ptr)
+// Half the nodes of a tree are leaves, and a leaf of the other tree splits
+// this side only to join it right back together. Walking one path and
+// fixing the counts on it, or inserting as insert_node does, is cheaper.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+bool AVLTree<T, Compare, Alloc, Stats>::merge_in_place(Node<T> *&t_root, const Node<T> *t_theirs, SetOperation t_op, SetOperationState &t_state)
 {
-    if (t_node_ptr->left != nullptr && right_heavy(t_node_ptr->left))
+    uint64_t prefix = probe_prefix(t_theirs->data);
+    Node<T> *parent = nullptr;
+    Node<T> *node = t_root;
+    int order = 0;
+    while (node)
     {
-        rotate_left(t_node_ptr->left);
+        m_stats.visit();
+        order = compare_to_node(t_theirs->data, prefix, node);
+        if (order == 0)
+            break;
+        parent = node;
+        node = order < 0 ? node->left : node->right;
     }
-    Node<T> *Temp;
-    Temp = t_node_ptr->left;
-    t_node_ptr->left = Temp->right;
-    Temp->right = t_node_ptr;
-    t_node_ptr = Temp;
-    compute_avl_values(t_node_ptr);
+
+    size_t count = t_theirs->count;
+    if (node)
+    {
+        if (t_op == SetOperation::subtract && node->count <= count)
+            return false;
+        node->count = t_op == SetOperation::unite ? node->count + count : node->count - count;
+        for (; node; node = node->parent)
+            node->subtree_size = t_op == SetOperation::unite ? node->subtree_size + count : node->subtree_size - count;
+        return true;
+    }
+    if (t_op == SetOperation::subtract)
+        return true;
+
+    node = new (t_state.slots[t_state.used++]) Node<T>(t_theirs->data, nullptr, nullptr, count);
+    node->parent = parent;
+    (order < 0 ? parent->left : parent->right) = node;
+    while (parent)
+    {
+        Node<T> *up = parent->parent;
+        rebalance(up ? (up->left == parent ? up->left : up->right) : t_root);
+        parent = up;
+    }
+    return true;
 }
 
-template <class T>
-long AVLTree<T>::balance_factor(Node<T> *t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+typename AVLTree<T, Compare, Alloc, Stats>::template Node<T> *AVLTree<T, Compare, Alloc, Stats>::set_operation(Node<T> *t_mine, const Node<T> *t_theirs, SetOperation t_op, SetOperationState &t_state, size_t t_spawn_depth)
 {
-    size_t leftheight = sub_tree_height(t_node_ptr->left);
-    size_t rightheight = sub_tree_height(t_node_ptr->right);
-    return leftheight - rightheight;
+    auto drop = [&t_state](Node<T> *t_root)
+    {
+        lock_guard<mutex> lock(t_state.dropped_mutex);
+        t_state.dropped.push_back(t_root);
+    };
+
+    if (!t_theirs)
+    {
+        if (t_op != SetOperation::intersect)
+            return t_mine;
+        if (t_mine)
+            drop(t_mine);
+        return nullptr;
+    }
+    if (!t_mine)
+        return t_op == SetOperation::unite ? copy_subtree(t_theirs, t_state) : nullptr;
+    if (!t_theirs->left && !t_theirs->right && t_op != SetOperation::intersect && merge_in_place(t_mine, t_theirs, t_op, t_state))
+        return t_mine;
+
+    // Forking pays off only for subtrees with enough nodes between them
+    bool fork = t_spawn_depth > 0 && t_mine->subtree_nodes + t_theirs->subtree_nodes >= 4096;
+    Node<T> *less;
+    Node<T> *greater;
+    Node<T> *found = split_nodes(t_mine, t_theirs->data, less, greater);
+    if (fork)
+    {
+        auto left = async(launch::async, [=, &t_state, this]()
+                          { return set_operation(less, t_theirs->left, t_op, t_state, t_spawn_depth - 1); });
+        greater = set_operation(greater, t_theirs->right, t_op, t_state, t_spawn_depth - 1);
+        less = left.get();
+    }
+    else
+    {
+        less = set_operation(less, t_theirs->left, t_op, t_state, 0);
+        greater = set_operation(greater, t_theirs->right, t_op, t_state, 0);
+    }
+
+    if (t_op == SetOperation::unite)
+    {
+        if (found)
+            found->count += t_theirs->count;
+        else
+        {
+            found = new (t_state.slots[t_state.used++]) Node<T>(t_theirs->data);
+            found->count = t_theirs->count;
+        }
+    }
+    else if (found && t_op == SetOperation::intersect)
+        found->count = min(found->count, t_theirs->count);
+    else if (found && found->count > t_theirs->count)
+        found->count -= t_theirs->count;
+    else if (found)
+    {
+        drop(found);
+        found = nullptr;
+    }
+    return found ? join_nodes(less, found, greater) : join_nodes(less, greater);
 }
 
-template <class T>
-void AVLTree<T>::compute_avl_values(Node<T> *&t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+FrozenIndex<T, Compare> AVLTree<T, Compare, Alloc, Stats>::freeze() const
 {
-    if (t_node_ptr)
+    vector<T> keys;
+    vector<size_t> counts;
+    keys.reserve(m_size);
+    counts.reserve(m_size);
+
+    vector<Node<T> *> stack;
+    Node<T> *t_node_ptr = m_root;
+    while (t_node_ptr || !stack.empty())
     {
-        compute_avl_values(t_node_ptr->left);
-        compute_avl_values(t_node_ptr->right);
-        t_node_ptr->balance_factor = balance_factor(t_node_ptr);
-        if (t_node_ptr->balance_factor > 1)
-            rotate_right(t_node_ptr);
-        else if (t_node_ptr->balance_factor < -1)
-            rotate_left(t_node_ptr);
+        while (t_node_ptr)
+        {
+            stack.push_back(t_node_ptr);
+            t_node_ptr = t_node_ptr->left;
+        }
+        t_node_ptr = stack.back();
+        stack.pop_back();
+        keys.push_back(t_node_ptr->data);
+        counts.push_back(t_node_ptr->count);
+        t_node_ptr = t_node_ptr->right;
     }
+
+    return FrozenIndex<T, Compare>(std::move(keys), std::move(counts), m_compare);
 }
 
-template <class T>
-size_t AVLTree<T>::size()
+// Lookups are processed in groups. In every round each unfinished lookup
+// of the group takes one step down the tree and prefetches the node it
+// moved to, so by the time the round comes back to it the node is likely
+// in cache.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K, class R, class Found>
+void AVLTree<T, Compare, Alloc, Stats>::lookup_batch(span<const K> t_keys, span<R> t_results, size_t t_group, Found t_found) const
+{
+    if (t_results.size() != t_keys.size())
+        throw invalid_argument("AVLTree: batch lookups need one result per key");
+    fill(t_results.begin(), t_results.end(), R{});
+    auto scope = m_stats.begin(TreeOp::search, t_keys.size());
+    t_group = clamp<size_t>(t_group, 1, max_batch_group);
+    Node<T> *cursor[max_batch_group];
+    uint64_t prefixes[max_batch_group];
+
+    for (size_t base = 0; base < t_keys.size(); base += t_group)
+    {
+        size_t group = min(t_group, t_keys.size() - base);
+        for (size_t i = 0; i < group; i++)
+        {
+            cursor[i] = m_root;
+            prefixes[i] = probe_prefix(t_keys[base + i]);
+        }
+
+        size_t active = group;
+        size_t depth = 0; // Rounds run; the deepest lookup of the group
+        while (active)
+        {
+            active = 0;
+            depth++;
+            for (size_t i = 0; i < group; i++)
+            {
+                Node<T> *t_node_ptr = cursor[i];
+                if (!t_node_ptr)
+                    continue;
+                m_stats.visit();
+                int order = compare_to_node(t_keys[base + i], prefixes[i], t_node_ptr);
+                if (order < 0)
+                    t_node_ptr = t_node_ptr->left;
+                else if (order > 0)
+                    t_node_ptr = t_node_ptr->right;
+                else
+                {
+                    t_results[base + i] = t_found(t_node_ptr);
+                    t_node_ptr = nullptr;
+                }
+                if (t_node_ptr)
+                {
+                    __builtin_prefetch(t_node_ptr);
+                    active++;
+                }
+                cursor[i] = t_node_ptr;
+            }
+        }
+        m_stats.path_depth(depth);
+    }
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+size_t AVLTree<T, Compare, Alloc, Stats>::size()
 {
     return m_size;
 }
 
+// Keeps the last node that satisfied the bound while descending towards
+// the smallest such node.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+typename AVLTree<T, Compare, Alloc, Stats>::template Node<T> *AVLTree<T, Compare, Alloc, Stats>::bound_node(const K &t_key, bool t_strict) const
+{
+    auto scope = m_stats.begin(TreeOp::search);
+    Node<T> *bound = nullptr;
+    Node<T> *t_node_ptr = m_root;
+    while (t_node_ptr)
+    {
+        m_stats.visit();
+        bool satisfies = t_strict ? less_than(t_key, t_node_ptr->data) : !less_than(t_node_ptr->data, t_key);
+        if (satisfies)
+        {
+            bound = t_node_ptr;
+            t_node_ptr = t_node_ptr->left;
+        }
+        else
+            t_node_ptr = t_node_ptr->right;
+    }
+    return bound;
+}
+
+// Walks one root-to-leaf path; every time it moves right, the left
+// subtree and the node itself are all ordered before the key.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+size_t AVLTree<T, Compare, Alloc, Stats>::count_before(const K &t_key, bool t_inclusive) const
+{
+    auto scope = m_stats.begin(TreeOp::search);
+    size_t before = 0;
+    Node<T> *t_node_ptr = m_root;
+    while (t_node_ptr)
+    {
+        m_stats.visit();
+        bool node_before = t_inclusive ? !less_than(t_key, t_node_ptr->data) : less_than(t_node_ptr->data, t_key);
+        if (node_before)
+        {
+            before += t_node_ptr->count + (t_node_ptr->left ? t_node_ptr->left->subtree_size : 0);
+            t_node_ptr = t_node_ptr->right;
+        }
+        else
+            t_node_ptr = t_node_ptr->left;
+    }
+    return before;
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+const T &AVLTree<T, Compare, Alloc, Stats>::select(size_t t_index) const
+{
+    if (t_index >= total_count())
+        throw out_of_range("AVLTree::select: index out of range");
+
+    auto scope = m_stats.begin(TreeOp::search);
+    Node<T> *t_node_ptr = m_root;
+    while (true)
+    {
+        m_stats.visit();
+        size_t left_size = t_node_ptr->left ? t_node_ptr->left->subtree_size : 0;
+        if (t_index < left_size)
+            t_node_ptr = t_node_ptr->left;
+        else if (t_index < left_size + t_node_ptr->count)
+            return t_node_ptr->data;
+        else
+        {
+            t_index -= left_size + t_node_ptr->count;
+            t_node_ptr = t_node_ptr->right;
+        }
+    }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,967 @@
+/// Header file for the policy-based balanced tree core
+#ifndef BALANCED_TREE
+#define BALANCED_TREE
+#include <iostream>
+#include <fstream>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <type_traits>
+#include <string>
+#include "tree_shape.hpp"
+#include "tree_stats.hpp"
+#include "tree_iterator.hpp"
+#include "tree_traversal.hpp"
+#include "tree_sink.hpp"
+#include "tree_graphviz.hpp"
+#include "tree_links.hpp"
+#include "node_pool.hpp"
+
+using namespace std;
+
+// BalancedTree is one binary search tree core whose balancing scheme is a
+// template parameter. The core does the searching, linking, counting and
+// freeing; a balance policy only keeps its per-node state and decides
+// where to rotate. The policy is resolved at compile time, so the hot
+// paths have no virtual calls and every scheme runs the same code around
+// its rotations.
+//
+// A balance policy is a class with the following static members. The tree
+// calls them with itself and a node; they may use the tree's m_root and
+// its rotate_left, rotate_right, swap_with_successor and splice:
+//   struct NodeState                 balance data kept in every node
+//   void inserted(Tree &, Node *)    restore the balance after a new leaf
+//                                    was linked in
+//   void erase(Tree &, Node *)       unlink a node whose count dropped to
+//                                    zero and restore the balance; the
+//                                    tree frees the node afterwards
+//   static constexpr const char *name  short name for reports
+// A self-adjusting policy may also define
+//   void accessed(Tree &, Node *)    called with the node a search, a
+//                                    duplicate insert or a partial remove
+//                                    reached, or the last node visited on
+//                                    a miss
+// The Stats policy counts every rotation as a single one, so a double
+// rotation counts twice.
+//
+// BalancedTree is a parallel implementation next to AVLTree and
+// BinarySearchTree, not a base they are built on: its node layout, its
+// insert and remove paths and the policies are its own, so a change to
+// one of those trees does not reach it. What all three share are the
+// pointer moves of tree_links.hpp (rotations, splicing, successor search
+// and the stackless teardown), the shape and height helpers of
+// tree_shape.hpp and the DOT writer of tree_graphviz.hpp.
+
+struct AVLBalance;
+
+/// @brief A class template for binary search trees with a pluggable
+/// balancing scheme. Equal values share one node with an occurrence count.
+/// @tparam T The type for the data to be stored in the tree.
+/// @tparam Balance Balance policy: NoBalance, AVLBalance, RedBlackBalance,
+/// WAVLBalance, TreapBalance or SplayBalance.
+/// @tparam Compare Ordering of the values. A transparent comparator such
+/// as the default less<> enables lookups with other key types.
+/// @tparam Alloc Node allocator template, see node_pool.hpp.
+/// @tparam Stats Operation statistics policy, see tree_stats.hpp.
+template <class T, class Balance = AVLBalance, class Compare = less<>, template <class> class Alloc = NodePool, class Stats = NullStats>
+class BalancedTree
+{
+private:
+    friend Balance;
+
+    struct Node
+    {
+        T data{};
+        size_t count{1};        // Count of duplicate values
+        size_t subtree_size{1}; // Values in the subtree, duplicates included
+        [[no_unique_address]] typename Balance::NodeState state; // Balance data of the policy
+        Node *left{nullptr};
+        Node *right{nullptr};
+        Node *parent{nullptr}; // nullptr for the root
+
+        Node() {}
+        explicit Node(T t_data) : data(std::move(t_data)) {}
+    };
+
+    Node *m_root{nullptr};
+    size_t m_size{0};
+    Alloc<Node> m_pool; // Allocator the nodes come from
+    Compare m_compare;  // Ordering of the values
+    [[no_unique_address]] mutable Stats m_stats; // Operation counters; empty unless enabled
+
+    /// @brief Compares two values with m_compare, counting the comparison.
+    template <class A, class B>
+    bool less_than(const A &t_lhs, const B &t_rhs) const
+    {
+        m_stats.comparison();
+        return m_compare(t_lhs, t_rhs);
+    }
+
+    /// @brief Refreshes the subtree size of a node from its children.
+    static void update_size(Node *t_node_ptr)
+    {
+        t_node_ptr->subtree_size = t_node_ptr->count + (t_node_ptr->left ? t_node_ptr->left->subtree_size : 0) + (t_node_ptr->right ? t_node_ptr->right->subtree_size : 0);
+    }
+
+    /// @brief The link pointing at a node: a child pointer of its parent,
+    /// or m_root.
+    Node *&link_to(Node *t_node_ptr) { return parent_link(t_node_ptr, m_root); }
+
+    /// @brief Rotates a subtree left, promoting the right child.
+    /// @param t_node_ptr Pointer to root of subtree.
+    /// @return The promoted node, now root of the subtree.
+    Node *rotate_left(Node *t_node_ptr);
+
+    /// @brief Rotates a subtree right, promoting the left child.
+    /// @param t_node_ptr Pointer to root of subtree.
+    /// @return The promoted node, now root of the subtree.
+    Node *rotate_right(Node *t_node_ptr);
+
+    /// @brief Exchanges the places and balance states of a node with two
+    /// children and its in-order successor, so the node can be spliced out.
+    /// @param t_node_ptr Pointer to node; its count must be zero.
+    void swap_with_successor(Node *t_node_ptr);
+
+    /// @brief Unlinks a node with at most one child, which takes its place.
+    /// @param t_node_ptr Pointer to node.
+    /// @return The child now in the node's place, nullptr if none.
+    Node *splice(Node *t_node_ptr);
+
+    /// @brief Finds the node holding a value.
+    /// @param t_data Value to look for.
+    /// @return Pointer to node, nullptr if the value is not in the tree.
+    template <class K>
+    Node *find_node(const K &t_data) const;
+
+    /// @brief Finds the node holding a value and reports the access to a
+    /// self-adjusting policy, which may move the node.
+    /// @param t_data Value to look for.
+    /// @return Pointer to node, nullptr if the value is not in the tree.
+    template <class K>
+    Node *access_node(const K &t_data);
+
+    /// @brief Passes an accessed node to the policy if it defines
+    /// accessed(); does nothing otherwise.
+    /// @param t_node_ptr Pointer to node, may be nullptr.
+    void touch(Node *t_node_ptr)
+    {
+        if constexpr (requires { Balance::accessed(*this, t_node_ptr); })
+            if (t_node_ptr)
+                Balance::accessed(*this, t_node_ptr);
+    }
+
+    /// @brief Inserts a value, or counts one more occurrence of it.
+    /// @param t_data Value; forwarded into a new node.
+    template <class V>
+    void insert_node(V &&t_data);
+
+    /// @brief Removes one occurrence of a value.
+    /// @param t_data Value to be removed.
+    /// @return true if the value was in the tree, false otherwise.
+    template <class K>
+    bool remove_node(const K &t_data);
+
+    /// @brief Destroys a subtree.
+    /// @param t_node_ptr Pointer to root of subtree.
+    void destroy_subtree(Node *&t_node_ptr);
+
+public:
+    /// @brief Bidirectional in-order iterator; one step per distinct value,
+    /// with the number of occurrences available through count().
+    using iterator = TreeIterator<Node, T>;
+    using const_iterator = iterator;
+
+    iterator begin() const { return iterator::first(&m_root); }
+    iterator end() const { return iterator(nullptr, &m_root); }
+
+    /// @brief Create a default BalancedTree object.
+    BalancedTree() {}
+
+    /// @brief Delete the BalancedTree object.
+    ~BalancedTree() { clear(); }
+
+    /// @brief Clears the tree. With a pooling allocator and trivially
+    /// destructible data the node storage is dropped block by block.
+    void clear();
+
+    /// @brief Insert a value into the tree.
+    /// @param t_data Value to be inserted.
+    void insert(const T &t_data) { insert_node(t_data); }
+
+    /// @brief Insert a value into the tree, moving it into the new node.
+    /// @param t_data Value to be inserted.
+    void insert(T &&t_data) { insert_node(std::move(t_data)); }
+
+    /// @brief Remove one occurrence of a value from the tree; the node goes
+    /// once its count reaches zero.
+    /// @param t_data Value to be removed.
+    /// @return true if the value was in the tree, false otherwise.
+    bool remove(const T &t_data) { return remove_node(t_data); }
+
+    /// @brief Remove one occurrence of the value comparing equivalent to a
+    /// key.
+    /// @param t_key Key of the value to be removed.
+    /// @return true if the value was in the tree, false otherwise.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    bool remove(const K &t_key) { return remove_node(t_key); }
+
+    /// @brief Search for a value. Under a self-adjusting policy such as
+    /// SplayBalance this moves the node reached toward the root; otherwise
+    /// it is the same as contains.
+    /// @param t_data Value to search for.
+    /// @return true if value exists, false otherwise.
+    bool search(const T &t_data) { return access_node(t_data) != nullptr; }
+
+    /// @brief Search for the value comparing equivalent to a key, without
+    /// converting the key to T; see search.
+    /// @param t_key Key to search for.
+    /// @return true if value exists, false otherwise.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    bool search(const K &t_key) { return access_node(t_key) != nullptr; }
+
+    /// @brief Check if a value exists in the tree, leaving the shape as it
+    /// is under every policy.
+    /// @param t_data Value to be checked.
+    /// @return true if value exists, false otherwise.
+    bool contains(const T &t_data) const { return find_node(t_data) != nullptr; }
+
+    /// @brief Check if a key comparing equivalent to a value exists in the
+    /// tree, without converting the key to T.
+    /// @param t_key Key to be checked.
+    /// @return true if value exists, false otherwise.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    bool contains(const K &t_key) const { return find_node(t_key) != nullptr; }
+
+    /// @brief Number of occurrences of a value.
+    /// @param t_data Value to be counted.
+    /// @return Count of the value, 0 if it is not in the tree.
+    size_t count(const T &t_data) const
+    {
+        const Node *node = find_node(t_data);
+        return node ? node->count : 0;
+    }
+
+    /// @brief Calls t_visit(value, count) for every distinct value, in the
+    /// given order, without recursion.
+    /// @param t_order Traversal order.
+    /// @param t_visit Callable taking (const T &, size_t count).
+    template <class Visit>
+    void visit(TraversalOrder t_order, Visit &&t_visit) const
+    {
+        visit_nodes(m_root, t_order, [&](const Node &t_node, size_t)
+                    { t_visit(t_node.data, t_node.count); });
+    }
+
+    /// @brief Size of the tree, meaning number of nodes.
+    /// @return Size of the tree.
+    size_t size() const { return m_size; }
+
+    /// @brief Number of values in the tree, duplicates included.
+    /// @return Sum of the counts of all nodes.
+    size_t total_count() const { return m_root ? m_root->subtree_size : 0; }
+
+    /// @brief Calculates the height of the tree; O(1) for policies caching
+    /// heights, a linear pass otherwise.
+    /// @return Height of the tree.
+    size_t height() const;
+
+    /// @brief Computes the average node height of the tree.
+    /// @return Average node height.
+    double average_height() const { return shape().average_height; }
+
+    /// @brief Gathers height, depth and level statistics of the tree in a
+    /// single linear pass.
+    /// @return Shape report of the tree.
+    TreeShape shape() const { return compute_shape(m_root); }
+
+    /// @brief Writes GraphViz code for a graph of the tree to a file in
+    /// one buffered pass; see write_graph_viz.
+    /// @param file_path File path.
+    /// @param t_options Depth, sampling and chain limits for large trees.
+    void graph_viz(string file_path, const GraphVizOptions &t_options = {}) const;
+
+    /// @brief Counters gathered by the Stats policy since the last reset.
+    /// All zero with the default NullStats.
+    /// @return Copy of the counters.
+    StatsSnapshot stats() const { return m_stats.snapshot(); }
+
+    /// @brief Zeroes the counters of the Stats policy.
+    void reset_stats() { m_stats.reset(); }
+};
+
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+void BalancedTree<T, Balance, Compare, Alloc, Stats>::clear()
+{
+    auto scope = m_stats.begin(TreeOp::clear);
+    if constexpr (Alloc<Node>::bulk_release && is_trivially_destructible_v<T>)
+    {
+        m_stats.deallocation(m_size);
+        m_root = nullptr;
+        m_size = 0;
+    }
+    else
+        destroy_subtree(m_root);
+    m_pool.release();
+}
+
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+void BalancedTree<T, Balance, Compare, Alloc, Stats>::destroy_subtree(Node *&t_node_ptr)
+{
+    destroy_links(t_node_ptr, [this](Node *t_node)
+                  {
+        m_pool.destroy(t_node);
+        m_stats.deallocation();
+        m_size -= 1; });
+}
+
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+typename BalancedTree<T, Balance, Compare, Alloc, Stats>::Node *BalancedTree<T, Balance, Compare, Alloc, Stats>::rotate_left(Node *t_node_ptr)
+{
+    Node *child = rotate_link_left(link_to(t_node_ptr));
+    child->subtree_size = t_node_ptr->subtree_size;
+    update_size(t_node_ptr);
+    m_stats.rotation(false);
+    return child;
+}
+
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+typename BalancedTree<T, Balance, Compare, Alloc, Stats>::Node *BalancedTree<T, Balance, Compare, Alloc, Stats>::rotate_right(Node *t_node_ptr)
+{
+    Node *child = rotate_link_right(link_to(t_node_ptr));
+    child->subtree_size = t_node_ptr->subtree_size;
+    update_size(t_node_ptr);
+    m_stats.rotation(false);
+    return child;
+}
+
+// The node holds no values any more, so the successor moving up keeps the
+// subtree size of the place it takes over, while every node between the
+// two places loses the successor's values.
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+void BalancedTree<T, Balance, Compare, Alloc, Stats>::swap_with_successor(Node *t_node_ptr)
+{
+    Node *successor = leftmost(t_node_ptr->right);
+    for (Node *node = successor->parent; node != t_node_ptr; node = node->parent)
+        node->subtree_size -= successor->count;
+    size_t node_size = t_node_ptr->subtree_size;
+    t_node_ptr->subtree_size = successor->subtree_size - successor->count;
+    successor->subtree_size = node_size;
+    swap(t_node_ptr->state, successor->state);
+
+    Node *&link = link_to(t_node_ptr);
+    Node *node_parent = t_node_ptr->parent;
+    Node *successor_right = successor->right;
+    if (successor == t_node_ptr->right)
+    {
+        successor->right = t_node_ptr;
+        t_node_ptr->parent = successor;
+    }
+    else
+    {
+        Node *successor_parent = successor->parent;
+        successor->right = t_node_ptr->right;
+        successor->right->parent = successor;
+        successor_parent->left = t_node_ptr;
+        t_node_ptr->parent = successor_parent;
+    }
+    successor->parent = node_parent;
+    link = successor;
+    successor->left = t_node_ptr->left;
+    successor->left->parent = successor;
+    t_node_ptr->left = nullptr;
+    t_node_ptr->right = successor_right;
+    if (successor_right)
+        successor_right->parent = t_node_ptr;
+}
+
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+typename BalancedTree<T, Balance, Compare, Alloc, Stats>::Node *BalancedTree<T, Balance, Compare, Alloc, Stats>::splice(Node *t_node_ptr)
+{
+    return splice_link(link_to(t_node_ptr));
+}
+
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+typename BalancedTree<T, Balance, Compare, Alloc, Stats>::Node *BalancedTree<T, Balance, Compare, Alloc, Stats>::find_node(const K &t_data) const
+{
+    auto scope = m_stats.begin(TreeOp::search);
+    Node *node = m_root;
+    size_t depth = 0;
+    while (node)
+    {
+        m_stats.visit();
+        depth++;
+        if (less_than(t_data, node->data))
+            node = node->left;
+        else if (less_than(node->data, t_data))
+            node = node->right;
+        else
+            break;
+    }
+    m_stats.path_depth(depth);
+    return node;
+}
+
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+typename BalancedTree<T, Balance, Compare, Alloc, Stats>::Node *BalancedTree<T, Balance, Compare, Alloc, Stats>::access_node(const K &t_data)
+{
+    auto scope = m_stats.begin(TreeOp::search);
+    Node *node = m_root;
+    Node *last = nullptr;
+    size_t depth = 0;
+    while (node)
+    {
+        m_stats.visit();
+        depth++;
+        last = node;
+        if (less_than(t_data, node->data))
+            node = node->left;
+        else if (less_than(node->data, t_data))
+            node = node->right;
+        else
+            break;
+    }
+    m_stats.path_depth(depth);
+    touch(node ? node : last);
+    return node;
+}
+
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+template <class V>
+void BalancedTree<T, Balance, Compare, Alloc, Stats>::insert_node(V &&t_data)
+{
+    auto scope = m_stats.begin(TreeOp::insert);
+    Node *parent = nullptr;
+    Node **link = &m_root;
+    size_t depth = 0;
+    while (*link)
+    {
+        Node *node = *link;
+        m_stats.visit();
+        depth++;
+        node->subtree_size++; // The value lands below this node either way
+        if (less_than(t_data, node->data))
+            link = &node->left;
+        else if (less_than(node->data, t_data))
+            link = &node->right;
+        else
+        {
+            node->count++; // Update count of duplicate t_data
+            m_stats.path_depth(depth);
+            touch(node);
+            return;
+        }
+        parent = node;
+    }
+    m_stats.path_depth(depth);
+
+    Node *node = m_pool.create(std::forward<V>(t_data));
+    node->parent = parent;
+    *link = node;
+    m_stats.allocation();
+    m_size += 1;
+    Balance::inserted(*this, node);
+}
+
+// The value leaves the subtree sizes on its path before the policy sees
+// the node, so an erased node holds no values while it is moved around.
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+bool BalancedTree<T, Balance, Compare, Alloc, Stats>::remove_node(const K &t_data)
+{
+    auto scope = m_stats.begin(TreeOp::remove);
+    Node *node = m_root;
+    Node *last = nullptr;
+    size_t depth = 0;
+    while (node)
+    {
+        m_stats.visit();
+        depth++;
+        last = node;
+        if (less_than(t_data, node->data))
+            node = node->left;
+        else if (less_than(node->data, t_data))
+            node = node->right;
+        else
+            break;
+    }
+    m_stats.path_depth(depth);
+    if (!node)
+    {
+        touch(last);
+        return false;
+    }
+
+    node->count--;
+    for (Node *ancestor = node; ancestor; ancestor = ancestor->parent)
+        ancestor->subtree_size--;
+    if (node->count == 0)
+    {
+        Balance::erase(*this, node);
+        m_pool.destroy(node);
+        m_stats.deallocation();
+        m_size -= 1;
+    }
+    else
+        touch(node);
+    return true;
+}
+
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+size_t BalancedTree<T, Balance, Compare, Alloc, Stats>::height() const
+{
+    if constexpr (requires(const Node &t_node) { t_node.state.height; })
+        return m_root ? m_root->state.height : 0;
+    else
+        return subtree_height(m_root);
+}
+
+template <class T, class Balance, class Compare, template <class> class Alloc, class Stats>
+void BalancedTree<T, Balance, Compare, Alloc, Stats>::graph_viz(string file_path, const GraphVizOptions &t_options) const
+{
+    write_graph_viz_file(file_path, m_root, t_options, [](BufferedSink &t_sink, const Node &t_node)
+                         {
+        t_sink.write_dot(t_node.data);
+        t_sink.write("\\nC|");
+        t_sink.write_integer(t_node.count); });
+}
+
+/// @brief No balancing: nodes stay where they were inserted. Unlike
+/// BinarySearchTree, which keeps one node per copy of a value, equal values
+/// share one counted node, and a removed node with two children is replaced
+/// by its successor rather than grafted, so this is a plain unbalanced
+/// tree for comparison and not a model of BinarySearchTree.
+struct NoBalance
+{
+    static constexpr const char *name = "none";
+
+    struct NodeState
+    {
+    };
+
+    template <class Tree, class Node>
+    static void inserted(Tree &, Node *) {}
+
+    template <class Tree, class Node>
+    static void erase(Tree &t_tree, Node *t_node_ptr)
+    {
+        if (t_node_ptr->left && t_node_ptr->right)
+            t_tree.swap_with_successor(t_node_ptr);
+        t_tree.splice(t_node_ptr);
+    }
+};
+
+/// @brief AVL balancing: the heights of the two subtrees of every node
+/// differ by at most one. The shallowest trees, at the price of the most
+/// rotations on removal.
+struct AVLBalance
+{
+    static constexpr const char *name = "avl";
+
+    struct NodeState
+    {
+        int height{0}; // Height of the subtree rooted at this node
+    };
+
+    template <class Node>
+    static int height(const Node *t_node_ptr) { return t_node_ptr ? t_node_ptr->state.height : -1; }
+
+    template <class Node>
+    static void update(Node *t_node_ptr) { t_node_ptr->state.height = max(height(t_node_ptr->left), height(t_node_ptr->right)) + 1; }
+
+    /// @brief Restores the AVL property at a node whose subtrees differ in
+    /// height by at most two, refreshing its height.
+    /// @return Root of the subtree afterwards.
+    template <class Tree, class Node>
+    static Node *rebalance(Tree &t_tree, Node *t_node_ptr)
+    {
+        update(t_node_ptr);
+        int balance = height(t_node_ptr->left) - height(t_node_ptr->right);
+        if (balance > 1)
+        {
+            Node *child = t_node_ptr->left;
+            if (height(child->left) < height(child->right))
+            {
+                Node *top = t_tree.rotate_left(child);
+                update(child);
+                update(top);
+            }
+            Node *top = t_tree.rotate_right(t_node_ptr);
+            update(t_node_ptr);
+            update(top);
+            return top;
+        }
+        if (balance < -1)
+        {
+            Node *child = t_node_ptr->right;
+            if (height(child->right) < height(child->left))
+            {
+                Node *top = t_tree.rotate_right(child);
+                update(child);
+                update(top);
+            }
+            Node *top = t_tree.rotate_left(t_node_ptr);
+            update(t_node_ptr);
+            update(top);
+            return top;
+        }
+        return t_node_ptr;
+    }
+
+    /// @brief Rebalances from a node up until a subtree keeps its height.
+    template <class Tree, class Node>
+    static void retrace(Tree &t_tree, Node *t_node_ptr)
+    {
+        while (t_node_ptr)
+        {
+            int old_height = t_node_ptr->state.height;
+            t_node_ptr = rebalance(t_tree, t_node_ptr);
+            if (t_node_ptr->state.height == old_height)
+                break;
+            t_node_ptr = t_node_ptr->parent;
+        }
+    }
+
+    template <class Tree, class Node>
+    static void inserted(Tree &t_tree, Node *t_node_ptr) { retrace(t_tree, t_node_ptr->parent); }
+
+    template <class Tree, class Node>
+    static void erase(Tree &t_tree, Node *t_node_ptr)
+    {
+        if (t_node_ptr->left && t_node_ptr->right)
+            t_tree.swap_with_successor(t_node_ptr);
+        Node *parent = t_node_ptr->parent;
+        t_tree.splice(t_node_ptr);
+        retrace(t_tree, parent);
+    }
+};
+
+/// @brief Red-black balancing: no red node has a red child and every path
+/// from a node down to a missing child passes the same number of black
+/// nodes. At most two rotations per insert and three per removal.
+struct RedBlackBalance
+{
+    static constexpr const char *name = "red-black";
+
+    struct NodeState
+    {
+        bool red{true}; // New nodes start red
+    };
+
+    template <class Node>
+    static bool is_red(const Node *t_node_ptr) { return t_node_ptr && t_node_ptr->state.red; }
+
+    template <class Tree, class Node>
+    static void inserted(Tree &t_tree, Node *t_node_ptr)
+    {
+        Node *node = t_node_ptr;
+        while (is_red(node->parent))
+        {
+            Node *parent = node->parent;
+            Node *grandparent = parent->parent; // A red node is never the root
+            bool parent_left = parent == grandparent->left;
+            Node *uncle = parent_left ? grandparent->right : grandparent->left;
+            if (is_red(uncle))
+            {
+                parent->state.red = false;
+                uncle->state.red = false;
+                grandparent->state.red = true;
+                node = grandparent;
+                continue;
+            }
+            if (node == (parent_left ? parent->right : parent->left))
+            {
+                parent_left ? t_tree.rotate_left(parent) : t_tree.rotate_right(parent);
+                parent = node;
+            }
+            parent->state.red = false;
+            grandparent->state.red = true;
+            parent_left ? t_tree.rotate_right(grandparent) : t_tree.rotate_left(grandparent);
+            break;
+        }
+        t_tree.m_root->state.red = false;
+    }
+
+    // The node removed from its place is missing one black on its side,
+    // carried up by x until a red node absorbs it or a rotation through
+    // the sibling w restores the count.
+    template <class Tree, class Node>
+    static void erase(Tree &t_tree, Node *t_node_ptr)
+    {
+        if (t_node_ptr->left && t_node_ptr->right)
+            t_tree.swap_with_successor(t_node_ptr);
+        Node *parent = t_node_ptr->parent;
+        bool removed_red = t_node_ptr->state.red;
+        Node *x = t_tree.splice(t_node_ptr);
+        if (removed_red)
+            return;
+
+        // A black node removed with a missing child has a sibling, so a
+        // missing x is on the side of parent that is empty
+        while (x != t_tree.m_root && !is_red(x))
+        {
+            bool x_left = x == parent->left;
+            Node *w = x_left ? parent->right : parent->left;
+            if (is_red(w))
+            {
+                w->state.red = false;
+                parent->state.red = true;
+                x_left ? t_tree.rotate_left(parent) : t_tree.rotate_right(parent);
+                w = x_left ? parent->right : parent->left;
+            }
+            if (!is_red(w->left) && !is_red(w->right))
+            {
+                w->state.red = true;
+                x = parent;
+                parent = parent->parent;
+                continue;
+            }
+            if (!is_red(x_left ? w->right : w->left))
+            {
+                (x_left ? w->left : w->right)->state.red = false;
+                w->state.red = true;
+                x_left ? t_tree.rotate_right(w) : t_tree.rotate_left(w);
+                w = x_left ? parent->right : parent->left;
+            }
+            w->state.red = parent->state.red;
+            parent->state.red = false;
+            (x_left ? w->right : w->left)->state.red = false;
+            x_left ? t_tree.rotate_left(parent) : t_tree.rotate_right(parent);
+            x = t_tree.m_root;
+        }
+        if (x)
+            x->state.red = false;
+    }
+};
+
+/// @brief Weak AVL balancing: every node has a rank, leaves rank 0 and
+/// missing children -1, and each child's rank is one or two below its
+/// parent's. Built by inserts alone the trees are AVL trees; removals
+/// only ever demote and rotate at most twice, unlike AVL.
+struct WAVLBalance
+{
+    static constexpr const char *name = "wavl";
+
+    struct NodeState
+    {
+        int rank{0}; // Rank of the node
+    };
+
+    template <class Node>
+    static int rank(const Node *t_node_ptr) { return t_node_ptr ? t_node_ptr->state.rank : -1; }
+
+    // While x is a 0-child, promote its parent if x's sibling is a
+    // 1-child; otherwise one single or double rotation ends the walk.
+    template <class Tree, class Node>
+    static void inserted(Tree &t_tree, Node *t_node_ptr)
+    {
+        Node *x = t_node_ptr;
+        Node *parent = x->parent;
+        while (parent && rank(parent) == rank(x))
+        {
+            bool x_left = parent->left == x;
+            Node *sibling = x_left ? parent->right : parent->left;
+            if (rank(parent) - rank(sibling) == 1)
+            {
+                parent->state.rank++;
+                x = parent;
+                parent = parent->parent;
+                continue;
+            }
+            Node *inner = x_left ? x->right : x->left;
+            if (rank(x) - rank(inner) == 2)
+            {
+                x_left ? t_tree.rotate_right(parent) : t_tree.rotate_left(parent);
+                parent->state.rank--;
+            }
+            else
+            {
+                x_left ? t_tree.rotate_left(x) : t_tree.rotate_right(x);
+                x_left ? t_tree.rotate_right(parent) : t_tree.rotate_left(parent);
+                inner->state.rank++;
+                x->state.rank--;
+                parent->state.rank--;
+            }
+            break;
+        }
+    }
+
+    // A leaf left with rank 1 is demoted first. Then, while x is a
+    // 3-child, the parent is demoted (with the sibling y if y is a 2,2
+    // node), until a rotation through y ends the walk.
+    template <class Tree, class Node>
+    static void erase(Tree &t_tree, Node *t_node_ptr)
+    {
+        if (t_node_ptr->left && t_node_ptr->right)
+            t_tree.swap_with_successor(t_node_ptr);
+        Node *parent = t_node_ptr->parent;
+        Node *x = t_tree.splice(t_node_ptr);
+        if (parent && !parent->left && !parent->right && parent->state.rank == 1)
+        {
+            parent->state.rank = 0;
+            x = parent;
+            parent = parent->parent;
+        }
+
+        while (parent && rank(parent) - rank(x) == 3)
+        {
+            bool x_left = parent->left == x;
+            Node *y = x_left ? parent->right : parent->left;
+            if (rank(parent) - rank(y) == 2)
+            {
+                parent->state.rank--;
+                x = parent;
+                parent = parent->parent;
+                continue;
+            }
+            if (rank(y) - rank(y->left) == 2 && rank(y) - rank(y->right) == 2)
+            {
+                parent->state.rank--;
+                y->state.rank--;
+                x = parent;
+                parent = parent->parent;
+                continue;
+            }
+            Node *outer = x_left ? y->right : y->left;
+            Node *inner = x_left ? y->left : y->right;
+            if (rank(y) - rank(outer) == 1)
+            {
+                x_left ? t_tree.rotate_left(parent) : t_tree.rotate_right(parent);
+                y->state.rank++;
+                parent->state.rank--;
+                if (!parent->left && !parent->right)
+                    parent->state.rank--;
+            }
+            else
+            {
+                x_left ? t_tree.rotate_right(y) : t_tree.rotate_left(y);
+                x_left ? t_tree.rotate_left(parent) : t_tree.rotate_right(parent);
+                inner->state.rank += 2;
+                y->state.rank--;
+                parent->state.rank -= 2;
+            }
+            break;
+        }
+    }
+};
+
+/// @brief Next pseudo-random treap priority from a per-thread xorshift
+/// generator; a fixed seed keeps runs reproducible.
+inline uint32_t treap_priority()
+{
+    thread_local uint64_t state = 0x9e3779b97f4a7c15ULL;
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (uint32_t)((state * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+/// @brief Treap balancing: every node draws a random priority and the
+/// tree is kept a max-heap on them, which gives expected logarithmic depth
+/// regardless of insertion order and about one rotation per update.
+struct TreapBalance
+{
+    static constexpr const char *name = "treap";
+
+    struct NodeState
+    {
+        uint32_t priority{treap_priority()}; // Heap order key
+    };
+
+    template <class Tree, class Node>
+    static void inserted(Tree &t_tree, Node *t_node_ptr)
+    {
+        while (t_node_ptr->parent && t_node_ptr->parent->state.priority < t_node_ptr->state.priority)
+        {
+            Node *parent = t_node_ptr->parent;
+            parent->left == t_node_ptr ? t_tree.rotate_right(parent) : t_tree.rotate_left(parent);
+        }
+    }
+
+    // Rotates the node down below its higher priority child until it has
+    // at most one child left.
+    template <class Tree, class Node>
+    static void erase(Tree &t_tree, Node *t_node_ptr)
+    {
+        while (t_node_ptr->left && t_node_ptr->right)
+        {
+            if (t_node_ptr->left->state.priority > t_node_ptr->right->state.priority)
+                t_tree.rotate_right(t_node_ptr);
+            else
+                t_tree.rotate_left(t_node_ptr);
+        }
+        t_tree.splice(t_node_ptr);
+    }
+};
+
+/// @brief Splay balancing: no balance data and no bound on the depth, but
+/// every insert and search rotates the node it reached up to the root, so
+/// keys in use stay near the top. Any m operations take O(m log n) time
+/// amortised, and skewed lookups touch far fewer nodes than in a tree of
+/// fixed shape. Only search adapts; contains and count leave the shape
+/// alone.
+struct SplayBalance
+{
+    static constexpr const char *name = "splay";
+
+    struct NodeState
+    {
+    };
+
+    /// @brief Rotates a node up by zig-zig and zig-zag steps until its
+    /// parent is t_top.
+    /// @param t_top Stop below this node; nullptr splays to the root.
+    template <class Tree, class Node>
+    static void splay(Tree &t_tree, Node *t_node_ptr, Node *t_top)
+    {
+        while (t_node_ptr->parent != t_top)
+        {
+            Node *parent = t_node_ptr->parent;
+            Node *grandparent = parent->parent;
+            bool node_left = parent->left == t_node_ptr;
+            if (grandparent == t_top)
+                node_left ? t_tree.rotate_right(parent) : t_tree.rotate_left(parent);
+            else if ((grandparent->left == parent) == node_left)
+            {
+                node_left ? t_tree.rotate_right(grandparent) : t_tree.rotate_left(grandparent);
+                node_left ? t_tree.rotate_right(parent) : t_tree.rotate_left(parent);
+            }
+            else
+            {
+                node_left ? t_tree.rotate_right(parent) : t_tree.rotate_left(parent);
+                node_left ? t_tree.rotate_left(grandparent) : t_tree.rotate_right(grandparent);
+            }
+        }
+    }
+
+    template <class Tree, class Node>
+    static void inserted(Tree &t_tree, Node *t_node_ptr) { splay(t_tree, t_node_ptr, (Node *)nullptr); }
+
+    template <class Tree, class Node>
+    static void accessed(Tree &t_tree, Node *t_node_ptr) { splay(t_tree, t_node_ptr, (Node *)nullptr); }
+
+    // The node is splayed to the root and, with two children, its
+    // successor is splayed up to be its right child, so it has no left
+    // child and a single swap and splice remove the node.
+    template <class Tree, class Node>
+    static void erase(Tree &t_tree, Node *t_node_ptr)
+    {
+        splay(t_tree, t_node_ptr, (Node *)nullptr);
+        if (t_node_ptr->left && t_node_ptr->right)
+        {
+            splay(t_tree, leftmost(t_node_ptr->right), t_node_ptr);
+            t_tree.swap_with_successor(t_node_ptr);
+        }
+        t_tree.splice(t_node_ptr);
+    }
+};
+
+/// @brief Self-adjusting search tree for skewed lookups; see SplayBalance.
+template <class T, class Compare = less<>, template <class> class Alloc = NodePool, class Stats = NullStats>
+using SplayTree = BalancedTree<T, SplayBalance, Compare, Alloc, Stats>;
+
+#endif
@@ -0,0 +1,151 @@
+// Benchmark: the balance policies of BalancedTree side by side.
+//
+// For each policy and key stream the tree is filled with n keys, searched
+// for every key in random order and then emptied again in random order.
+// One pass with CountingStats reports rotations per insert and remove and
+// nodes visited per lookup; a second pass with the default NullStats
+// measures the time per operation, best of three.
+//
+// Key streams: random (a shuffled permutation) and sorted. The unbalanced
+// trees turn into a chain on sorted keys, so they are only run on sorted
+// keys up to 20000 of them.
+//
+// The "none" rows are BalancedTree with NoBalance, which differs from
+// BinarySearchTree in how it removes a node with two children (successor
+// splice instead of grafting the left subtree), so the "bst" rows run
+// BinarySearchTree itself.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O2 -march=native bench/balance_policy_bench.cpp -o balance_policy_bench
+//   ./balance_policy_bench [key_count=1000000]
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include "../balanced_tree.hpp"
+#include "../bst.hpp"
+
+using namespace std;
+
+// Operation costs of one policy on one key stream.
+struct PolicyResult
+{
+	double rotations_per_insert{0};
+	double rotations_per_remove{0};
+	double visits_per_lookup{0};
+	double average_depth{0};
+	size_t height{0};
+	double insert_ns{1e300};
+	double lookup_ns{1e300};
+	double remove_ns{1e300};
+};
+
+// Stands in for a policy to run BinarySearchTree in the same table
+struct PlainBST
+{
+	static constexpr const char *name = "bst";
+};
+
+// The tree a row measures: BalancedTree with the policy, or
+// BinarySearchTree for PlainBST
+template <class Balance, class Stats>
+struct TreeFor
+{
+	using type = BalancedTree<int, Balance, less<>, NodePool, Stats>;
+};
+
+template <class Stats>
+struct TreeFor<PlainBST, Stats>
+{
+	using type = BinarySearchTree<int, less<>, NodePool, Stats>;
+};
+
+template <class Balance>
+PolicyResult run_policy(const vector<int> &t_inserts, const vector<int> &t_lookups)
+{
+	PolicyResult result;
+	double n = (double)t_inserts.size();
+
+	typename TreeFor<Balance, CountingStats>::type counted;
+	for (int key : t_inserts)
+		counted.insert(key);
+	for (int key : t_lookups)
+		counted.contains(key);
+	TreeShape shape = counted.shape();
+	result.average_depth = shape.average_depth;
+	result.height = shape.height;
+	for (int key : t_lookups)
+		counted.remove(key);
+	StatsSnapshot stats = counted.stats();
+	result.rotations_per_insert = stats[TreeOp::insert].single_rotations / n;
+	result.rotations_per_remove = stats[TreeOp::remove].single_rotations / n;
+	result.visits_per_lookup = stats[TreeOp::search].node_visits / n;
+
+	size_t found = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		typename TreeFor<Balance, NullStats>::type tree;
+		auto start = chrono::steady_clock::now();
+		for (int key : t_inserts)
+			tree.insert(key);
+		auto inserted = chrono::steady_clock::now();
+		for (int key : t_lookups)
+			found += tree.contains(key);
+		auto looked_up = chrono::steady_clock::now();
+		for (int key : t_lookups)
+			tree.remove(key);
+		auto removed = chrono::steady_clock::now();
+		result.insert_ns = min(result.insert_ns, chrono::duration<double, nano>(inserted - start).count() / n);
+		result.lookup_ns = min(result.lookup_ns, chrono::duration<double, nano>(looked_up - inserted).count() / n);
+		result.remove_ns = min(result.remove_ns, chrono::duration<double, nano>(removed - looked_up).count() / n);
+	}
+	if (found != 3 * t_lookups.size())
+		cerr << "Lookups missed keys\n";
+	return result;
+}
+
+template <class Balance>
+void report(const string &t_stream, const vector<int> &t_inserts, const vector<int> &t_lookups)
+{
+	PolicyResult result = run_policy<Balance>(t_inserts, t_lookups);
+	cout << left << setw(8) << t_stream << setw(11) << Balance::name << right << fixed
+		 << setprecision(3) << setw(10) << result.rotations_per_insert << setw(10) << result.rotations_per_remove
+		 << setprecision(2) << setw(10) << result.visits_per_lookup << setw(10) << result.average_depth << setw(8) << result.height
+		 << setprecision(1) << setw(11) << result.insert_ns << setw(11) << result.lookup_ns << setw(11) << result.remove_ns << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+	size_t key_count = argc > 1 ? stoull(argv[1]) : 1000000;
+	const size_t degenerate_limit = 20000;
+
+	mt19937_64 rng(42);
+	vector<int> sorted(key_count);
+	iota(sorted.begin(), sorted.end(), 0);
+	vector<int> shuffled = sorted;
+	shuffle(shuffled.begin(), shuffled.end(), rng);
+	vector<int> lookups = sorted;
+	shuffle(lookups.begin(), lookups.end(), rng);
+
+	cout << "Keys: " << key_count << '\n'
+		 << left << setw(8) << "stream" << setw(11) << "policy" << right
+		 << setw(10) << "rot/ins" << setw(10) << "rot/rem" << setw(10) << "visits" << setw(10) << "avg dep" << setw(8) << "height"
+		 << setw(11) << "ins ns" << setw(11) << "find ns" << setw(11) << "rem ns" << '\n';
+	for (const auto &[stream, keys] : {pair<string, const vector<int> &>{"random", shuffled}, {"sorted", sorted}})
+	{
+		if (stream == "random" || key_count <= degenerate_limit)
+		{
+			report<PlainBST>(stream, keys, lookups);
+			report<NoBalance>(stream, keys, lookups);
+		}
+		report<AVLBalance>(stream, keys, lookups);
+		report<RedBlackBalance>(stream, keys, lookups);
+		report<WAVLBalance>(stream, keys, lookups);
+		report<TreapBalance>(stream, keys, lookups);
+	}
+	return 0;
+}
@@ -0,0 +1,100 @@
+// Benchmark: scalar contains() loop versus contains_batch() with several
+// group sizes, on AVLTree and BinarySearchTree.
+//
+// The words of words.txt are scaled up to the requested number of distinct
+// keys by appending a numeric suffix. Queries are a shuffled mix of hits
+// and misses.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O2 -march=native bench/batch_lookup_bench.cpp -o batch_lookup_bench
+//   ./batch_lookup_bench [key_count=2000000] [query_count=2000000] [words=words.txt]
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <memory>
+#include "../bst.hpp"
+#include "../avlt.hpp"
+#include "bench_util.hpp"
+
+using namespace std;
+
+// Returns nanoseconds per lookup of one call of run().
+template <class Run>
+double time_per_query(size_t query_count, Run run)
+{
+	auto start = chrono::steady_clock::now();
+	run();
+	auto stop = chrono::steady_clock::now();
+	return chrono::duration<double, nano>(stop - start).count() / query_count;
+}
+
+// Times the scalar loop and each group size for one tree and prints a row
+// per configuration.
+template <class Tree>
+void bench_tree(const string &name, const Tree &tree, const vector<string> &queries)
+{
+	unique_ptr<bool[]> results(new bool[queries.size()]);
+	span<bool> out(results.get(), queries.size());
+	size_t hits = 0;
+
+	double scalar_ns = time_per_query(queries.size(), [&]()
+									  {
+		for (size_t i = 0; i < queries.size(); i++)
+			out[i] = tree.contains(queries[i]); });
+	for (bool hit : out)
+		hits += hit;
+	cout << name << " scalar loop:        " << scalar_ns << " ns/lookup\n";
+
+	for (size_t group : {2, 4, 8, 16, 32, 64})
+	{
+		double batch_ns = time_per_query(queries.size(), [&]()
+										 { tree.contains_batch(queries, out, group); });
+		for (bool hit : out)
+			hits += hit;
+		cout << name << " batch, group " << group << ":" << string(group < 10 ? 5 : 4, ' ')
+			 << batch_ns << " ns/lookup (" << scalar_ns / batch_ns << "x)\n";
+	}
+	cout << name << " hits counted: " << hits << "\n\n";
+}
+
+int main(int argc, char *argv[])
+{
+	size_t key_count = argc > 1 ? stoull(argv[1]) : 2000000;
+	size_t query_count = argc > 2 ? stoull(argv[2]) : 2000000;
+	string words_path = argc > 3 ? argv[3] : "words.txt";
+
+	vector<string> words = read_words(words_path);
+	if (words.empty())
+		return 1;
+
+	vector<string> keys = scale_words(words, key_count);
+
+	mt19937_64 rng(42);
+	vector<string> queries;
+	queries.reserve(query_count);
+	for (size_t i = 0; i < query_count; i++)
+	{
+		const string &key = keys[rng() % keys.size()];
+		queries.push_back(i % 2 ? key : key + "#");
+	}
+
+	// Insert in shuffled order so nodes are scattered in memory the way an
+	// incrementally loaded tree's are
+	shuffle(keys.begin(), keys.end(), rng);
+	AVLTree<string> avltree;
+	BinarySearchTree<string> bstree;
+	for (const string &key : keys)
+	{
+		avltree.insert(key);
+		bstree.insert(key);
+	}
+
+	cout << "Keys: " << key_count << ", queries: " << query_count << "\n\n";
+	bench_tree("AVLTree", avltree, queries);
+	bench_tree("BST    ", bstree, queries);
+
+	return 0;
+}
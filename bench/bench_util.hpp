@@ -0,0 +1,92 @@
+/// Header file for the helpers shared by the benchmarks
+#ifndef BENCH_UTIL
+#define BENCH_UTIL
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+// Zipf distributed ranks in [1, n] with exponent s, sampled by rejection
+// inversion (Hormann & Derflinger) in O(1) memory, so the universe can be
+// as large as the key count.
+class ZipfDistribution
+{
+private:
+	double m_exponent;
+	double m_h_integral_x1;
+	double m_h_integral_n;
+	double m_s;
+	uint64_t m_n;
+
+	static double helper1(double x) { return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x)); }
+	static double helper2(double x) { return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x)); }
+	double h(double x) const { return exp(-m_exponent * log(x)); }
+	double h_integral(double x) const
+	{
+		double log_x = log(x);
+		return helper2((1 - m_exponent) * log_x) * log_x;
+	}
+	double h_integral_inverse(double x) const
+	{
+		double t = x * (1 - m_exponent);
+		if (t < -1)
+			t = -1;
+		return exp(helper1(t) * x);
+	}
+
+public:
+	ZipfDistribution(uint64_t n, double exponent) : m_exponent(exponent), m_n(n)
+	{
+		m_h_integral_x1 = h_integral(1.5) - 1;
+		m_h_integral_n = h_integral(n + 0.5);
+		m_s = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+	}
+
+	template <class Rng>
+	uint64_t operator()(Rng &rng)
+	{
+		uniform_real_distribution<double> uniform(0.0, 1.0);
+		while (true)
+		{
+			double u = m_h_integral_n + uniform(rng) * (m_h_integral_x1 - m_h_integral_n);
+			double x = h_integral_inverse(u);
+			uint64_t k = (uint64_t)(x + 0.5);
+			k = clamp<uint64_t>(k, 1, m_n);
+			if (k - x <= m_s || u >= h_integral(k + 0.5) - h(k))
+				return k;
+		}
+	}
+};
+
+// Reads the whitespace separated words of a file. Reports on cerr and
+// returns no words if the file is missing or empty.
+inline vector<string> read_words(const string &t_path)
+{
+	vector<string> words;
+	ifstream infile(t_path);
+	string word;
+	while (infile >> word)
+		words.push_back(word);
+	if (words.empty())
+		cerr << "No words read from " << t_path << '\n';
+	return words;
+}
+
+// Scales a corpus up to t_count keys: word i of round r becomes
+// "<word><r>", so the keys are distinct if the words are
+inline vector<string> scale_words(const vector<string> &t_words, size_t t_count)
+{
+	vector<string> keys;
+	keys.reserve(t_count);
+	for (size_t i = 0; i < t_count; i++)
+		keys.push_back(t_words[i % t_words.size()] + to_string(i / t_words.size()));
+	return keys;
+}
+
+#endif
@@ -0,0 +1,136 @@
+// Benchmark: reader scaling of ConcurrentAVLTree against an AVLTree
+// guarded by a mutex, with one writer inserting and removing keys the
+// whole time.
+//
+// The words of words.txt are scaled up to the requested number of keys.
+// Each reader thread looks up random keys for a fixed time; the table
+// gives the total lookups per second over all readers and the updates the
+// writer got through meanwhile.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O2 -march=native -pthread bench/concurrent_read_bench.cpp -o concurrent_read_bench
+//   ./concurrent_read_bench [key_count=1000000] [max_readers=hardware threads] [words=words.txt]
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "../avlt.hpp"
+#include "../concurrent_avlt.hpp"
+#include "bench_util.hpp"
+
+using namespace std;
+
+// How long every configuration runs
+static constexpr chrono::milliseconds run_time(500);
+
+// AVLTree with every operation under one mutex
+struct LockedAVLTree
+{
+	AVLTree<string> tree;
+	mutable mutex lock;
+
+	bool search_value(const string &t_key) const
+	{
+		lock_guard<mutex> guard(lock);
+		return tree.contains(t_key);
+	}
+	void insert(const string &t_key)
+	{
+		lock_guard<mutex> guard(lock);
+		tree.insert(t_key);
+	}
+	void remove(const string &t_key)
+	{
+		lock_guard<mutex> guard(lock);
+		tree.remove(t_key);
+	}
+};
+
+// Runs t_readers lookup threads next to one writer for run_time.
+// Returns the lookups per second over all readers and the updates the
+// writer made.
+template <class Tree>
+pair<double, size_t> run(Tree &t_tree, const vector<string> &t_keys, size_t t_readers)
+{
+	atomic<bool> stop{false};
+	atomic<size_t> lookups{0};
+	size_t hits = 0;
+	mutex hits_lock;
+	vector<thread> readers;
+	for (size_t r = 0; r < t_readers; r++)
+		readers.emplace_back([&, r]()
+							 {
+			mt19937_64 rng(r + 1);
+			size_t done = 0, found = 0;
+			while (!stop.load(memory_order_relaxed))
+			{
+				for (int i = 0; i < 256; i++)
+					found += t_tree.search_value(t_keys[rng() % t_keys.size()]);
+				done += 256;
+			}
+			lookups += done;
+			lock_guard<mutex> guard(hits_lock);
+			hits += found; });
+
+	// The writer churns keys of its own, so the readers' keys stay put
+	size_t updates = 0;
+	mt19937_64 rng(0);
+	auto start = chrono::steady_clock::now();
+	while (chrono::steady_clock::now() - start < run_time)
+	{
+		string key = t_keys[rng() % t_keys.size()] + "#";
+		if (updates % 2)
+			t_tree.remove(key);
+		else
+			t_tree.insert(key);
+		updates++;
+	}
+	stop.store(true);
+	for (thread &reader : readers)
+		reader.join();
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if (hits != lookups.load())
+		cerr << "Lookups missed keys\n";
+	return {lookups.load() / seconds, updates};
+}
+
+int main(int argc, char *argv[])
+{
+	size_t key_count = argc > 1 ? stoull(argv[1]) : 1000000;
+	size_t max_readers = argc > 2 ? stoull(argv[2]) : max<size_t>(thread::hardware_concurrency(), 1);
+	string words_path = argc > 3 ? argv[3] : "words.txt";
+
+	vector<string> words = read_words(words_path);
+	if (words.empty())
+		return 1;
+	vector<string> keys = scale_words(words, key_count);
+
+	ConcurrentAVLTree<string> concurrent;
+	LockedAVLTree locked;
+	for (const string &key : keys)
+	{
+		concurrent.insert(key);
+		locked.tree.insert(key);
+	}
+
+	cout << "Keys: " << keys.size() << ", one writer, " << run_time.count() << " ms per row\n"
+		 << left << setw(9) << "readers" << right << setw(18) << "concurrent Mops/s" << setw(16) << "mutex Mops/s"
+		 << setw(10) << "scaling" << setw(20) << "concurrent updates" << setw(15) << "mutex updates" << '\n';
+	double base = 0;
+	for (size_t readers = 1; readers <= max_readers; readers *= 2)
+	{
+		auto [concurrent_rate, concurrent_updates] = run(concurrent, keys, readers);
+		auto [locked_rate, locked_updates] = run(locked, keys, readers);
+		if (readers == 1)
+			base = concurrent_rate;
+		cout << left << setw(9) << readers << right << fixed << setprecision(2)
+			 << setw(18) << concurrent_rate / 1e6 << setw(16) << locked_rate / 1e6
+			 << setw(9) << concurrent_rate / base << 'x' << setw(20) << concurrent_updates << setw(15) << locked_updates << '\n';
+	}
+	return 0;
+}
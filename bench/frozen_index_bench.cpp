@@ -0,0 +1,89 @@
+// Benchmark: pointer-chasing AVLTree / BinarySearchTree lookups versus the
+// frozen Eytzinger index produced by freeze(), with the cache-line sized
+// nodes of BTree for comparison.
+//
+// The words of words.txt are scaled up to the requested number of distinct
+// keys by appending a numeric suffix, loaded with build(), frozen, and then
+// queried with a shuffled mix of hits and misses.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O2 -march=native bench/frozen_index_bench.cpp -o frozen_index_bench
+//   ./frozen_index_bench [key_count=10000000] [query_count=2000000] [words=words.txt]
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include "../bst.hpp"
+#include "../avlt.hpp"
+#include "../btree.hpp"
+#include "bench_util.hpp"
+
+using namespace std;
+
+// Times one pass of lookups and returns nanoseconds per lookup. The number
+// of hits is accumulated so the lookups cannot be optimized away.
+template <class Lookup>
+double time_lookups(const vector<string> &queries, Lookup lookup, size_t &hits)
+{
+	auto start = chrono::steady_clock::now();
+	for (const string &query : queries)
+		hits += lookup(query);
+	auto stop = chrono::steady_clock::now();
+	return chrono::duration<double, nano>(stop - start).count() / queries.size();
+}
+
+int main(int argc, char *argv[])
+{
+	size_t key_count = argc > 1 ? stoull(argv[1]) : 10000000;
+	size_t query_count = argc > 2 ? stoull(argv[2]) : 2000000;
+	string words_path = argc > 3 ? argv[3] : "words.txt";
+
+	vector<string> words = read_words(words_path);
+	if (words.empty())
+		return 1;
+
+	vector<string> keys = scale_words(words, key_count);
+
+	mt19937_64 rng(42);
+	vector<string> queries;
+	queries.reserve(query_count);
+	for (size_t i = 0; i < query_count; i++)
+	{
+		const string &key = keys[rng() % keys.size()];
+		queries.push_back(i % 2 ? key : key + "#"); // half hits, half misses
+	}
+
+	AVLTree<string> avltree;
+	avltree.build(keys.begin(), keys.end());
+	FrozenIndex<string> avl_index = avltree.freeze();
+
+	BinarySearchTree<string> bstree;
+	bstree.build(keys.begin(), keys.end());
+	FrozenIndex<string> bst_index = bstree.freeze();
+
+	BTree<string> btree;
+	for (const string &key : keys)
+		btree.insert(key);
+
+	size_t hits = 0;
+	double avl_ns = time_lookups(queries, [&](const string &q) { return avltree.contains(q); }, hits);
+	double bst_ns = time_lookups(queries, [&](const string &q) { return bstree.contains(q); }, hits);
+	double avl_frozen_ns = time_lookups(queries, [&](const string &q) { return avl_index.contains(q); }, hits);
+	double btree_ns = time_lookups(queries, [&](const string &q) { return btree.contains(q); }, hits);
+	double bst_frozen_ns = time_lookups(queries, [&](const string &q) { return bst_index.contains(q); }, hits);
+
+	cout << "Keys:                       " << key_count << '\n'
+		 << "Queries:                    " << query_count << " (hits counted: " << hits << ")\n"
+		 << "AVLTree contains:           " << avl_ns << " ns/lookup\n"
+		 << "AVLTree frozen contains:    " << avl_frozen_ns << " ns/lookup ("
+		 << avl_ns / avl_frozen_ns << "x)\n"
+		 << "BST contains:               " << bst_ns << " ns/lookup\n"
+		 << "BST frozen contains:        " << bst_frozen_ns << " ns/lookup ("
+		 << bst_ns / bst_frozen_ns << "x)\n"
+		 << "BTree contains:             " << btree_ns << " ns/lookup\n";
+
+	return 0;
+}
@@ -0,0 +1,121 @@
+// Benchmark: AVLTree set algebra through union_with / intersect_with /
+// difference_with versus the per-key insert, search and remove loops they
+// replace.
+//
+// The words of words.txt are scaled up to the requested number of keys by
+// appending a numeric suffix. The first tree holds every key, the second a
+// random sample of a given fraction of them mixed with as many new keys,
+// so the operations both find and miss. Each operation is timed on fresh
+// copies, best of three runs, on one thread and on every hardware thread.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O2 -march=native -pthread bench/set_ops_bench.cpp -o set_ops_bench
+//   ./set_ops_bench [key_count=2000000] [words=words.txt]
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include "../avlt.hpp"
+#include "bench_util.hpp"
+
+using namespace std;
+
+// Builds fresh trees with t_setup, then times t_run on them three times
+// and returns the fastest run in milliseconds. t_check receives the size
+// of the result so the work is not dropped.
+template <class Setup, class Run>
+double best_of_three(Setup t_setup, Run t_run, size_t &t_check)
+{
+	double best = 1e300;
+	for (int i = 0; i < 3; i++)
+	{
+		AVLTree<string> mine, theirs;
+		t_setup(mine, theirs);
+		auto start = chrono::steady_clock::now();
+		t_run(mine, theirs);
+		auto stop = chrono::steady_clock::now();
+		best = min(best, chrono::duration<double, milli>(stop - start).count());
+		t_check += mine.size();
+	}
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t key_count = argc > 1 ? stoull(argv[1]) : 2000000;
+	string words_path = argc > 2 ? argv[2] : "words.txt";
+
+	vector<string> words = read_words(words_path);
+	if (words.empty())
+		return 1;
+
+	vector<string> keys = scale_words(words, key_count);
+
+	size_t threads = thread::hardware_concurrency();
+	size_t check = 0;
+	mt19937_64 rng(42);
+	cout << "Keys in first tree: " << key_count << ", threads: " << threads << '\n';
+	for (double fraction : {1.0, 0.1, 0.001})
+	{
+		// Half the second tree is shared with the first, half is new
+		size_t other_count = max<size_t>(1, (size_t)(key_count * fraction));
+		vector<string> other;
+		other.reserve(other_count);
+		for (size_t i = 0; i < other_count; i++)
+			other.push_back(i % 2 ? keys[rng() % keys.size()] : keys[rng() % keys.size()] + "#");
+
+		auto setup = [&](AVLTree<string> &t_mine, AVLTree<string> &t_theirs)
+		{
+			t_mine.build(keys.begin(), keys.end());
+			t_theirs.build(other.begin(), other.end());
+		};
+
+		double insert_ms = best_of_three(setup, [](AVLTree<string> &t_mine, AVLTree<string> &t_theirs)
+										 {
+			for (auto it = t_theirs.begin(); it != t_theirs.end(); ++it)
+				for (size_t i = 0; i < it.count(); i++)
+					t_mine.insert(*it); }, check);
+		double union_one_ms = best_of_three(setup, [](AVLTree<string> &t_mine, AVLTree<string> &t_theirs)
+											{ t_mine.union_with(t_theirs, 1); }, check);
+		double union_all_ms = best_of_three(setup, [&](AVLTree<string> &t_mine, AVLTree<string> &t_theirs)
+											{ t_mine.union_with(t_theirs, threads); }, check);
+
+		double search_ms = best_of_three(setup, [&](AVLTree<string> &t_mine, AVLTree<string> &t_theirs)
+										 {
+			AVLTree<string> result;
+			for (auto it = t_theirs.begin(); it != t_theirs.end(); ++it)
+				if (t_mine.contains(*it))
+					result.insert(*it);
+			check += result.size(); }, check);
+		double intersect_one_ms = best_of_three(setup, [](AVLTree<string> &t_mine, AVLTree<string> &t_theirs)
+												{ t_mine.intersect_with(t_theirs, 1); }, check);
+		double intersect_all_ms = best_of_three(setup, [&](AVLTree<string> &t_mine, AVLTree<string> &t_theirs)
+												{ t_mine.intersect_with(t_theirs, threads); }, check);
+
+		double remove_ms = best_of_three(setup, [](AVLTree<string> &t_mine, AVLTree<string> &t_theirs)
+										 {
+			for (auto it = t_theirs.begin(); it != t_theirs.end(); ++it)
+				t_mine.remove(*it); }, check);
+		double difference_one_ms = best_of_three(setup, [](AVLTree<string> &t_mine, AVLTree<string> &t_theirs)
+												 { t_mine.difference_with(t_theirs, 1); }, check);
+		double difference_all_ms = best_of_three(setup, [&](AVLTree<string> &t_mine, AVLTree<string> &t_theirs)
+												 { t_mine.difference_with(t_theirs, threads); }, check);
+
+		cout << "Second tree: " << other_count << " values\n"
+			 << "  insert loop:                   " << insert_ms << " ms\n"
+			 << "  union_with, 1 thread:          " << union_one_ms << " ms (" << insert_ms / union_one_ms << "x)\n"
+			 << "  union_with, all threads:       " << union_all_ms << " ms (" << insert_ms / union_all_ms << "x)\n"
+			 << "  search + insert loop:          " << search_ms << " ms\n"
+			 << "  intersect_with, 1 thread:      " << intersect_one_ms << " ms (" << search_ms / intersect_one_ms << "x)\n"
+			 << "  intersect_with, all threads:   " << intersect_all_ms << " ms (" << search_ms / intersect_all_ms << "x)\n"
+			 << "  remove loop:                   " << remove_ms << " ms\n"
+			 << "  difference_with, 1 thread:     " << difference_one_ms << " ms (" << remove_ms / difference_one_ms << "x)\n"
+			 << "  difference_with, all threads:  " << difference_all_ms << " ms (" << remove_ms / difference_all_ms << "x)\n";
+	}
+	cout << "Nodes in results over all runs: " << check << '\n';
+	return 0;
+}
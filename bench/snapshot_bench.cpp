@@ -0,0 +1,127 @@
+// Benchmark: rebuilding the trees from a word file, as main.cpp does on
+// every run, versus loading them from a binary snapshot written by save().
+//
+// The words of words.txt are scaled up to the requested number of keys by
+// appending a numeric suffix and written to a scratch word file. Each tree
+// is then built four ways, best of three runs each:
+//   insert    words read with operator>> and inserted one by one
+//   mapped    MappedTree over the word file (what main.cpp does)
+//   load      load() of a snapshot, keys copied into strings
+//   snapshot  MappedTree over the snapshot, keys left in the mapping
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O2 -march=native bench/snapshot_bench.cpp -o snapshot_bench
+//   ./snapshot_bench [key_count=1000000] [words=words.txt] [scratch_dir=.]
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include "../bst.hpp"
+#include "../avlt.hpp"
+#include "../word_loader.hpp"
+#include "bench_util.hpp"
+
+using namespace std;
+
+// Runs t_run three times and returns the fastest run in milliseconds.
+// t_check receives the number of nodes built so the work is not dropped.
+double best_of_three(const function<size_t()> &t_run, size_t &t_check)
+{
+	double best = 1e300;
+	for (int i = 0; i < 3; i++)
+	{
+		auto start = chrono::steady_clock::now();
+		t_check += t_run();
+		auto stop = chrono::steady_clock::now();
+		best = min(best, chrono::duration<double, milli>(stop - start).count());
+	}
+	return best;
+}
+
+size_t file_size(const string &path)
+{
+	ifstream in(path, ios::binary | ios::ate);
+	return in ? (size_t)in.tellg() : 0;
+}
+
+// Times every way of building one kind of tree and prints a table row per
+// way. StringTree holds strings, ViewTree string_views.
+template <class StringTree, class ViewTree>
+void run(const string &name, const string &words_path, const string &snapshot_path)
+{
+	size_t check = 0;
+	double insert_ms = best_of_three([&]()
+									 {
+		StringTree tree;
+		ifstream infile(words_path);
+		string word;
+		while (infile >> word)
+			tree.insert(word);
+		return tree.size(); }, check);
+	double mapped_ms = best_of_three([&]()
+									 {
+		MappedTree<ViewTree> tree(words_path);
+		return tree->size(); }, check);
+
+	double save_ms;
+	{
+		StringTree tree;
+		ifstream infile(words_path);
+		string word;
+		while (infile >> word)
+			tree.insert(word);
+		save_ms = best_of_three([&]()
+								{
+			tree.save(snapshot_path);
+			return tree.size(); }, check);
+	}
+
+	double load_ms = best_of_three([&]()
+								   {
+		StringTree tree;
+		tree.load(snapshot_path);
+		return tree.size(); }, check);
+	double snapshot_ms = best_of_three([&]()
+									   {
+		MappedTree<ViewTree> tree(snapshot_path, MappedContents::snapshot);
+		return tree->size(); }, check);
+
+	cout << name << " (nodes built over all runs: " << check << ", snapshot " << file_size(snapshot_path) << " bytes)\n"
+		 << "  insert from words:          " << insert_ms << " ms\n"
+		 << "  MappedTree from words:      " << mapped_ms << " ms\n"
+		 << "  save snapshot:              " << save_ms << " ms\n"
+		 << "  load snapshot:              " << load_ms << " ms (" << insert_ms / load_ms << "x)\n"
+		 << "  MappedTree from snapshot:   " << snapshot_ms << " ms (" << mapped_ms / snapshot_ms << "x)\n";
+}
+
+int main(int argc, char *argv[])
+{
+	size_t key_count = argc > 1 ? stoull(argv[1]) : 1000000;
+	string words_path = argc > 2 ? argv[2] : "words.txt";
+	string scratch_dir = argc > 3 ? argv[3] : ".";
+
+	vector<string> words = read_words(words_path);
+	if (words.empty())
+		return 1;
+
+	// The word loaders read the scaled corpus from a file
+	string scaled_path = scratch_dir + "/snapshot_bench_words.txt";
+	{
+		ofstream scaled(scaled_path);
+		for (const string &key : scale_words(words, key_count))
+			scaled << key << '\n';
+	}
+
+	cout << "Keys: " << key_count << '\n';
+	run<AVLTree<string>, AVLTree<string_view>>("AVLTree", scaled_path, scratch_dir + "/snapshot_bench_avl.snap");
+	run<BinarySearchTree<string>, BinarySearchTree<string_view>>("BinarySearchTree", scaled_path, scratch_dir + "/snapshot_bench_bst.snap");
+
+	remove(scaled_path.c_str());
+	remove((scratch_dir + "/snapshot_bench_avl.snap").c_str());
+	remove((scratch_dir + "/snapshot_bench_bst.snap").c_str());
+	return 0;
+}
@@ -0,0 +1,462 @@
+// Benchmark suite comparing BinarySearchTree, AVLTree, BTree, std::set and
+// std::multiset.
+//
+// Every combination of container, workload and key stream runs in its own
+// child process so peak RSS is measured per configuration. Results are
+// written to stdout as a JSON array, one object per configuration.
+//
+// Workloads:     insert, search, remove, mixed, traversal
+// Key streams:   sorted, reverse, random, zipf, duplicates
+//
+// Build and run from the repository root (POSIX only):
+//   g++ -std=c++20 -O2 -march=native bench/tree_bench.cpp -o tree_bench
+//   ./tree_bench [--sizes 1000,10000,100000] [--containers bst,avl,btree,set,multiset]
+//                [--workloads insert,search,...] [--streams sorted,zipf,...]
+//                [--bst-degenerate-limit 20000] [--timeout 60]
+//
+// A BinarySearchTree fed sorted or reverse-sorted keys is a chain, so those
+// runs cost O(n^2) and are skipped above --bst-degenerate-limit keys. Its
+// removal grafts the left subtree under the successor, which also degrades
+// towards a chain on large remove-heavy runs; any configuration exceeding
+// --timeout seconds is reported with "status":"timeout".
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <malloc.h>
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../bst.hpp"
+#include "../avlt.hpp"
+#include "../btree.hpp"
+#include "bench_util.hpp"
+
+using namespace std;
+
+using Key = uint64_t;
+
+// Scrambles a rank into a key so popular keys are spread over the key space
+inline Key scramble(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x & ~(Key)1; // even keys only; odd keys are guaranteed misses
+}
+
+// Generates n keys of the named stream
+vector<Key> make_stream(const string &stream, size_t n, mt19937_64 &rng)
+{
+	vector<Key> keys(n);
+	if (stream == "sorted" || stream == "reverse" || stream == "random")
+	{
+		for (size_t i = 0; i < n; i++)
+			keys[i] = 2 * (Key)i;
+		if (stream == "reverse")
+			reverse(keys.begin(), keys.end());
+		else if (stream == "random")
+			shuffle(keys.begin(), keys.end(), rng);
+	}
+	else if (stream == "zipf")
+	{
+		ZipfDistribution zipf(max<size_t>(n, 1), 0.99);
+		for (Key &key : keys)
+			key = scramble(zipf(rng));
+	}
+	else // duplicates: about 100 copies of each key
+	{
+		uniform_int_distribution<uint64_t> pick(0, max<size_t>(n / 100, 1) - 1);
+		for (Key &key : keys)
+			key = scramble(pick(rng));
+	}
+	return keys;
+}
+
+// Uniform interface over the containers under test. remove takes out one
+// occurrence of a key, so the remove and mixed workloads do the same
+// work in every container that keeps duplicates.
+template <class C>
+struct Adapter;
+
+template <>
+struct Adapter<BinarySearchTree<Key>>
+{
+	static constexpr const char *name = "bst";
+	BinarySearchTree<Key> c;
+	void insert(Key k) { c.insert(k); }
+	bool contains(Key k) const { return c.contains(k); }
+	void remove(Key k) { c.remove(k); }
+	size_t nodes() { return c.size(); }
+	size_t traverse()
+	{
+		size_t n = 0;
+		c.visit(TraversalOrder::in_order, [&](const Key &, auto...)
+				{ n++; });
+		return n;
+	}
+};
+
+template <>
+struct Adapter<AVLTree<Key>>
+{
+	static constexpr const char *name = "avl";
+	AVLTree<Key> c;
+	void insert(Key k) { c.insert(k); }
+	bool contains(Key k) const { return c.contains(k); }
+	void remove(Key k) { c.remove(k); }
+	size_t nodes() { return c.size(); }
+	size_t traverse()
+	{
+		size_t n = 0;
+		c.visit(TraversalOrder::in_order, [&](const Key &, auto...)
+				{ n++; });
+		return n;
+	}
+};
+
+template <>
+struct Adapter<BTree<Key>>
+{
+	static constexpr const char *name = "btree";
+	BTree<Key> c;
+	void insert(Key k) { c.insert(k); }
+	bool contains(Key k) const { return c.contains(k); }
+	void remove(Key k) { c.remove(k); }
+	size_t nodes() { return c.size(); }
+	size_t traverse()
+	{
+		size_t n = 0;
+		c.visit([&](const Key &, size_t)
+				{ n++; });
+		return n;
+	}
+};
+
+template <>
+struct Adapter<set<Key>>
+{
+	static constexpr const char *name = "set";
+	set<Key> c;
+	void insert(Key k) { c.insert(k); }
+	bool contains(Key k) const { return c.count(k) != 0; }
+	void remove(Key k) { c.erase(k); }
+	size_t nodes() { return c.size(); }
+	size_t traverse() { return accumulate(c.begin(), c.end(), (size_t)0, [](size_t n, Key) { return n + 1; }); }
+};
+
+template <>
+struct Adapter<multiset<Key>>
+{
+	static constexpr const char *name = "multiset";
+	multiset<Key> c;
+	void insert(Key k) { c.insert(k); }
+	bool contains(Key k) const { return c.count(k) != 0; }
+	void remove(Key k)
+	{
+		auto it = c.find(k);
+		if (it != c.end())
+			c.erase(it);
+	}
+	size_t nodes() { return c.size(); }
+	size_t traverse() { return accumulate(c.begin(), c.end(), (size_t)0, [](size_t n, Key) { return n + 1; }); }
+};
+
+// Bytes currently allocated from the heap. glibc reports them exactly;
+// elsewhere the resident set size is used, which has page granularity.
+size_t heap_in_use()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+#else
+	long pages = 0, resident = 0;
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (statm)
+	{
+		if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+			resident = 0;
+		fclose(statm);
+	}
+	return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// Collects ops, wall time and sampled per-op latencies of a timed phase
+class Recorder
+{
+private:
+	size_t m_sample_every;
+	size_t m_ops{0};
+	vector<uint32_t> m_latencies;
+	chrono::steady_clock::time_point m_start;
+	double m_seconds{0};
+
+public:
+	explicit Recorder(size_t expected_ops) : m_sample_every(max<size_t>(expected_ops / 1000000, 1)) {}
+
+	void start() { m_start = chrono::steady_clock::now(); }
+	void stop() { m_seconds += chrono::duration<double>(chrono::steady_clock::now() - m_start).count(); }
+
+	// Runs one operation, timing every m_sample_every-th one individually
+	template <class Op>
+	void op(Op operation)
+	{
+		if (m_ops++ % m_sample_every)
+		{
+			operation();
+			return;
+		}
+		auto begin = chrono::steady_clock::now();
+		operation();
+		auto end = chrono::steady_clock::now();
+		m_latencies.push_back((uint32_t)min<int64_t>(chrono::duration_cast<chrono::nanoseconds>(end - begin).count(), UINT32_MAX));
+	}
+
+	size_t ops() const { return m_ops; }
+	double seconds() const { return m_seconds; }
+
+	double percentile(double p)
+	{
+		if (m_latencies.empty())
+			return 0;
+		size_t index = min(m_latencies.size() - 1, (size_t)(p * m_latencies.size()));
+		nth_element(m_latencies.begin(), m_latencies.begin() + index, m_latencies.end());
+		return m_latencies[index];
+	}
+};
+
+// Runs one configuration and returns its JSON object
+template <class C>
+string run(const string &workload, const string &stream, size_t n)
+{
+	mt19937_64 rng(12345);
+	vector<Key> keys = make_stream(stream, n, rng);
+	Adapter<C> adapter;
+	size_t heap_before = heap_in_use();
+	size_t checksum = 0;
+	Recorder recorder(n);
+
+	// Footprint of the container once built, before the timed phase shrinks it
+	size_t nodes = 0;
+	size_t heap_bytes = 0;
+	auto footprint = [&]()
+	{
+		nodes = adapter.nodes();
+		size_t heap_after = heap_in_use();
+		heap_bytes = heap_after > heap_before ? heap_after - heap_before : 0;
+	};
+
+	auto load = [&](size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+			adapter.insert(keys[i]);
+	};
+	// Lookups hit the key set in stream proportions; every other one misses
+	auto query = [&](size_t i)
+	{ return i % 2 ? keys[rng() % keys.size()] : keys[rng() % keys.size()] | 1; };
+
+	if (workload == "insert")
+	{
+		recorder.start();
+		for (Key key : keys)
+			recorder.op([&]()
+						{ adapter.insert(key); });
+		recorder.stop();
+		footprint();
+	}
+	else if (workload == "search")
+	{
+		load(n);
+		footprint();
+		vector<Key> queries(n);
+		for (size_t i = 0; i < n; i++)
+			queries[i] = query(i);
+		recorder.start();
+		for (Key key : queries)
+			recorder.op([&]()
+						{ checksum += adapter.contains(key); });
+		recorder.stop();
+	}
+	else if (workload == "remove")
+	{
+		load(n);
+		footprint();
+		recorder.start();
+		for (Key key : keys)
+			recorder.op([&]()
+						{ adapter.remove(key); });
+		recorder.stop();
+	}
+	else if (workload == "mixed")
+	{
+		// Start half full, then 50% lookups, 25% inserts, 25% removes
+		load(n / 2);
+		footprint();
+		vector<pair<int, Key>> ops(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			int kind = rng() % 4;
+			ops[i] = {kind, kind < 2 ? query(i) : keys[rng() % keys.size()]};
+		}
+		recorder.start();
+		for (auto [kind, key] : ops)
+			recorder.op([&]()
+						{
+				if (kind < 2)
+					checksum += adapter.contains(key);
+				else if (kind == 2)
+					adapter.insert(key);
+				else
+					adapter.remove(key); });
+		recorder.stop();
+	}
+	else // traversal
+	{
+		load(n);
+		footprint();
+		recorder.start();
+		for (int pass = 0; pass < 5; pass++)
+			recorder.op([&]()
+						{ checksum += adapter.traverse(); });
+		recorder.stop();
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	ostringstream json;
+	json << "{\"container\":\"" << Adapter<C>::name << "\""
+		 << ",\"workload\":\"" << workload << "\""
+		 << ",\"stream\":\"" << stream << "\""
+		 << ",\"n\":" << n
+		 << ",\"status\":\"ok\""
+		 << ",\"ops\":" << recorder.ops()
+		 << ",\"seconds\":" << recorder.seconds()
+		 << ",\"ops_per_sec\":" << (recorder.seconds() > 0 ? recorder.ops() / recorder.seconds() : 0)
+		 << ",\"p50_ns\":" << recorder.percentile(0.50)
+		 << ",\"p99_ns\":" << recorder.percentile(0.99)
+		 << ",\"peak_rss_kb\":" << usage.ru_maxrss
+		 << ",\"nodes\":" << nodes
+		 << ",\"bytes_per_node\":" << (nodes ? (double)heap_bytes / nodes : 0)
+		 << ",\"checksum\":" << checksum << "}";
+	return json.str();
+}
+
+// Runs a configuration in a child process and returns its JSON line. The
+// child is killed after t_timeout seconds; the returned object then only
+// names the configuration and carries "status":"timeout".
+template <class C>
+string run_isolated(const string &workload, const string &stream, size_t n, unsigned t_timeout)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+		return "";
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		close(fds[0]);
+		alarm(t_timeout);
+		string result = run<C>(workload, stream, n);
+		if (write(fds[1], result.data(), result.size()) < 0)
+			_exit(1);
+		_exit(0);
+	}
+	close(fds[1]);
+	string result;
+	char buffer[4096];
+	ssize_t got;
+	while ((got = read(fds[0], buffer, sizeof(buffer))) > 0)
+		result.append(buffer, got);
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	if (result.empty() && WIFSIGNALED(status))
+		result = "{\"container\":\"" + string(Adapter<C>::name) + "\",\"workload\":\"" + workload + "\",\"stream\":\"" + stream + "\",\"n\":" + to_string(n) + ",\"status\":\"" + (WTERMSIG(status) == SIGALRM ? "timeout" : "crashed") + "\"}";
+	return result;
+}
+
+vector<string> split_list(const string &text)
+{
+	vector<string> items;
+	stringstream stream(text);
+	string item;
+	while (getline(stream, item, ','))
+		items.push_back(item);
+	return items;
+}
+
+int main(int argc, char *argv[])
+{
+	vector<string> sizes = {"1000", "10000", "100000", "1000000"};
+	vector<string> containers = {"bst", "avl", "btree", "set", "multiset"};
+	vector<string> workloads = {"insert", "search", "remove", "mixed", "traversal"};
+	vector<string> streams = {"sorted", "reverse", "random", "zipf", "duplicates"};
+	size_t bst_degenerate_limit = 20000;
+	unsigned timeout = 60;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		string option = argv[i];
+		if (option == "--sizes")
+			sizes = split_list(argv[i + 1]);
+		else if (option == "--containers")
+			containers = split_list(argv[i + 1]);
+		else if (option == "--workloads")
+			workloads = split_list(argv[i + 1]);
+		else if (option == "--streams")
+			streams = split_list(argv[i + 1]);
+		else if (option == "--bst-degenerate-limit")
+			bst_degenerate_limit = stoull(argv[i + 1]);
+		else if (option == "--timeout")
+			timeout = stoul(argv[i + 1]);
+		else
+		{
+			cerr << "Unknown option " << option << '\n';
+			return 1;
+		}
+	}
+
+	bool first = true;
+	cout << "[\n";
+	for (const string &size : sizes)
+		for (const string &container : containers)
+			for (const string &workload : workloads)
+				for (const string &stream : streams)
+				{
+					size_t n = stoull(size);
+					if (container == "bst" && (stream == "sorted" || stream == "reverse") && n > bst_degenerate_limit)
+						continue;
+
+					string result;
+					if (container == "bst")
+						result = run_isolated<BinarySearchTree<Key>>(workload, stream, n, timeout);
+					else if (container == "avl")
+						result = run_isolated<AVLTree<Key>>(workload, stream, n, timeout);
+					else if (container == "btree")
+						result = run_isolated<BTree<Key>>(workload, stream, n, timeout);
+					else if (container == "set")
+						result = run_isolated<set<Key>>(workload, stream, n, timeout);
+					else
+						result = run_isolated<multiset<Key>>(workload, stream, n, timeout);
+					if (result.empty())
+						continue;
+
+					cout << (first ? "  " : ",\n  ") << result << flush;
+					first = false;
+				}
+	cout << "\n]\n";
+
+	return 0;
+}
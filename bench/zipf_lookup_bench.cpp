@@ -0,0 +1,117 @@
+// Benchmark: SplayTree versus AVLTree on skewed lookup streams.
+//
+// Both trees hold the words of words.txt, scaled up to the requested number
+// of keys by appending a numeric suffix. Each query stream draws key ranks
+// from a Zipf distribution, with ranks assigned to the keys in random
+// order, so a few keys get most of the lookups wherever they sit in the
+// key order. A uniform stream is the baseline. One pass with
+// CountingStats reports the nodes visited per lookup (and rotations per
+// lookup for the splay tree); a second pass with the default NullStats
+// times the lookups, best of three.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O2 -march=native bench/zipf_lookup_bench.cpp -o zipf_lookup_bench
+//   ./zipf_lookup_bench [key_count=1000000] [query_count=2000000] [words=words.txt]
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include "../avlt.hpp"
+#include "../balanced_tree.hpp"
+#include "bench_util.hpp"
+
+using namespace std;
+
+// Visits and rotations per lookup of a counted tree, and the best of three
+// timed runs of the same stream over an uncounted tree.
+template <class Counted, class Timed, class Lookup>
+void report(const string &t_tree, const string &t_stream, const vector<string> &t_keys, const vector<const string *> &t_queries, Lookup t_lookup)
+{
+	double n = (double)t_queries.size();
+	Counted counted;
+	for (const string &key : t_keys)
+		counted.insert(key);
+	counted.reset_stats();
+	size_t found = 0;
+	for (const string *query : t_queries)
+		found += t_lookup(counted, *query);
+	StatsSnapshot stats = counted.stats();
+
+	double best_ns = 1e300;
+	for (int i = 0; i < 3; i++)
+	{
+		Timed timed;
+		for (const string &key : t_keys)
+			timed.insert(key);
+		auto start = chrono::steady_clock::now();
+		for (const string *query : t_queries)
+			found += t_lookup(timed, *query);
+		auto stop = chrono::steady_clock::now();
+		best_ns = min(best_ns, chrono::duration<double, nano>(stop - start).count() / n);
+	}
+	if (found != 4 * t_queries.size())
+		cerr << "Lookups missed keys\n";
+	cout << left << setw(12) << t_stream << setw(7) << t_tree << right << fixed << setprecision(2)
+		 << setw(10) << stats[TreeOp::search].node_visits / n << setw(10) << stats[TreeOp::search].single_rotations / n
+		 << setprecision(1) << setw(10) << best_ns << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+	size_t key_count = argc > 1 ? stoull(argv[1]) : 1000000;
+	size_t query_count = argc > 2 ? stoull(argv[2]) : 2000000;
+	string words_path = argc > 3 ? argv[3] : "words.txt";
+
+	vector<string> words = read_words(words_path);
+	if (words.empty())
+		return 1;
+
+	vector<string> keys = scale_words(words, key_count);
+	sort(keys.begin(), keys.end());
+	keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+	mt19937_64 rng(42);
+	vector<const string *> by_rank;
+	for (const string &key : keys)
+		by_rank.push_back(&key);
+	shuffle(by_rank.begin(), by_rank.end(), rng);
+	vector<string> insert_order = keys;
+	shuffle(insert_order.begin(), insert_order.end(), rng);
+
+	cout << "Keys: " << keys.size() << ", lookups per stream: " << query_count << '\n'
+		 << left << setw(12) << "stream" << setw(7) << "tree" << right
+		 << setw(10) << "visits" << setw(10) << "rot" << setw(10) << "ns" << '\n';
+	for (double exponent : {0.0, 0.8, 0.99, 1.2})
+	{
+		vector<const string *> queries(query_count);
+		string stream;
+		if (exponent == 0.0)
+		{
+			stream = "uniform";
+			uniform_int_distribution<size_t> uniform(0, keys.size() - 1);
+			for (auto &query : queries)
+				query = by_rank[uniform(rng)];
+		}
+		else
+		{
+			ostringstream name;
+			name << "zipf " << exponent;
+			stream = name.str();
+			ZipfDistribution zipf(keys.size(), exponent);
+			for (auto &query : queries)
+				query = by_rank[zipf(rng) - 1];
+		}
+
+		report<AVLTree<string, less<>, NodePool, CountingStats>, AVLTree<string>>("avl", stream, insert_order, queries, [](auto &t_tree, const string &t_key)
+																				  { return t_tree.search_value(t_key); });
+		report<SplayTree<string, less<>, NodePool, CountingStats>, SplayTree<string>>("splay", stream, insert_order, queries, [](auto &t_tree, const string &t_key)
+																					  { return t_tree.search(t_key); });
+	}
+	return 0;
+}
@@ -4,19 +4,53 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <cstddef>
 #include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include <span>
+#include <stdexcept>
+#include "tree_shape.hpp"
+#include "tree_stats.hpp"
+#include "tree_iterator.hpp"
+#include "tree_traversal.hpp"
+#include "tree_sink.hpp"
+#include "tree_graphviz.hpp"
+#include "tree_links.hpp"
+#include "tree_snapshot.hpp"
+#include "key_prefix.hpp"
+#include "node_pool.hpp"
+#include "frozen_index.hpp"
+#include "parallel_build.hpp"
 
 using namespace std;
 
 // A binary search tree is a binary tree with the additional property
 // that at any node, all values in the left subtree are less than or equal
-// to the node and all nodes in the right subtree are greater than the node.
+// to the node and all nodes in the right subtree are greater than or
+// equal to the node. Inserts send equal values left; rebalancing may
+// move copies of a value to either side, so a run of duplicates does not
+// have to form a chain.
+//
+// The tree does not rebalance itself by default. rebalance() restores a
+// balanced shape on demand, and set_auto_rebalance() turns on
+// scapegoat-style rebuilding of subtrees that have grown too deep. Neither
+// rotates on ordinary inserts.
 
 /// @brief A class template for creating binary search trees for any given
 /// data type.
 /// @tparam T The type for the data to be stored in the tree.
-template <class T>
+/// @tparam Compare Ordering of the values. A transparent comparator such
+/// as the default less<> enables lookups with other key types.
+/// @tparam Alloc Node allocator template, see node_pool.hpp.
+/// @tparam Stats Operation statistics policy, see tree_stats.hpp.
+template <class T, class Compare = less<>, template <class> class Alloc = NodePool, class Stats = NullStats>
 class BinarySearchTree
 {
 private:
@@ -26,8 +60,11 @@ private:
 	struct Node
 	{
 		U data{};			  // Data to be stored in the Node
+		size_t subtree_size{1}; // Number of nodes in the subtree rooted here
+		[[no_unique_address]] KeyPrefix<U, key_prefix_enabled_v<U, Compare>> prefix; // Leading key bytes, see key_prefix.hpp
 		Node *left{nullptr};  // Pointer to left child Node
 		Node *right{nullptr}; // Pointer to right child Node
+		Node *parent{nullptr}; // Pointer to parent Node, nullptr for the root
 
 		/// @brief Creates a new instance of Node.
 		Node() {}
@@ -36,38 +73,125 @@ private:
 		/// @param t_data Data to be stored.
 		/// @param t_left Pointer to left child.
 		/// @param t_right Pointer to right child.
-		Node(U t_data, Node *t_left = nullptr, Node *t_right = nullptr) : data(t_data), left(t_left), right(t_right) {}
+		Node(U t_data, Node *t_left = nullptr, Node *t_right = nullptr) : data(std::move(t_data)), subtree_size(1 + (t_left ? t_left->subtree_size : 0) + (t_right ? t_right->subtree_size : 0)), prefix(data), left(t_left), right(t_right) {}
+
+		/// @brief Creates a new instance of Node, building the data in place.
+		/// @param t_args Arguments forwarded to the data constructor.
+		template <class... Args>
+		explicit Node(in_place_t, Args &&...t_args) : data(std::forward<Args>(t_args)...), prefix(data) {}
 	};
 
 	Node<T> *m_root{nullptr}; // Root of the tree
 	size_t m_size{0};		  // Size of the tree (i.e, number of nodes in the tree).
+	double m_alpha{0};		  // Scapegoat weight factor; 0 if auto rebalancing is off
+	size_t m_max_size{0};	  // Largest size since the last full rebalance
+	Alloc<Node<T>> m_pool;	  // Allocator the nodes come from
+	Compare m_compare;		  // Ordering of the values
+	[[no_unique_address]] mutable Stats m_stats; // Operation counters; empty unless enabled
 
-	/// @brief Calculates the sum of the heights of each node of a subtree.
-	/// @param t_node_ptr Pointer to root of subtree.
-	/// @return Sum of the heights of the tree.
-	void sum_heights(Node<T> *t_node_ptr, size_t &total_height);
+	/// @brief Compares two values with m_compare, counting the comparison.
+	template <class A, class B>
+	bool less_than(const A &t_lhs, const B &t_rhs) const
+	{
+		m_stats.comparison();
+		return m_compare(t_lhs, t_rhs);
+	}
+
+	// Whether lookups with keys of type K compare the cached key prefixes
+	// of the nodes before the keys themselves
+	template <class K>
+	static constexpr bool compares_prefix = key_prefix_enabled_v<T, Compare> && is_convertible_v<const K &, string_view>;
+
+	// Prefix of a lookup key, computed once per lookup; 0 if prefixes are
+	// not compared
+	template <class K>
+	static uint64_t probe_prefix(const K &t_key)
+	{
+		if constexpr (compares_prefix<K>)
+			return key_prefix(string_view(t_key));
+		else
+			return 0;
+	}
+
+	// Orders a key, whose probe_prefix is t_prefix, against the value of a
+	// node: negative if the key comes first, positive if after, 0 if
+	// equivalent. With cached prefixes a single integer compare decides
+	// unless the prefixes tie.
+	template <class K>
+	int compare_to_node(const K &t_key, uint64_t t_prefix, const Node<T> *t_node_ptr) const
+	{
+		if constexpr (compares_prefix<K>)
+		{
+			m_stats.comparison();
+			if (t_prefix != t_node_ptr->prefix.value)
+				return t_prefix < t_node_ptr->prefix.value ? -1 : 1;
+			return string_view(t_key).compare(string_view(t_node_ptr->data));
+		}
+		else
+		{
+			if (less_than(t_key, t_node_ptr->data))
+				return -1;
+			return less_than(t_node_ptr->data, t_key) ? 1 : 0;
+		}
+	}
 
 	/// @brief Calculates height of the subtree.
 	/// @param t_node_ptr Pointer to root of the subtree.
 	/// @return Height of the subtree.
 	size_t sub_tree_height(Node<T> *t_node_ptr);
 
-	/// @brief Inserts a new Node with the provided data.
+	/// @brief Links a newly created Node into the subtree.
 	/// @param t_node_ptr Pointer to subtree, a Node.
-	/// @param t_data Data to be stored in the Node.
-	void insert_node(Node<T> *&t_node_ptr, T t_data);
+	/// @param t_new_node Node holding the data to be inserted.
+	void insert_node(Node<T> *&t_node_ptr, Node<T> *t_new_node);
 
-	/// @brief Prints in-order traversal of a subtree.
-	/// @param t_node_ptr Pointer to subtree, a Node.
-	void in_order(Node<T> *t_node_ptr) const;
+	/// @brief Builds a balanced subtree from a sorted range of values.
+	/// @param t_values Sorted values; moved from.
+	/// @param t_lo Index of the first value of the range.
+	/// @param t_hi Index one past the last value of the range.
+	/// @return Pointer to root of the new subtree.
+	Node<T> *build_subtree(vector<T> &t_values, size_t t_lo, size_t t_hi);
 
-	/// @brief Prints pre-order traversal of a subtree.
-	/// @param t_node_ptr Pointer to subtree, a Node.
-	void pre_order(Node<T> *t_node_ptr) const;
+	/// @brief Links already constructed nodes, ordered by value, into a
+	/// balanced subtree using the same split rule as build_subtree. The top
+	/// t_spawn_depth levels hand their left half to another thread.
+	/// @param t_nodes Nodes in order.
+	/// @param t_lo Index of the first node of the range.
+	/// @param t_hi Index one past the last node of the range.
+	/// @param t_spawn_depth Number of levels that fork.
+	/// @return Pointer to root of the new subtree.
+	Node<T> *link_subtree(Node<T> **t_nodes, size_t t_lo, size_t t_hi, size_t t_spawn_depth);
 
-	/// @brief Prints post-order traversal of a subtree.
-	/// @param t_node_ptr Pointer to subtree, a Node.
-	void post_order(Node<T> *t_node_ptr) const;
+	/// @brief Undoes a failed parallel build: destroys the nodes that were
+	/// constructed and returns every allocated slot to the pool.
+	/// @param t_nodes Slots in order, nullptr where none was allocated.
+	/// @param t_offsets Index of the first slot of each bucket.
+	/// @param t_built Number of nodes constructed in each bucket.
+	void release_nodes(const vector<Node<T> *> &t_nodes, const vector<size_t> &t_offsets, const vector<size_t> &t_built);
+
+	/// @brief Rotates a subtree left, keeping parents and subtree sizes.
+	/// @param t_node_ptr Link to root of subtree; receives the new root.
+	void rotate_left(Node<T> *&t_node_ptr);
+
+	/// @brief Rotates a subtree right, keeping parents and subtree sizes.
+	/// @param t_node_ptr Link to root of subtree; receives the new root.
+	void rotate_right(Node<T> *&t_node_ptr);
+
+	/// @brief Rebuilds a subtree into a balanced shape in place with the
+	/// Day-Stout-Warren algorithm, in O(n) time and O(1) extra memory.
+	/// @param t_node_ptr Link to root of subtree; receives the new root.
+	void rebalance_subtree(Node<T> *&t_node_ptr);
+
+	/// @brief One DSW compression pass: left rotations at every other node
+	/// of the right spine.
+	/// @param t_node_ptr Link to the top of the spine.
+	/// @param t_count Number of rotations.
+	void compress(Node<T> *&t_node_ptr, size_t t_count);
+
+	/// @brief Finds the lowest ancestor of a node that is not
+	/// alpha-weight-balanced and rebuilds its subtree.
+	/// @param t_node_ptr A node deeper than the scapegoat depth limit.
+	void rebuild_scapegoat(Node<T> *t_node_ptr);
 
 	/// @brief Removes the Node pointed to by the specified Node pointer.
 	/// Uses right-child promotion.
@@ -77,7 +201,8 @@ private:
 	/// @brief Removes the Node containing a specific value from the subtree.
 	/// @param t_node_ptr Pointer to subtree, a Node.
 	/// @param t_data Value to be removed from the tree.
-	void remove_node(Node<T> *&t_node_ptr, T t_data);
+	template <class K>
+	void remove_node(Node<T> *&t_node_ptr, const K &t_data);
 
 	/// @brief Deletes the subtree.
 	/// @param t_node_ptr Pointer to root of subtree.
@@ -87,23 +212,77 @@ private:
 	/// @param t_node_ptr Pointer to root of subtree.
 	/// @param t_data Value to search for.
 	/// @return true if vaue exists, false otherwise.
-	bool search_value(Node<T> *t_node_ptr, T t_data);
+	template <class K>
+	bool search_value(Node<T> *t_node_ptr, const K &t_data) const;
 
-	// Credit to:  Terry Griffin
-	// Creates GraphViz code so the tree can be visualized.  Prints
-	// unique node id's by traversing the tree.
-	void graph_viz_ids(Node<T> *t_node_ptr, ofstream &VizOut);
+	/// @brief Finds the first node not ordered before a key, or after it.
+	/// @param t_key Key to compare with.
+	/// @param t_strict false for the first node >= key, true for > key.
+	/// @return Pointer to node, nullptr if there is none.
+	template <class K>
+	Node<T> *bound_node(const K &t_key, bool t_strict) const;
 
-	// Credit to:  Terry Griffin
-	// Partnered with the above method, but on this pass it
-	// writes out the actual data from each node.
-	void graph_viz_connections(Node<T> *t_node_ptr, ofstream &VizOut);
+	/// @brief Counts the values ordered before a key.
+	/// @param t_key Key to compare with.
+	/// @param t_inclusive Whether values equal to the key are counted too.
+	/// @return Number of values less than (or equal to) the key.
+	template <class K>
+	size_t count_before(const K &t_key, bool t_inclusive) const;
+
+	/// @brief Runs a group of lookups level by level, prefetching the next
+	/// node of each lookup so their cache misses overlap.
+	/// @param t_keys Keys to look up.
+	/// @param t_results One result per key; zeroed before the lookups.
+	/// @param t_group Number of lookups advanced together.
+	/// @param t_all_matches If true, a lookup goes on below its first match
+	/// and adds every duplicate to its result; otherwise it stops at the
+	/// first match.
+	/// @throws invalid_argument if t_results is not as long as t_keys.
+	template <class K, class R>
+	void lookup_batch(span<const K> t_keys, span<R> t_results, size_t t_group, bool t_all_matches) const;
 
 public:
+	// Bidirectional in-order iterator; duplicates are visited one node at
+	// a time
+	using iterator = TreeIterator<Node<T>, T>;
+	using const_iterator = iterator;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = reverse_iterator;
+
+	iterator begin() const { return iterator::first(&m_root); }
+	iterator end() const { return iterator(nullptr, &m_root); }
+	reverse_iterator rbegin() const { return reverse_iterator(end()); }
+	reverse_iterator rend() const { return reverse_iterator(begin()); }
+
+	// Public function returning an iterator to the first value not less
+	// than t_data, or end(), in O(depth)
+	iterator lower_bound(const T &t_data) const { return iterator(bound_node(t_data, false), &m_root); }
+
+	template <class K, class C = Compare, class = typename C::is_transparent>
+	iterator lower_bound(const K &t_key) const { return iterator(bound_node(t_key, false), &m_root); }
+
+	// Public function returning an iterator to the first value greater
+	// than t_data, or end(), in O(depth)
+	iterator upper_bound(const T &t_data) const { return iterator(bound_node(t_data, true), &m_root); }
+
+	template <class K, class C = Compare, class = typename C::is_transparent>
+	iterator upper_bound(const K &t_key) const { return iterator(bound_node(t_key, true), &m_root); }
+
+	// Public function returning the range of values equal to t_data
+	pair<iterator, iterator> equal_range(const T &t_data) const { return {lower_bound(t_data), upper_bound(t_data)}; }
+
+	template <class K, class C = Compare, class = typename C::is_transparent>
+	pair<iterator, iterator> equal_range(const K &t_key) const { return {lower_bound(t_key), upper_bound(t_key)}; }
+
 	/// @brief Computes the averahe node height of the tree.
 	/// @return Average node height.
 	double average_height();
 
+	/// @brief Gathers height, depth and level statistics of the tree in a
+	/// single linear pass.
+	/// @return Shape report of the tree.
+	TreeShape shape() { return compute_shape(m_root); }
+
 	/// @brief Calculates the height of the tree.
 	/// @return Height of the tree.
 	size_t height() { return sub_tree_height(m_root); }
@@ -115,252 +294,905 @@ public:
 	~BinarySearchTree() { clear(); }
 
 	// Public function to insert item t_data into the tree; calls insert_node
-	void insert(T t_data) { insert_node(m_root, t_data); }
+	void insert(const T &t_data) { insert_node(m_root, m_pool.create(t_data)); }
+
+	// Public function to insert item t_data into the tree, moving it into
+	// the new node
+	void insert(T &&t_data) { insert_node(m_root, m_pool.create(std::move(t_data))); }
+
+	// Public function to insert an item built in place from t_args
+	template <class... Args>
+	void emplace(Args &&...t_args) { insert_node(m_root, m_pool.create(in_place, std::forward<Args>(t_args)...)); }
+
+	// Public function replacing the contents of the tree with the values of
+	// a range. Sorted input becomes a balanced tree in O(n); unsorted input
+	// is sorted first. Duplicates are kept as separate nodes, as with insert.
+	template <class InputIt>
+	void build(InputIt t_first, InputIt t_last);
+
+	// Parallel version of build using t_threads threads (0 = one per
+	// hardware thread). The values are split by key range with sampled
+	// splitters, and sorting, node construction and linking of the
+	// resulting subtrees run concurrently. An exception thrown on any
+	// thread is rethrown here once every thread has stopped; the tree is
+	// then unchanged or empty.
+	template <class InputIt>
+	void build(InputIt t_first, InputIt t_last, size_t t_threads);
 
 	// Public function to delete item t_data from the tree; calls deleteNode
-	void remove(T t_data) { remove_node(m_root, t_data); }
+	void remove(const T &t_data) { remove_node(m_root, t_data); }
+
+	// Public function to delete the item comparing equivalent to t_key
+	// without converting the key to T; needs a transparent comparator
+	template <class K, class C = Compare, class = typename C::is_transparent>
+	void remove(const K &t_key) { remove_node(m_root, t_key); }
 
-	// Public function to delete all items from the tree
-	void clear() { destroy_subtree(m_root); }
+	// Public function rebuilding the tree into a balanced shape in place
+	// with the Day-Stout-Warren algorithm, in O(n) time and O(1) extra
+	// memory. Subtree sizes and parent pointers are kept. The result is
+	// complete, duplicates included: its height is floor(log2(n)).
+	void rebalance() { rebalance_subtree(m_root); m_max_size = m_size; }
 
-	// Public function to print all nodes in order; calls in_order
+	// Public function turning scapegoat-style rebalancing on with weight
+	// factor t_alpha in (0.5, 1), or off with 0. An insert landing deeper
+	// than log(n) / log(1 / t_alpha), about 2.4 log2(n) for 0.75, rebuilds
+	// the subtree of its lowest ancestor whose larger child holds more than
+	// t_alpha of its nodes. Once removals shrink the tree below t_alpha
+	// times its largest size, the whole tree is rebalanced. Smaller values
+	// keep the tree shallower at the price of more frequent rebuilds.
+	// Throws invalid_argument for other values.
+	void set_auto_rebalance(double t_alpha);
+
+	// Public function to delete all items from the tree. With a pooling
+	// allocator and trivially destructible data the node storage is dropped
+	// block by block instead of node by node.
+	void clear();
+
+	// Public function to print all nodes in order; calls dump
 	void in_order_print()
 	{
-		in_order(m_root);
+		dump(cout, TraversalOrder::in_order);
 		cout << '\n';
 	}
 
-	// Public function to print all nodes pre-order; calls pre_order
+	// Public function to print all nodes pre-order; calls dump
 	void pre_order_print()
 	{
-		pre_order(m_root);
+		dump(cout, TraversalOrder::pre_order);
 		cout << '\n';
 	}
 
-	// Public function to print all nodes post order; calls post_order
+	// Public function to print all nodes post order; calls dump
 	void post_order_print()
 	{
-		post_order(m_root);
+		dump(cout, TraversalOrder::post_order);
 		cout << '\n';
 	}
 
+	// Public function calling t_visit(value) for every node in the given
+	// order, without recursion
+	template <class Visit>
+	void visit(TraversalOrder t_order, Visit &&t_visit) const
+	{
+		visit_nodes(m_root, t_order, [&](const Node<T> &t_node, size_t)
+					{ t_visit(t_node.data); });
+	}
+
+	// Public function writing every node to t_out through a block-buffered
+	// sink. The text format matches the print functions, values separated
+	// by three spaces; csv and ndjson carry value and depth.
+	void dump(ostream &t_out, TraversalOrder t_order = TraversalOrder::in_order, DumpFormat t_format = DumpFormat::text) const;
+
 	// Public function to search for an item in the tree
-	bool search(T t_data)
+	bool search(const T &t_data) const
 	{
 		return search_value(m_root, t_data);
 	}
 
+	// Public function to search for an item comparing equivalent to t_key,
+	// e.g. a string_view in a tree of strings, without converting the key
+	template <class K, class C = Compare, class = typename C::is_transparent>
+	bool search(const K &t_key) const
+	{
+		return search_value(m_root, t_key);
+	}
+
+	// Same as search
+	bool contains(const T &t_data) const { return search_value(m_root, t_data); }
+
+	template <class K, class C = Compare, class = typename C::is_transparent>
+	bool contains(const K &t_key) const { return search_value(m_root, t_key); }
+
+	// Default and maximum number of lookups interleaved by the batch
+	// functions
+	static constexpr size_t default_batch_group = 16;
+	static constexpr size_t max_batch_group = 64;
+
+	// Public function checking many items at once; t_results[i] is set to
+	// whether t_keys[i] is in the tree. Up to t_group independent lookups
+	// are in flight so their cache misses overlap. Throws invalid_argument
+	// if the spans differ in length.
+	void contains_batch(span<const T> t_keys, span<bool> t_results, size_t t_group = default_batch_group) const
+	{
+		lookup_batch(t_keys, t_results, t_group, false);
+	}
+
+	template <class K, class C = Compare, class = typename C::is_transparent>
+	void contains_batch(span<const K> t_keys, span<bool> t_results, size_t t_group = default_batch_group) const
+	{
+		lookup_batch(t_keys, t_results, t_group, false);
+	}
+
+	// Public function counting the copies of many items at once;
+	// t_counts[i] is set to the number of nodes equal to t_keys[i]. Throws
+	// invalid_argument if the spans differ in length.
+	void count_batch(span<const T> t_keys, span<size_t> t_counts, size_t t_group = default_batch_group) const
+	{
+		lookup_batch(t_keys, t_counts, t_group, true);
+	}
+
+	template <class K, class C = Compare, class = typename C::is_transparent>
+	void count_batch(span<const K> t_keys, span<size_t> t_counts, size_t t_group = default_batch_group) const
+	{
+		lookup_batch(t_keys, t_counts, t_group, true);
+	}
+
+	// Public function copying the values into an immutable index laid out
+	// for cache-friendly lookups; duplicates become one key with a count
+	FrozenIndex<T, Compare> freeze() const;
+
 	// Credit to:  Terry Griffin
-	// Receives a file_path and stores a GraphViz readable file;
-	// calls 	GraphVizGetIds and GraphVizMakeConnections
-	void graph_viz(string file_path);
+	// Receives a file_path and stores a GraphViz readable file, written in
+	// one buffered pass; t_options limits depth, samples subtrees or
+	// collapses chains so large trees stay drawable
+	void graph_viz(string file_path, const GraphVizOptions &t_options = {}) const;
+
+	// Public function writing the tree to a binary snapshot file (see
+	// tree_snapshot.hpp); throws runtime_error if it cannot be written.
+	// Pointer keys do not compile, since only their addresses would be
+	// stored.
+	void save(const string &file_path) const;
+
+	// Public function replacing the contents with a snapshot written by
+	// save, restoring the exact shape in linear time with the keys copied
+	// out of the file. Throws runtime_error if the file cannot be read,
+	// fails its checksum, is not a BST snapshot of this key type or holds
+	// keys out of order under Compare, and leaves the tree empty.
+	void load(const string &file_path);
+
+	// Same as load, from snapshot bytes already in memory such as a
+	// mapped file. Keys of view types like string_view point into t_bytes,
+	// which then has to outlive the tree; see MappedTree.
+	void load_snapshot(string_view t_bytes);
 
 	size_t size();
+
+	// Public function counting the values less than t_data in O(depth)
+	// using the subtree sizes kept in the nodes
+	size_t rank(const T &t_data) const { return count_before(t_data, false); }
+
+	template <class K, class C = Compare, class = typename C::is_transparent>
+	size_t rank(const K &t_key) const { return count_before(t_key, false); }
+
+	// Public function returning the t_index-th smallest value (zero-based,
+	// duplicates counted separately) in O(depth); throws out_of_range if
+	// t_index >= size()
+	const T &select(size_t t_index) const;
+
+	// Public function counting the values v with t_lo <= v <= t_hi in
+	// O(depth)
+	size_t count_range(const T &t_lo, const T &t_hi) const
+	{
+		size_t upper = count_before(t_hi, true);
+		size_t lower = count_before(t_lo, false);
+		return upper > lower ? upper - lower : 0;
+	}
+
+	template <class K, class C = Compare, class = typename C::is_transparent>
+	size_t count_range(const K &t_lo, const K &t_hi) const
+	{
+		size_t upper = count_before(t_hi, true);
+		size_t lower = count_before(t_lo, false);
+		return upper > lower ? upper - lower : 0;
+	}
+
+	// Public function returning the counters gathered by the Stats policy
+	// since the last reset; all zero with the default NullStats
+	StatsSnapshot stats() const { return m_stats.snapshot(); }
+
+	// Public function zeroing the counters of the Stats policy
+	void reset_stats() { m_stats.reset(); }
 };
 
-template <class T>
-double BinarySearchTree<T>::average_height()
+template <class T, class Compare, template <class> class Alloc, class Stats>
+double BinarySearchTree<T, Compare, Alloc, Stats>::average_height()
 {
-	size_t total = 0;
-	sum_heights(this->m_root, total);
-
-	double avg_height = (double)total / (double)(this->size());
+	return shape().average_height;
+}
 
-	return avg_height;
+// Counts the levels of the subtree one level at a time, so even a
+// degenerate chain is measured without recursion.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+size_t BinarySearchTree<T, Compare, Alloc, Stats>::sub_tree_height(Node<T> *t_node_ptr)
+{
+	return subtree_height(t_node_ptr);
 }
 
-template <class T>
-void BinarySearchTree<T>::sum_heights(Node<T> *t_node_ptr, size_t &total_height)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::clear()
 {
-	if (!t_node_ptr)
+	auto scope = m_stats.begin(TreeOp::clear);
+	if constexpr (Alloc<Node<T>>::bulk_release && is_trivially_destructible_v<T>)
 	{
-		return;
+		m_stats.deallocation(m_size);
+		m_root = nullptr;
+		m_size = 0;
 	}
+	else
+		destroy_subtree(m_root);
+	m_pool.release();
+	m_max_size = 0;
+}
 
-	sum_heights(t_node_ptr->left, total_height);
-	total_height += sub_tree_height(t_node_ptr);
-	sum_heights(t_node_ptr->right, total_height);
+// destroy_subtree deletes each node without recursion or an explicit
+// stack; see destroy_links.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::destroy_subtree(Node<T> *&t_node_ptr)
+{
+	destroy_links(t_node_ptr, [this](Node<T> *t_node)
+				  {
+		m_pool.destroy(t_node);
+		m_stats.deallocation();
+		m_size -= 1; });
 }
 
-template <class T>
-size_t BinarySearchTree<T>::sub_tree_height(Node<T> *t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::insert_node(Node<T> *&t_node_ptr, Node<T> *t_new_node)
 {
-	if(!t_node_ptr)
-	return 0;
+	// Walk down the tree until an empty child pointer, the insertion
+	// position, is found. At each node decide whether to traverse down
+	// the left subtree or right subtree by comparing value to be
+	// inserted with current node.
+	auto scope = m_stats.begin(TreeOp::insert);
+	m_stats.allocation();
+	Node<T> **link = &t_node_ptr;
+	Node<T> *parent = nullptr;
+	size_t depth = 0;
+	while (*link)
+	{
+		m_stats.visit();
+		depth++;
+		parent = *link;
+		parent->subtree_size++;
+		bool go_left; // node should be inserted in left subtree
+		if constexpr (compares_prefix<T>)
+		{
+			m_stats.comparison();
+			go_left = t_new_node->prefix.value != parent->prefix.value ? t_new_node->prefix.value < parent->prefix.value
+																	   : string_view(t_new_node->data) <= string_view(parent->data);
+		}
+		else
+			go_left = !less_than(parent->data, t_new_node->data);
+		if (go_left)
+			link = &parent->left;
+		else // node should be inserted in right subtree
+			link = &parent->right;
+	}
+	m_stats.path_depth(depth);
 
-	if(!t_node_ptr->left && !t_node_ptr->right)
-	return 0;
+	t_new_node->parent = parent;
+	*link = t_new_node;
+	m_size += 1;
 
-	size_t left_height = sub_tree_height(t_node_ptr->left);
-	size_t right_height = sub_tree_height(t_node_ptr->right);
+	if (m_alpha > 0)
+	{
+		m_max_size = max(m_max_size, m_size);
+		if ((double)depth > log2((double)m_size) / -log2(m_alpha))
+			rebuild_scapegoat(t_new_node);
+	}
+}
 
-	return max(left_height, right_height) + 1;
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::set_auto_rebalance(double t_alpha)
+{
+	if (t_alpha != 0 && !(t_alpha > 0.5 && t_alpha < 1))
+		throw invalid_argument("BinarySearchTree::set_auto_rebalance: alpha must be in (0.5, 1) or 0");
+	m_alpha = t_alpha;
+	m_max_size = m_size;
 }
 
-// destroy_subtree recursively visits and deletes each node
-// from the lowest level (leaves) up
-template <class T>
-void BinarySearchTree<T>::destroy_subtree(Node<T> *&t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::rotate_left(Node<T> *&t_node_ptr)
 {
-	if (t_node_ptr)
-	{
-		destroy_subtree(t_node_ptr->left);
-		destroy_subtree(t_node_ptr->right);
-		delete t_node_ptr;
-		t_node_ptr = nullptr;
-		m_size -= 1;
-	}
+	Node<T> *node = t_node_ptr;
+	Node<T> *child = rotate_link_left(t_node_ptr);
+	child->subtree_size = node->subtree_size;
+	node->subtree_size = 1 + (node->left ? node->left->subtree_size : 0) + (node->right ? node->right->subtree_size : 0);
+	m_stats.rotation(false);
 }
 
-template <class T>
-void BinarySearchTree<T>::insert_node(Node<T> *&t_node_ptr, T t_data)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::rotate_right(Node<T> *&t_node_ptr)
 {
-	// If t_node_ptr points to nullptr, the insertion position has been found
-	if (!t_node_ptr)
-	{
-		t_node_ptr = new Node<T>(t_data);
-		m_size += 1;
-	}
-	// If t_node_ptr does not point to nullptr, decide whether to traverse
-	// down the left subtree or right subtree by comparing value
-	// to be inserted with current node.
-	else if (t_data <= t_node_ptr->data) // node should be inserted in left subtree
-		insert_node(t_node_ptr->left, t_data);
-	else // node should be inserted in right subtree
-		insert_node(t_node_ptr->right, t_data);
+	Node<T> *node = t_node_ptr;
+	Node<T> *child = rotate_link_right(t_node_ptr);
+	child->subtree_size = node->subtree_size;
+	node->subtree_size = 1 + (node->left ? node->left->subtree_size : 0) + (node->right ? node->right->subtree_size : 0);
+	m_stats.rotation(false);
+}
+
+// The subtree is first flattened into a vine, a chain of right children,
+// by rotating right wherever a node has a left child. The m vine nodes are
+// then compressed: one pass places the m + 1 - 2^floor(log2(m + 1)) nodes
+// of the bottom level, and each following pass halves the spine until it
+// is a single node.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::rebalance_subtree(Node<T> *&t_node_ptr)
+{
+	auto scope = m_stats.begin(TreeOp::rebalance);
+	m_stats.recomputation();
+	size_t vine_nodes = t_node_ptr ? t_node_ptr->subtree_size : 0;
+	Node<T> **link = &t_node_ptr;
+	while (*link)
+	{
+		if ((*link)->left)
+			rotate_right(*link);
+		else
+			link = &(*link)->right;
+	}
+
+	size_t bottom = vine_nodes + 1 - bit_floor(vine_nodes + 1);
+	compress(t_node_ptr, bottom);
+	for (size_t spine = vine_nodes - bottom; spine > 1;)
+	{
+		spine /= 2;
+		compress(t_node_ptr, spine);
+	}
 }
 
-template <class T>
-void BinarySearchTree<T>::in_order(Node<T> *t_node_ptr) const
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::compress(Node<T> *&t_node_ptr, size_t t_count)
 {
-	if (t_node_ptr) // Equivalent to if(t_node_ptr != nullptr)
+	Node<T> **link = &t_node_ptr;
+	for (size_t i = 0; i < t_count; i++)
 	{
-		in_order(t_node_ptr->left);
-		cout << t_node_ptr->data << "   ";
-		in_order(t_node_ptr->right);
+		rotate_left(*link);
+		link = &(*link)->right;
 	}
 }
 
-template <class T>
-void BinarySearchTree<T>::pre_order(Node<T> *t_node_ptr) const
+// A node deeper than log(n) / log(1 / alpha) always has an ancestor whose
+// child on the path holds more than alpha of its nodes. The subtree
+// sizes kept in the nodes make the walk up to it O(depth).
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::rebuild_scapegoat(Node<T> *t_node_ptr)
 {
-	if (t_node_ptr) // same as if (t_node_ptr != nullptr)
+	Node<T> *child = t_node_ptr;
+	for (Node<T> *node = t_node_ptr->parent; node; child = node, node = node->parent)
 	{
-		cout << t_node_ptr->data << "   ";
-		pre_order(t_node_ptr->left);
-		pre_order(t_node_ptr->right);
+		if ((double)child->subtree_size > m_alpha * (double)node->subtree_size)
+		{
+			Node<T> *parent = node->parent;
+			rebalance_subtree(!parent ? m_root : parent->left == node ? parent->left : parent->right);
+			return;
+		}
 	}
 }
 
-template <class T>
-void BinarySearchTree<T>::post_order(Node<T> *t_node_ptr) const
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::dump(ostream &t_out, TraversalOrder t_order, DumpFormat t_format) const
 {
-	if (t_node_ptr)
+	BufferedSink sink(t_out);
+	switch (t_format)
 	{
-		post_order(t_node_ptr->left);
-		post_order(t_node_ptr->right);
-		cout << t_node_ptr->data << "   ";
+	case DumpFormat::text:
+		visit_nodes(m_root, t_order, [&](const Node<T> &t_node, size_t)
+					{
+			sink.write_text(t_node.data);
+			sink.write("   "); });
+		break;
+	case DumpFormat::csv:
+		sink.write("value,depth\n");
+		visit_nodes(m_root, t_order, [&](const Node<T> &t_node, size_t t_depth)
+					{
+			sink.write_csv(t_node.data);
+			sink.put(',');
+			sink.write_integer(t_depth);
+			sink.put('\n'); });
+		break;
+	case DumpFormat::ndjson:
+		visit_nodes(m_root, t_order, [&](const Node<T> &t_node, size_t t_depth)
+					{
+			sink.write("{\"value\":");
+			sink.write_json(t_node.data);
+			sink.write(",\"depth\":");
+			sink.write_integer(t_depth);
+			sink.write("}\n"); });
+		break;
 	}
 }
 
 // Deletes a node using right child promotion
-template <class T>
-void BinarySearchTree<T>::delete_node(Node<T> *&t_node_ptr)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::delete_node(Node<T> *&t_node_ptr)
 {
 	Node<T> *delPtr = t_node_ptr;
 	Node<T> *attach;
-	if (t_node_ptr->left == nullptr && t_node_ptr->right == nullptr) // no children
-		t_node_ptr = nullptr;
-	else if (t_node_ptr->right == nullptr) // only left child
-		t_node_ptr = t_node_ptr->left;
-	else if (t_node_ptr->left == nullptr) // only right child
-		t_node_ptr = t_node_ptr->right;
+	if (t_node_ptr->left == nullptr || t_node_ptr->right == nullptr) // at most one child
+		splice_link(t_node_ptr);
 	else // two children
 	{
+		// Every node on the way down to the successor gains the whole
+		// left subtree
+		size_t grafted = t_node_ptr->left->subtree_size;
 		attach = t_node_ptr->right;
+		attach->subtree_size += grafted;
 		while (attach->left != nullptr)
+		{
 			attach = attach->left;
+			attach->subtree_size += grafted;
+		}
 		attach->left = t_node_ptr->left;
+		attach->left->parent = attach;
 		t_node_ptr = t_node_ptr->right;
+		t_node_ptr->parent = delPtr->parent;
 	}
-	delete delPtr;
+	m_pool.destroy(delPtr);
+	m_stats.deallocation();
 	m_size -= 1;
 }
 
-// Recursive function that searches for node to be deleted and then
-// passes the appropriate pointer to method remove_node
-template <class T>
-void BinarySearchTree<T>::remove_node(Node<T> *&t_node_ptr, T t_data)
+// Iterative function that searches for node to be deleted and then
+// passes the appropriate pointer to method delete_node
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+void BinarySearchTree<T, Compare, Alloc, Stats>::remove_node(Node<T> *&t_node_ptr, const K &t_data)
 {
-	if (t_node_ptr)
+	auto scope = m_stats.begin(TreeOp::remove);
+	uint64_t prefix = probe_prefix(t_data);
+	Node<T> **link = &t_node_ptr;
+	size_t depth = 0;
+	while (*link)
 	{
-		if (t_node_ptr->data == t_data)
-			delete_node(t_node_ptr);
-		else if (t_data < t_node_ptr->data)
-			remove_node(t_node_ptr->left, t_data);
+		m_stats.visit();
+		depth++;
+		int order = compare_to_node(t_data, prefix, *link);
+		if (order < 0)
+			link = &(*link)->left;
+		else if (order > 0)
+			link = &(*link)->right;
 		else
-			remove_node(t_node_ptr->right, t_data);
+		{
+			m_stats.path_depth(depth);
+			// The same comparisons lead to the same node, so walk the path
+			// again to shrink the subtree sizes of its ancestors
+			for (Node<T> *ancestor = t_node_ptr; ancestor != *link;)
+			{
+				ancestor->subtree_size--;
+				ancestor = m_compare(t_data, ancestor->data) ? ancestor->left : ancestor->right;
+			}
+			delete_node(*link);
+			if (m_alpha > 0 && (double)m_size < m_alpha * (double)m_max_size)
+				rebalance();
+			return;
+		}
 	}
+	m_stats.path_depth(depth);
 }
 
-template <class T>
-bool BinarySearchTree<T>::search_value(Node<T> *t_node_ptr, T t_data)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+bool BinarySearchTree<T, Compare, Alloc, Stats>::search_value(Node<T> *t_node_ptr, const K &t_data) const
 {
-	if (t_node_ptr)
+	auto scope = m_stats.begin(TreeOp::search);
+	uint64_t prefix = probe_prefix(t_data);
+	size_t depth = 0;
+	while (t_node_ptr)
 	{
-		if (t_data == t_node_ptr->data)
-			return true;
-		else if (t_data < t_node_ptr->data)
-			return search_value(t_node_ptr->left, t_data);
+		m_stats.visit();
+		depth++;
+		int order = compare_to_node(t_data, prefix, t_node_ptr);
+		if (order < 0)
+			t_node_ptr = t_node_ptr->left;
+		else if (order > 0)
+			t_node_ptr = t_node_ptr->right;
 		else
-			return search_value(t_node_ptr->right, t_data);
+			break;
 	}
-	return false;
+	m_stats.path_depth(depth);
+	return t_node_ptr != nullptr;
 }
 
-template <class T>
-void BinarySearchTree<T>::graph_viz_ids(Node<T> *t_node_ptr, ofstream &VizOut)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::graph_viz(string file_path, const GraphVizOptions &t_options) const
 {
-	if (t_node_ptr)
+	write_graph_viz_file(file_path, m_root, t_options, [](BufferedSink &t_sink, const Node<T> &t_node)
+						 { t_sink.write_dot(t_node.data); });
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::save(const string &file_path) const
+{
+	static_assert(snapshot_key_v<T>, "pointer keys would be saved as addresses");
+	ofstream out(file_path, ios::binary | ios::trunc);
+	if (!out || !write_snapshot<T>(m_root, m_size, SnapshotKind::bst, out))
+		throw runtime_error("BinarySearchTree::save: cannot write " + file_path);
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::load(const string &file_path)
+{
+	static_assert(snapshot_key_v<T>, "pointer keys would be loaded as addresses from another process");
+	static_assert(!snapshot_view_key_v<T>, "keys would point into a temporary buffer; use load_snapshot on a mapped file");
+	ifstream in(file_path, ios::binary);
+	if (!in)
 	{
-		graph_viz_ids(t_node_ptr->left, VizOut);
-		VizOut << " node" << t_node_ptr->data << " [label=\"" << t_node_ptr->data << "\"];" << '\n';
-		graph_viz_ids(t_node_ptr->right, VizOut);
+		clear();
+		throw runtime_error("BinarySearchTree::load: cannot read " + file_path);
 	}
+	string bytes(istreambuf_iterator<char>(in), {});
+	load_snapshot(bytes);
 }
 
-template <class T>
-void BinarySearchTree<T>::graph_viz_connections(Node<T> *t_node_ptr, ofstream &VizOut)
+// Nodes come back in preorder, so walking them backwards sees every
+// node after its children and can sum up the subtree sizes. The same
+// walk checks that no key is less than its in-order predecessor under
+// m_compare.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::load_snapshot(string_view t_bytes)
 {
-	if (t_node_ptr)
+	clear();
+	auto scope = m_stats.begin(TreeOp::build);
+	vector<Node<T> *> nodes;
+	m_root = read_snapshot<T>(t_bytes, SnapshotKind::bst, [this](T t_key, const SnapshotRecord &)
+							  { return m_pool.create(std::move(t_key)); }, nodes);
+	m_size = nodes.size();
+	m_stats.allocation(m_size);
+
+	SnapshotOrderCheck<Node<T>> order;
+	for (size_t i = nodes.size(); i-- > 0;)
 	{
-		if (t_node_ptr->left)
-			VizOut << "  node" << t_node_ptr->data << "->"
-				   << " node" << t_node_ptr->left->data << '\n';
-		if (t_node_ptr->right)
-			VizOut << "  node" << t_node_ptr->data << "->"
-				   << " node" << t_node_ptr->right->data << '\n';
-		graph_viz_connections(t_node_ptr->left, VizOut);
-		graph_viz_connections(t_node_ptr->right, VizOut);
+		Node<T> *node = nodes[i];
+		node->subtree_size = 1 + (node->left ? node->left->subtree_size : 0) + (node->right ? node->right->subtree_size : 0);
+		if (!order.visit(node, [this](const T &t_lhs, const T &t_rhs)
+						 { return !less_than(t_rhs, t_lhs); }))
+		{
+			clear();
+			throw runtime_error("BinarySearchTree::load: keys are not in order");
+		}
 	}
 }
 
-template <class T>
-void BinarySearchTree<T>::graph_viz(string file_path)
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class InputIt>
+void BinarySearchTree<T, Compare, Alloc, Stats>::build(InputIt t_first, InputIt t_last)
 {
-	ofstream VizOut;
-	VizOut.open(file_path);
-	VizOut << "digraph g { \n";
-	graph_viz_ids(m_root, VizOut);
-	graph_viz_connections(m_root, VizOut);
-	VizOut << "} \n";
-	VizOut.close();
+	vector<T> values(t_first, t_last);
+	if (!is_sorted(values.begin(), values.end(), m_compare))
+		sort(values.begin(), values.end(), m_compare);
+
+	clear();
+	auto scope = m_stats.begin(TreeOp::build);
+	m_root = build_subtree(values, 0, values.size());
+	m_stats.allocation(values.size());
+	m_size = values.size();
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class InputIt>
+void BinarySearchTree<T, Compare, Alloc, Stats>::build(InputIt t_first, InputIt t_last, size_t t_threads)
+{
+	if constexpr (!is_base_of_v<random_access_iterator_tag, typename iterator_traits<InputIt>::iterator_category>)
+	{
+		vector<T> values(t_first, t_last);
+		build(values.begin(), values.end(), t_threads);
+	}
+	else
+	{
+		t_threads = resolve_thread_count(t_threads);
+		vector<vector<T>> buckets = parallel_sorted_buckets<T>(t_first, t_last, m_compare, t_threads);
+
+		vector<size_t> offsets(buckets.size() + 1, 0);
+		for (size_t bucket = 0; bucket < buckets.size(); bucket++)
+			offsets[bucket + 1] = offsets[bucket] + buckets[bucket].size();
+		size_t count = offsets.back();
+
+		// The pool is not thread-safe: take the storage up front, then
+		// construct the nodes concurrently. If anything throws, the nodes
+		// built so far are destroyed and all the storage goes back to the
+		// pool, leaving the tree empty.
+		clear();
+		auto scope = m_stats.begin(TreeOp::build);
+		vector<Node<T> *> nodes(count, nullptr);
+		vector<size_t> built(buckets.size(), 0); // Nodes constructed per bucket
+		try
+		{
+			for (Node<T> *&node : nodes)
+				node = m_pool.allocate();
+			parallel_for(buckets.size(), t_threads, [&](size_t bucket)
+						 {
+				for (size_t i = 0; i < buckets[bucket].size(); i++)
+				{
+					new (nodes[offsets[bucket] + i]) Node<T>(std::move(buckets[bucket][i]));
+					built[bucket]++;
+				}
+				vector<T>().swap(buckets[bucket]); });
+
+			size_t spawn_depth = 0;
+			while (((size_t)1 << spawn_depth) < t_threads)
+				spawn_depth++;
+			m_root = link_subtree(nodes.data(), 0, count, spawn_depth);
+		}
+		catch (...)
+		{
+			release_nodes(nodes, offsets, built);
+			throw;
+		}
+		m_stats.allocation(count);
+		m_size = count;
+	}
 }
 
-template <class T>
-size_t BinarySearchTree<T>::size()
+template <class T, class Compare, template <class> class Alloc, class Stats>
+typename BinarySearchTree<T, Compare, Alloc, Stats>::template Node<T> *BinarySearchTree<T, Compare, Alloc, Stats>::build_subtree(vector<T> &t_values, size_t t_lo, size_t t_hi)
+{
+	if (t_lo == t_hi)
+		return nullptr;
+
+	size_t mid = t_lo + (t_hi - t_lo) / 2;
+
+	Node<T> *node = m_pool.create(std::move(t_values[mid]));
+	node->left = build_subtree(t_values, t_lo, mid);
+	node->right = build_subtree(t_values, mid + 1, t_hi);
+	if (node->left)
+		node->left->parent = node;
+	if (node->right)
+		node->right->parent = node;
+	node->subtree_size = t_hi - t_lo;
+	return node;
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+void BinarySearchTree<T, Compare, Alloc, Stats>::release_nodes(const vector<Node<T> *> &t_nodes, const vector<size_t> &t_offsets, const vector<size_t> &t_built)
+{
+	for (size_t bucket = 0; bucket < t_built.size(); bucket++)
+		for (size_t i = 0; i < t_built[bucket]; i++)
+			t_nodes[t_offsets[bucket] + i]->~Node<T>();
+	for (Node<T> *node : t_nodes)
+		if (node)
+			m_pool.deallocate(node);
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+typename BinarySearchTree<T, Compare, Alloc, Stats>::template Node<T> *BinarySearchTree<T, Compare, Alloc, Stats>::link_subtree(Node<T> **t_nodes, size_t t_lo, size_t t_hi, size_t t_spawn_depth)
+{
+	if (t_lo == t_hi)
+		return nullptr;
+
+	size_t mid = t_lo + (t_hi - t_lo) / 2;
+
+	Node<T> *node = t_nodes[mid];
+	if (t_spawn_depth > 0)
+	{
+		auto left = async(launch::async, [=, this]()
+						  { return link_subtree(t_nodes, t_lo, mid, t_spawn_depth - 1); });
+		node->right = link_subtree(t_nodes, mid + 1, t_hi, t_spawn_depth - 1);
+		node->left = left.get();
+	}
+	else
+	{
+		node->left = link_subtree(t_nodes, t_lo, mid, 0);
+		node->right = link_subtree(t_nodes, mid + 1, t_hi, 0);
+	}
+	if (node->left)
+		node->left->parent = node;
+	if (node->right)
+		node->right->parent = node;
+	node->subtree_size = t_hi - t_lo;
+	return node;
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+FrozenIndex<T, Compare> BinarySearchTree<T, Compare, Alloc, Stats>::freeze() const
+{
+	vector<T> keys;
+	vector<size_t> counts;
+
+	vector<Node<T> *> stack;
+	Node<T> *t_node_ptr = m_root;
+	while (t_node_ptr || !stack.empty())
+	{
+		while (t_node_ptr)
+		{
+			stack.push_back(t_node_ptr);
+			t_node_ptr = t_node_ptr->left;
+		}
+		t_node_ptr = stack.back();
+		stack.pop_back();
+		// Values arrive in order, so duplicates are adjacent
+		if (!keys.empty() && !m_compare(keys.back(), t_node_ptr->data))
+			counts.back()++;
+		else
+		{
+			keys.push_back(t_node_ptr->data);
+			counts.push_back(1);
+		}
+		t_node_ptr = t_node_ptr->right;
+	}
+
+	return FrozenIndex<T, Compare>(std::move(keys), std::move(counts), m_compare);
+}
+
+// Lookups are processed in groups. In every round each unfinished lookup
+// of the group takes one step down the tree and prefetches the node it
+// moved to, so by the time the round comes back to it the node is likely
+// in cache.
+//
+// Copies of a value can sit on both sides of each other, so counting all
+// matches goes on in two phases after the first match. Its left subtree
+// holds values no greater than the key: every copy met there brings its
+// whole right subtree along and the walk carries on left of it. The right
+// subtree of the first match, remembered until then, is walked the same
+// way mirrored.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K, class R>
+void BinarySearchTree<T, Compare, Alloc, Stats>::lookup_batch(span<const K> t_keys, span<R> t_results, size_t t_group, bool t_all_matches) const
+{
+	if (t_results.size() != t_keys.size())
+		throw invalid_argument("BinarySearchTree: batch lookups need one result per key");
+	fill(t_results.begin(), t_results.end(), R{});
+	auto scope = m_stats.begin(TreeOp::search, t_keys.size());
+	t_group = clamp<size_t>(t_group, 1, max_batch_group);
+	Node<T> *cursor[max_batch_group];
+	Node<T> *pending[max_batch_group]; // Right subtree of the first match
+	uint8_t phase[max_batch_group];	   // 0 searching, 1 left of the match, 2 right of it
+	uint64_t prefixes[max_batch_group];
+
+	for (size_t base = 0; base < t_keys.size(); base += t_group)
+	{
+		size_t group = min(t_group, t_keys.size() - base);
+		for (size_t i = 0; i < group; i++)
+		{
+			cursor[i] = m_root;
+			pending[i] = nullptr;
+			phase[i] = 0;
+			prefixes[i] = probe_prefix(t_keys[base + i]);
+		}
+
+		size_t active = group;
+		size_t depth = 0; // Rounds run; the deepest lookup of the group
+		while (active)
+		{
+			active = 0;
+			depth++;
+			for (size_t i = 0; i < group; i++)
+			{
+				Node<T> *t_node_ptr = cursor[i];
+				if (!t_node_ptr)
+					continue;
+				m_stats.visit();
+				int order = compare_to_node(t_keys[base + i], prefixes[i], t_node_ptr);
+				if (order < 0)
+					t_node_ptr = t_node_ptr->left;
+				else if (order > 0)
+					t_node_ptr = t_node_ptr->right;
+				else if (phase[i] == 0)
+				{
+					if constexpr (is_same_v<R, bool>)
+						t_results[base + i] = true;
+					else
+						t_results[base + i] += 1;
+					if (t_all_matches)
+					{
+						pending[i] = t_node_ptr->right;
+						phase[i] = 1;
+						t_node_ptr = t_node_ptr->left;
+					}
+					else
+						t_node_ptr = nullptr;
+				}
+				else
+				{
+					// Everything between two copies is a copy as well
+					Node<T> *inner = phase[i] == 1 ? t_node_ptr->right : t_node_ptr->left;
+					if constexpr (!is_same_v<R, bool>)
+						t_results[base + i] += 1 + (inner ? inner->subtree_size : 0);
+					t_node_ptr = phase[i] == 1 ? t_node_ptr->left : t_node_ptr->right;
+				}
+				if (!t_node_ptr && phase[i] == 1)
+				{
+					t_node_ptr = pending[i];
+					phase[i] = 2;
+				}
+				if (t_node_ptr)
+				{
+					__builtin_prefetch(t_node_ptr);
+					active++;
+				}
+				cursor[i] = t_node_ptr;
+			}
+		}
+		m_stats.path_depth(depth);
+	}
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+size_t BinarySearchTree<T, Compare, Alloc, Stats>::size()
 {
 	return m_size;
 }
 
+// Keeps the last node that satisfied the bound while descending towards
+// the leftmost such node in in-order, so among duplicates the first one
+// is found.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+typename BinarySearchTree<T, Compare, Alloc, Stats>::template Node<T> *BinarySearchTree<T, Compare, Alloc, Stats>::bound_node(const K &t_key, bool t_strict) const
+{
+	auto scope = m_stats.begin(TreeOp::search);
+	Node<T> *bound = nullptr;
+	Node<T> *t_node_ptr = m_root;
+	while (t_node_ptr)
+	{
+		m_stats.visit();
+		bool satisfies = t_strict ? less_than(t_key, t_node_ptr->data) : !less_than(t_node_ptr->data, t_key);
+		if (satisfies)
+		{
+			bound = t_node_ptr;
+			t_node_ptr = t_node_ptr->left;
+		}
+		else
+			t_node_ptr = t_node_ptr->right;
+	}
+	return bound;
+}
+
+// Walks one root-to-leaf path; every time it moves right, the left
+// subtree and the node itself are all ordered before the key.
+template <class T, class Compare, template <class> class Alloc, class Stats>
+template <class K>
+size_t BinarySearchTree<T, Compare, Alloc, Stats>::count_before(const K &t_key, bool t_inclusive) const
+{
+	auto scope = m_stats.begin(TreeOp::search);
+	size_t before = 0;
+	Node<T> *t_node_ptr = m_root;
+	while (t_node_ptr)
+	{
+		m_stats.visit();
+		bool node_before = t_inclusive ? !less_than(t_key, t_node_ptr->data) : less_than(t_node_ptr->data, t_key);
+		if (node_before)
+		{
+			before += 1 + (t_node_ptr->left ? t_node_ptr->left->subtree_size : 0);
+			t_node_ptr = t_node_ptr->right;
+		}
+		else
+			t_node_ptr = t_node_ptr->left;
+	}
+	return before;
+}
+
+template <class T, class Compare, template <class> class Alloc, class Stats>
+const T &BinarySearchTree<T, Compare, Alloc, Stats>::select(size_t t_index) const
+{
+	if (t_index >= m_size)
+		throw out_of_range("BinarySearchTree::select: index out of range");
+
+	auto scope = m_stats.begin(TreeOp::search);
+	Node<T> *t_node_ptr = m_root;
+	while (true)
+	{
+		m_stats.visit();
+		size_t left_size = t_node_ptr->left ? t_node_ptr->left->subtree_size : 0;
+		if (t_index < left_size)
+			t_node_ptr = t_node_ptr->left;
+		else if (t_index == left_size)
+			return t_node_ptr->data;
+		else
+		{
+			t_index -= left_size + 1;
+			t_node_ptr = t_node_ptr->right;
+		}
+	}
+}
+
 #endif
\ No newline at end of file
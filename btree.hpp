@@ -0,0 +1,652 @@
+/// Header file for B-Tree class
+#ifndef BTREE_TEMPLATE
+#define BTREE_TEMPLATE
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include "tree_stats.hpp"
+
+using namespace std;
+
+/// @brief A class template for creating B-trees whose nodes are sized to
+/// a few cache lines. Each node holds a sorted array of keys, so a lookup
+/// touches one node per level instead of one per key comparison, and
+/// searches inside a node without data-dependent branches. Like AVLTree,
+/// equal values share one key with an occurrence count.
+/// @tparam T The type for the data to be stored in the tree.
+/// @tparam NodeBytes Target size of an internal node in bytes; leaves are
+/// the same minus the child pointers.
+/// @tparam Compare Ordering of the values. A transparent comparator such
+/// as the default less<> enables lookups with other key types.
+/// @tparam Stats Operation statistics policy, see tree_stats.hpp.
+template <class T, size_t NodeBytes = 256, class Compare = less<>, class Stats = NullStats>
+class BTree
+{
+private:
+    static constexpr size_t cache_line = 64;
+
+    // Keys that fit an internal node: each brings its count and one child
+    // pointer, plus the node header and the extra child pointer
+    static constexpr size_t fitting_keys = NodeBytes > 2 * sizeof(void *) ? (NodeBytes - 2 * sizeof(void *)) / (sizeof(T) + sizeof(size_t) + sizeof(void *)) : 0;
+
+public:
+    /// @brief Keys per node. Odd, so a full node splits around its median
+    /// into two nodes of min_keys each; at least 3.
+    static constexpr size_t max_keys = fitting_keys < 3 ? 3 : fitting_keys - 1 + fitting_keys % 2;
+
+    /// @brief Fewest keys any node but the root holds.
+    static constexpr size_t min_keys = (max_keys - 1) / 2;
+
+private:
+    static_assert(max_keys < 65536, "NodeBytes is too large for a 16-bit key count");
+
+    /// @brief A leaf node. Internal nodes extend it with child pointers.
+    struct alignas(cache_line) Node
+    {
+        uint16_t key_count{0};   // Keys in use, at the front of keys
+        bool leaf{true};         // Whether this is a plain Node or an Internal
+        T keys[max_keys]{};      // Sorted keys; slots past key_count are stale
+        size_t counts[max_keys]; // counts[i] = occurrences of keys[i]
+    };
+
+    /// @brief An internal node; children[i] holds the keys between
+    /// keys[i - 1] and keys[i].
+    struct alignas(cache_line) Internal : Node
+    {
+        Node *children[max_keys + 1];
+
+        Internal() { this->leaf = false; }
+    };
+
+    Node *m_root{nullptr};
+    size_t m_size{0};  // Distinct values
+    size_t m_total{0}; // Values, duplicates included
+    size_t m_nodes{0}; // Nodes allocated
+    Compare m_compare; // Ordering of the values
+    [[no_unique_address]] mutable Stats m_stats; // Operation counters; empty unless enabled
+
+    /// @brief Compares two values with m_compare, counting the comparison.
+    template <class A, class B>
+    bool less_than(const A &t_lhs, const B &t_rhs) const
+    {
+        m_stats.comparison();
+        return m_compare(t_lhs, t_rhs);
+    }
+
+    static Internal *internal(Node *t_node_ptr) { return static_cast<Internal *>(t_node_ptr); }
+    static const Internal *internal(const Node *t_node_ptr) { return static_cast<const Internal *>(t_node_ptr); }
+
+    /// @brief Allocates an empty node.
+    /// @param t_leaf Whether the node is a leaf.
+    /// @return Pointer to the new node.
+    Node *create_node(bool t_leaf);
+
+    /// @brief Frees one node, not its children.
+    /// @param t_node_ptr Pointer to node.
+    void destroy_node(Node *t_node_ptr);
+
+    /// @brief Finds the position of the first key of a node not ordered
+    /// before a key, without branching on the comparisons.
+    /// @param t_node_ptr Pointer to node.
+    /// @param t_key Key to compare with.
+    /// @return Index in [0, key_count].
+    template <class K>
+    size_t lower_index(const Node *t_node_ptr, const K &t_key) const;
+
+    /// @brief Walks down to the node holding a key.
+    /// @param t_key Key to look for.
+    /// @param t_index Set to the index of the key in the node.
+    /// @return Pointer to node, nullptr if the key is not in the tree.
+    template <class K>
+    Node *find_node(const K &t_key, size_t &t_index) const;
+
+    /// @brief Inserts a key and count into a node at a position, shifting
+    /// the keys after it.
+    void insert_at(Node *t_node_ptr, size_t t_index, T &&t_key, size_t t_count);
+
+    /// @brief Removes the key at a position of a node, shifting the keys
+    /// after it.
+    void erase_at(Node *t_node_ptr, size_t t_index);
+
+    /// @brief Splits the full child t_index of a node around its median,
+    /// which moves up into the node.
+    void split_child(Internal *t_node_ptr, size_t t_index);
+
+    /// @brief Merges child t_index + 1 of a node and the key separating it
+    /// from child t_index into child t_index.
+    void merge_children(Internal *t_node_ptr, size_t t_index);
+
+    /// @brief Makes sure child t_index of a node has more than min_keys
+    /// keys before a removal descends into it, by borrowing a key through
+    /// the parent from a sibling or by merging with one.
+    /// @return Index of the child now covering the same key range.
+    size_t fill_child(Internal *t_node_ptr, size_t t_index);
+
+    /// @brief Removes the largest or smallest key of a subtree whose root
+    /// has more than min_keys keys.
+    /// @param t_node_ptr Pointer to root of subtree.
+    /// @param t_largest true for the largest key, false for the smallest.
+    /// @return The key and its count.
+    pair<T, size_t> pop_extreme(Node *t_node_ptr, bool t_largest);
+
+    /// @brief Inserts a value, or counts one more occurrence of it.
+    /// @param t_data Value; forwarded into the tree if it is new.
+    template <class V>
+    void insert_key(V &&t_data);
+
+    /// @brief Removes one occurrence of a value in one pass down the tree,
+    /// merging or refilling nodes on the way so no node underflows. The
+    /// key goes once its count reaches zero.
+    /// @param t_key Key of the value to be removed.
+    /// @return true if the value was in the tree, false otherwise.
+    template <class K>
+    bool remove_key(const K &t_key);
+
+    /// @brief Checks for a value, counting the lookup as a search.
+    template <class K>
+    bool search_key(const K &t_key) const
+    {
+        auto scope = m_stats.begin(TreeOp::search);
+        size_t index;
+        return find_node(t_key, index) != nullptr;
+    }
+
+public:
+    /// @brief Create a default BTree object.
+    BTree() {}
+
+    /// @brief Delete the BTree object.
+    ~BTree() { clear(); }
+
+    BTree(const BTree &) = delete;
+    BTree &operator=(const BTree &) = delete;
+
+    /// @brief Clears the tree.
+    void clear();
+
+    /// @brief Insert a value into the tree.
+    /// @param t_data Value to be inserted.
+    void insert(const T &t_data) { insert_key(t_data); }
+
+    /// @brief Insert a value into the tree, moving it in if it is new.
+    /// @param t_data Value to be inserted.
+    void insert(T &&t_data) { insert_key(std::move(t_data)); }
+
+    /// @brief Remove one occurrence of a value from the tree, like
+    /// AVLTree::remove; the key goes once its count reaches zero.
+    /// @param t_data Value to be removed.
+    /// @return true if the value was in the tree, false otherwise.
+    bool remove(const T &t_data) { return remove_key(t_data); }
+
+    /// @brief Remove one occurrence of the value comparing equivalent to a
+    /// key.
+    /// @param t_key Key of the value to be removed.
+    /// @return true if the value was in the tree, false otherwise.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    bool remove(const K &t_key) { return remove_key(t_key); }
+
+    /// @brief Check if a value exists in the tree.
+    /// @param t_data Value to be checked.
+    /// @return true if value exists, false otherwise.
+    bool search(const T &t_data) const { return search_key(t_data); }
+
+    /// @brief Check if a key comparing equivalent to a value exists in the
+    /// tree, without converting the key to T.
+    /// @param t_key Key to be checked.
+    /// @return true if value exists, false otherwise.
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    bool search(const K &t_key) const { return search_key(t_key); }
+
+    /// @brief Same as search.
+    bool contains(const T &t_data) const { return search_key(t_data); }
+
+    template <class K, class C = Compare, class = typename C::is_transparent>
+    bool contains(const K &t_key) const { return search_key(t_key); }
+
+    /// @brief Calls t_visit(value, count) for every distinct value in
+    /// order, without recursion.
+    /// @param t_visit Callable taking (const T &, size_t count).
+    template <class Visit>
+    void visit(Visit &&t_visit) const;
+
+    /// @brief Calculates the height of the tree. Every leaf is at the same
+    /// depth, so this is the number of levels below the root.
+    /// @return Height of the tree.
+    size_t height() const;
+
+    /// @brief Computes the average node height of the tree, over nodes
+    /// rather than keys, with leaves at height 0.
+    /// @return Average node height.
+    double average_height() const;
+
+    /// @brief Size of the tree, meaning number of distinct values; the
+    /// number of nodes of AVLTree.
+    /// @return Size of the tree.
+    size_t size() const { return m_size; }
+
+    /// @brief Number of values in the tree, duplicates included.
+    /// @return Sum of the counts of all keys.
+    size_t total_count() const { return m_total; }
+
+    /// @brief Number of B-tree nodes.
+    /// @return Nodes allocated.
+    size_t node_count() const { return m_nodes; }
+
+    /// @brief Counters gathered by the Stats policy since the last reset.
+    /// All zero with the default NullStats.
+    /// @return Copy of the counters.
+    StatsSnapshot stats() const { return m_stats.snapshot(); }
+
+    /// @brief Zeroes the counters of the Stats policy.
+    void reset_stats() { m_stats.reset(); }
+};
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+typename BTree<T, NodeBytes, Compare, Stats>::Node *BTree<T, NodeBytes, Compare, Stats>::create_node(bool t_leaf)
+{
+    m_stats.allocation();
+    m_nodes += 1;
+    if (t_leaf)
+        return new Node();
+    return new Internal();
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+void BTree<T, NodeBytes, Compare, Stats>::destroy_node(Node *t_node_ptr)
+{
+    m_stats.deallocation();
+    m_nodes -= 1;
+    if (t_node_ptr->leaf)
+        delete t_node_ptr;
+    else
+        delete internal(t_node_ptr);
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+void BTree<T, NodeBytes, Compare, Stats>::clear()
+{
+    auto scope = m_stats.begin(TreeOp::clear);
+    vector<Node *> stack;
+    if (m_root)
+        stack.push_back(m_root);
+    while (!stack.empty())
+    {
+        Node *node = stack.back();
+        stack.pop_back();
+        if (!node->leaf)
+            for (size_t i = 0; i <= node->key_count; i++)
+                stack.push_back(internal(node)->children[i]);
+        destroy_node(node);
+    }
+    m_root = nullptr;
+    m_size = 0;
+    m_total = 0;
+}
+
+// Arithmetic keys under the default ordering are counted with a fixed
+// trip-count loop over the whole key array, masked to the keys in use,
+// which the compiler turns into packed compares. Other keys use a binary
+// search whose steps select with conditional moves instead of branches.
+template <class T, size_t NodeBytes, class Compare, class Stats>
+template <class K>
+size_t BTree<T, NodeBytes, Compare, Stats>::lower_index(const Node *t_node_ptr, const K &t_key) const
+{
+    const T *keys = t_node_ptr->keys;
+    size_t count = t_node_ptr->key_count;
+    if constexpr (is_arithmetic_v<T> && is_same_v<K, T> && !Stats::enabled && (is_same_v<Compare, less<>> || is_same_v<Compare, less<T>>))
+    {
+        size_t index = 0;
+        for (size_t i = 0; i < max_keys; i++)
+            index += (keys[i] < t_key) & (i < count);
+        return index;
+    }
+    else
+    {
+        const T *first = keys;
+        while (count > 0)
+        {
+            size_t half = count / 2;
+            bool right = less_than(first[half], t_key);
+            first = right ? first + half + 1 : first;
+            count = right ? count - half - 1 : half;
+        }
+        return first - keys;
+    }
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+template <class K>
+typename BTree<T, NodeBytes, Compare, Stats>::Node *BTree<T, NodeBytes, Compare, Stats>::find_node(const K &t_key, size_t &t_index) const
+{
+    Node *node = m_root;
+    size_t depth = 0;
+    while (node)
+    {
+        m_stats.visit();
+        depth++;
+        size_t index = lower_index(node, t_key);
+        if (index < node->key_count && !less_than(t_key, node->keys[index]))
+        {
+            t_index = index;
+            break;
+        }
+        node = node->leaf ? nullptr : internal(node)->children[index];
+    }
+    m_stats.path_depth(depth);
+    return node;
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+void BTree<T, NodeBytes, Compare, Stats>::insert_at(Node *t_node_ptr, size_t t_index, T &&t_key, size_t t_count)
+{
+    size_t count = t_node_ptr->key_count;
+    move_backward(t_node_ptr->keys + t_index, t_node_ptr->keys + count, t_node_ptr->keys + count + 1);
+    copy_backward(t_node_ptr->counts + t_index, t_node_ptr->counts + count, t_node_ptr->counts + count + 1);
+    t_node_ptr->keys[t_index] = std::move(t_key);
+    t_node_ptr->counts[t_index] = t_count;
+    t_node_ptr->key_count++;
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+void BTree<T, NodeBytes, Compare, Stats>::erase_at(Node *t_node_ptr, size_t t_index)
+{
+    size_t count = t_node_ptr->key_count;
+    move(t_node_ptr->keys + t_index + 1, t_node_ptr->keys + count, t_node_ptr->keys + t_index);
+    copy(t_node_ptr->counts + t_index + 1, t_node_ptr->counts + count, t_node_ptr->counts + t_index);
+    t_node_ptr->keys[count - 1] = T(); // Release what the stale slot holds
+    t_node_ptr->key_count--;
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+void BTree<T, NodeBytes, Compare, Stats>::split_child(Internal *t_node_ptr, size_t t_index)
+{
+    Node *full = t_node_ptr->children[t_index];
+    Node *sibling = create_node(full->leaf);
+    move(full->keys + min_keys + 1, full->keys + max_keys, sibling->keys);
+    copy(full->counts + min_keys + 1, full->counts + max_keys, sibling->counts);
+    if (!full->leaf)
+        copy(internal(full)->children + min_keys + 1, internal(full)->children + max_keys + 1, internal(sibling)->children);
+    sibling->key_count = min_keys;
+    full->key_count = min_keys;
+
+    size_t count = t_node_ptr->key_count;
+    copy_backward(t_node_ptr->children + t_index + 1, t_node_ptr->children + count + 1, t_node_ptr->children + count + 2);
+    t_node_ptr->children[t_index + 1] = sibling;
+    insert_at(t_node_ptr, t_index, std::move(full->keys[min_keys]), full->counts[min_keys]);
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+void BTree<T, NodeBytes, Compare, Stats>::merge_children(Internal *t_node_ptr, size_t t_index)
+{
+    Node *left = t_node_ptr->children[t_index];
+    Node *right = t_node_ptr->children[t_index + 1];
+    size_t base = left->key_count;
+    left->keys[base] = std::move(t_node_ptr->keys[t_index]);
+    left->counts[base] = t_node_ptr->counts[t_index];
+    move(right->keys, right->keys + right->key_count, left->keys + base + 1);
+    copy(right->counts, right->counts + right->key_count, left->counts + base + 1);
+    if (!left->leaf)
+        copy(internal(right)->children, internal(right)->children + right->key_count + 1, internal(left)->children + base + 1);
+    left->key_count += 1 + right->key_count;
+
+    size_t count = t_node_ptr->key_count;
+    copy(t_node_ptr->children + t_index + 2, t_node_ptr->children + count + 1, t_node_ptr->children + t_index + 1);
+    erase_at(t_node_ptr, t_index);
+    destroy_node(right);
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+size_t BTree<T, NodeBytes, Compare, Stats>::fill_child(Internal *t_node_ptr, size_t t_index)
+{
+    Node *child = t_node_ptr->children[t_index];
+    if (child->key_count > min_keys)
+        return t_index;
+
+    if (t_index > 0 && t_node_ptr->children[t_index - 1]->key_count > min_keys)
+    {
+        // Rotate the last key of the left sibling up and the separator down
+        Node *sibling = t_node_ptr->children[t_index - 1];
+        size_t last = sibling->key_count - 1;
+        if (!child->leaf)
+        {
+            copy_backward(internal(child)->children, internal(child)->children + child->key_count + 1, internal(child)->children + child->key_count + 2);
+            internal(child)->children[0] = internal(sibling)->children[last + 1];
+        }
+        insert_at(child, 0, std::move(t_node_ptr->keys[t_index - 1]), t_node_ptr->counts[t_index - 1]);
+        t_node_ptr->keys[t_index - 1] = std::move(sibling->keys[last]);
+        t_node_ptr->counts[t_index - 1] = sibling->counts[last];
+        erase_at(sibling, last);
+        return t_index;
+    }
+    if (t_index < t_node_ptr->key_count && t_node_ptr->children[t_index + 1]->key_count > min_keys)
+    {
+        // Rotate the first key of the right sibling up and the separator down
+        Node *sibling = t_node_ptr->children[t_index + 1];
+        if (!child->leaf)
+        {
+            internal(child)->children[child->key_count + 1] = internal(sibling)->children[0];
+            copy(internal(sibling)->children + 1, internal(sibling)->children + sibling->key_count + 1, internal(sibling)->children);
+        }
+        insert_at(child, child->key_count, std::move(t_node_ptr->keys[t_index]), t_node_ptr->counts[t_index]);
+        t_node_ptr->keys[t_index] = std::move(sibling->keys[0]);
+        t_node_ptr->counts[t_index] = sibling->counts[0];
+        erase_at(sibling, 0);
+        return t_index;
+    }
+    if (t_index < t_node_ptr->key_count)
+    {
+        merge_children(t_node_ptr, t_index);
+        return t_index;
+    }
+    merge_children(t_node_ptr, t_index - 1);
+    return t_index - 1;
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+pair<T, size_t> BTree<T, NodeBytes, Compare, Stats>::pop_extreme(Node *t_node_ptr, bool t_largest)
+{
+    while (!t_node_ptr->leaf)
+    {
+        m_stats.visit();
+        Internal *node = internal(t_node_ptr);
+        size_t index = fill_child(node, t_largest ? node->key_count : 0);
+        t_node_ptr = node->children[index];
+    }
+    m_stats.visit();
+    size_t index = t_largest ? t_node_ptr->key_count - 1 : 0;
+    pair<T, size_t> extreme(std::move(t_node_ptr->keys[index]), t_node_ptr->counts[index]);
+    erase_at(t_node_ptr, index);
+    return extreme;
+}
+
+// Duplicates only bump a count and must not reshape the tree, so the
+// value is looked up first. A new value then goes down from the root,
+// splitting every full node it meets, which guarantees the leaf it lands
+// in has room and no split ever has to travel back up.
+template <class T, size_t NodeBytes, class Compare, class Stats>
+template <class V>
+void BTree<T, NodeBytes, Compare, Stats>::insert_key(V &&t_data)
+{
+    auto scope = m_stats.begin(TreeOp::insert);
+    size_t index;
+    if (Node *node = find_node(t_data, index))
+    {
+        node->counts[index]++;
+        m_total += 1;
+        return;
+    }
+
+    if (!m_root)
+        m_root = create_node(true);
+    else if (m_root->key_count == max_keys)
+    {
+        Internal *root = internal(create_node(false));
+        root->children[0] = m_root;
+        m_root = root;
+        split_child(root, 0);
+    }
+
+    Node *node = m_root;
+    while (!node->leaf)
+    {
+        Internal *parent = internal(node);
+        index = lower_index(parent, t_data);
+        if (parent->children[index]->key_count == max_keys)
+        {
+            split_child(parent, index);
+            if (less_than(parent->keys[index], t_data))
+                index++;
+        }
+        node = parent->children[index];
+    }
+    insert_at(node, lower_index(node, t_data), T(std::forward<V>(t_data)), 1);
+    m_size += 1;
+    m_total += 1;
+}
+
+// Every node the walk enters is first given more than min_keys keys, so
+// removing from a leaf, or merging two children of the current node,
+// never leaves a node below the minimum. A key with more than one
+// occurrence only loses one from its count. Otherwise a key found in an
+// internal node is replaced by its predecessor or successor when the
+// child on that side can spare a key, and merged down into that child
+// if neither can.
+template <class T, size_t NodeBytes, class Compare, class Stats>
+template <class K>
+bool BTree<T, NodeBytes, Compare, Stats>::remove_key(const K &t_key)
+{
+    auto scope = m_stats.begin(TreeOp::remove);
+    Node *node = m_root;
+    size_t depth = 0;
+    bool removed = false;
+    while (node)
+    {
+        m_stats.visit();
+        depth++;
+        size_t index = lower_index(node, t_key);
+        bool found = index < node->key_count && !less_than(t_key, node->keys[index]);
+        if (found && node->counts[index] > 1)
+        {
+            node->counts[index] -= 1;
+            m_total -= 1;
+            removed = true;
+            break;
+        }
+        if (node->leaf)
+        {
+            if (found)
+            {
+                m_total -= 1;
+                m_size -= 1;
+                erase_at(node, index);
+                removed = true;
+            }
+            break;
+        }
+
+        Internal *parent = internal(node);
+        if (!found)
+        {
+            node = parent->children[fill_child(parent, index)];
+            continue;
+        }
+
+        Node *left = parent->children[index];
+        Node *right = parent->children[index + 1];
+        if (left->key_count > min_keys || right->key_count > min_keys)
+        {
+            m_total -= 1;
+            m_size -= 1;
+            tie(parent->keys[index], parent->counts[index]) = pop_extreme(left->key_count > min_keys ? left : right, left->key_count > min_keys);
+            removed = true;
+            break;
+        }
+        merge_children(parent, index);
+        node = left;
+    }
+    m_stats.path_depth(depth);
+
+    // A merge below the root may have taken its last key
+    if (m_root && m_root->key_count == 0)
+    {
+        Node *old_root = m_root;
+        m_root = old_root->leaf ? nullptr : internal(old_root)->children[0];
+        destroy_node(old_root);
+    }
+    return removed;
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+template <class Visit>
+void BTree<T, NodeBytes, Compare, Stats>::visit(Visit &&t_visit) const
+{
+    // Each frame is an internal node and the next child to descend into
+    vector<pair<const Internal *, size_t>> stack;
+    const Node *node = m_root;
+    while (node || !stack.empty())
+    {
+        if (node)
+        {
+            if (node->leaf)
+            {
+                for (size_t i = 0; i < node->key_count; i++)
+                    t_visit(node->keys[i], node->counts[i]);
+                node = nullptr;
+            }
+            else
+            {
+                stack.push_back({internal(node), 1});
+                node = internal(node)->children[0];
+            }
+            continue;
+        }
+        auto &[parent, next] = stack.back();
+        if (next > parent->key_count)
+        {
+            stack.pop_back();
+            continue;
+        }
+        t_visit(parent->keys[next - 1], parent->counts[next - 1]);
+        node = parent->children[next++];
+    }
+}
+
+template <class T, size_t NodeBytes, class Compare, class Stats>
+size_t BTree<T, NodeBytes, Compare, Stats>::height() const
+{
+    size_t levels = 0;
+    for (const Node *node = m_root; node && !node->leaf; node = internal(node)->children[0])
+        levels++;
+    return levels;
+}
+
+// All leaves share one depth, so a node's height is the tree height minus
+// its depth. Only internal nodes are walked, level by level, to count the
+// nodes on each level.
+template <class T, size_t NodeBytes, class Compare, class Stats>
+double BTree<T, NodeBytes, Compare, Stats>::average_height() const
+{
+    if (!m_root)
+        return 0;
+
+    size_t tree_height = height();
+    size_t total_height = 0;
+    vector<const Node *> level{m_root};
+    vector<const Node *> next_level;
+    for (size_t depth = 0; depth < tree_height; depth++)
+    {
+        total_height += level.size() * (tree_height - depth);
+        next_level.clear();
+        for (const Node *node : level)
+            next_level.insert(next_level.end(), internal(node)->children, internal(node)->children + node->key_count + 1);
+        level.swap(next_level);
+    }
+    return (double)total_height / (double)m_nodes;
+}
+
+#endif
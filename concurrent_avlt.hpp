@@ -0,0 +1,532 @@
+/// Header file for the concurrent AVL Tree class
+#ifndef CONCURRENT_AVL_TEMPLATE
+#define CONCURRENT_AVL_TEMPLATE
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+/// @brief An AVL tree that many threads can read while writers modify it.
+/// Published nodes are never changed: a writer copies the nodes on the path
+/// it touches and then publishes a new root with one atomic store. Readers
+/// take a Snapshot without locking and keep seeing the version they
+/// started with. Replaced nodes are freed by epoch-based reclamation once
+/// no reader can still hold them. Writers are serialized by a mutex.
+/// @tparam T The type for the data to be stored in the tree.
+/// @tparam Compare Ordering of the values; see AVLTree.
+template <class T, class Compare = less<>>
+class ConcurrentAVLTree
+{
+private:
+    /// @brief Tree node. Immutable once reachable from a published version.
+    struct Node
+    {
+        T data;
+        size_t count{1};  // Count of duplicate values
+        long height{0};   // Height of the subtree rooted at this node
+        Node *left{nullptr};
+        Node *right{nullptr};
+        uint64_t stamp{0}; // Write operation that created the node
+
+        Node(T t_data, uint64_t t_stamp) : data(std::move(t_data)), stamp(t_stamp) {}
+    };
+
+    /// @brief A published state of the tree.
+    struct Version
+    {
+        Node *root{nullptr};
+        size_t size{0}; // Number of nodes
+    };
+
+    /// @brief Nodes and version replaced by one write, freed once every
+    /// reader active at retirement time has finished.
+    struct Retired
+    {
+        uint64_t epoch;
+        vector<Node *> nodes;
+        Version *version;
+    };
+
+    // Reader slots per block; more blocks are chained on when they run out
+    static constexpr size_t readers_per_block = 128;
+
+    /// @brief Epoch announced by one active reader, 0 when the slot is free.
+    /// Padded to a cache line so readers do not contend.
+    struct alignas(64) ReaderSlot
+    {
+        atomic<uint64_t> epoch{0};
+    };
+
+    /// @brief A block of reader slots. Blocks are only added, never
+    /// removed, until the tree is destroyed.
+    struct ReaderBlock
+    {
+        ReaderSlot slots[readers_per_block];
+        atomic<ReaderBlock *> next{nullptr};
+    };
+
+    atomic<Version *> m_version;
+    atomic<uint64_t> m_epoch{1};
+    mutable ReaderBlock m_readers; // First block of the chain
+    Compare m_compare;
+
+    // Writer state, protected by m_write_mutex
+    mutex m_write_mutex;
+    uint64_t m_stamp{0};       // Current write operation
+    vector<Node *> m_retiring; // Nodes replaced by the current write
+    deque<Retired> m_limbo;    // Retired nodes waiting for readers
+
+    static long node_height(const Node *t_node_ptr) { return t_node_ptr ? t_node_ptr->height : -1; }
+
+    static long balance_factor(const Node *t_node_ptr) { return node_height(t_node_ptr->left) - node_height(t_node_ptr->right); }
+
+    static void update_height(Node *t_node_ptr) { t_node_ptr->height = max(node_height(t_node_ptr->left), node_height(t_node_ptr->right)) + 1; }
+
+    /// @brief Returns a node the current write may modify: the node itself
+    /// if this write created it, otherwise a copy, retiring the original.
+    /// @param t_node_ptr Pointer to node.
+    /// @return Pointer to a writable node with the same contents.
+    Node *writable(Node *t_node_ptr);
+
+    /// @brief Rotates a writable subtree left.
+    /// @param t_node_ptr Pointer to root of subtree.
+    /// @return Pointer to the new root of the subtree.
+    Node *rotate_left(Node *t_node_ptr);
+
+    /// @brief Rotates a writable subtree right.
+    /// @param t_node_ptr Pointer to root of subtree.
+    /// @return Pointer to the new root of the subtree.
+    Node *rotate_right(Node *t_node_ptr);
+
+    /// @brief Restores the AVL property at a writable node whose subtrees
+    /// are balanced.
+    /// @param t_node_ptr Pointer to root of subtree.
+    /// @return Pointer to the new root of the subtree.
+    Node *rebalance(Node *t_node_ptr);
+
+    /// @brief Inserts a value, copying the path to it.
+    /// @param t_node_ptr Pointer to root of subtree.
+    /// @param t_data Value to be inserted.
+    /// @param t_added Set to true if a new node was created.
+    /// @return Pointer to the new root of the subtree.
+    template <class V>
+    Node *insert_node(Node *t_node_ptr, V &&t_data, bool &t_added);
+
+    /// @brief Removes one occurrence of a value known to be in the subtree,
+    /// copying the path to it.
+    /// @param t_node_ptr Pointer to root of subtree.
+    /// @param t_data Value to be removed.
+    /// @param t_deleted Set to true if a node was deleted.
+    /// @return Pointer to the new root of the subtree.
+    template <class K>
+    Node *remove_node(Node *t_node_ptr, const K &t_data, bool &t_deleted);
+
+    /// @brief Detaches the smallest node of a subtree.
+    /// @param t_node_ptr Pointer to root of subtree.
+    /// @param t_min Set to the detached node, which is retired.
+    /// @return Pointer to the new root of the subtree.
+    Node *remove_min(Node *t_node_ptr, Node *&t_min);
+
+    /// @brief Finds the node holding a value.
+    /// @param t_root Pointer to root of the tree.
+    /// @param t_data Value to look for.
+    /// @return Pointer to node, nullptr if absent.
+    template <class K>
+    const Node *find_node(const Node *t_root, const K &t_data) const;
+
+    /// @brief Publishes a new version and retires what the write replaced.
+    /// @param t_root Root of the new version.
+    /// @param t_size Number of nodes of the new version.
+    void publish(Node *t_root, size_t t_size);
+
+    /// @brief Frees retired nodes that no active reader can reach.
+    void reclaim();
+
+    /// @brief Deletes every node of a subtree.
+    /// @param t_node_ptr Pointer to root of subtree.
+    static void destroy_subtree(Node *t_node_ptr);
+
+public:
+    /// @brief A consistent, read-only view of the tree. Creating one never
+    /// blocks: when every reader slot is taken, as with many nested or
+    /// long-lived snapshots, another block of slots is allocated. Writers
+    /// keep working while it is alive, but memory they replace is only
+    /// freed after it is destroyed, so keep it short-lived.
+    class Snapshot
+    {
+    private:
+        const ConcurrentAVLTree *m_tree;
+        ReaderSlot *m_slot;
+        const Version *m_version;
+
+    public:
+        /// @brief Announces the reader and pins the current version.
+        /// @param t_tree Tree to read.
+        explicit Snapshot(const ConcurrentAVLTree &t_tree);
+
+        /// @brief Releases the pinned version.
+        ~Snapshot() { m_slot->epoch.store(0); }
+
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+
+        /// @brief Check if a value exists in the snapshot.
+        /// @param t_data Value to be checked.
+        /// @return true if value exists, false otherwise.
+        template <class K>
+        bool search_value(const K &t_data) const { return m_tree->find_node(m_version->root, t_data) != nullptr; }
+
+        /// @brief Number of occurrences of a value in the snapshot.
+        /// @param t_data Value to be counted.
+        /// @return Count of the value, 0 if absent.
+        template <class K>
+        size_t count(const K &t_data) const
+        {
+            const Node *node = m_tree->find_node(m_version->root, t_data);
+            return node ? node->count : 0;
+        }
+
+        /// @brief Size of the snapshot, meaning number of nodes.
+        /// @return Size of the snapshot.
+        size_t size() const { return m_version->size; }
+
+        /// @brief Calculates the height of the snapshot.
+        /// @return Height of the snapshot.
+        size_t height() const { return m_version->root ? m_version->root->height : 0; }
+    };
+
+    /// @brief Create an empty ConcurrentAVLTree object.
+    ConcurrentAVLTree() : m_version(new Version) {}
+
+    /// @brief Delete the tree. No reader or writer may be active.
+    ~ConcurrentAVLTree();
+
+    ConcurrentAVLTree(const ConcurrentAVLTree &) = delete;
+    ConcurrentAVLTree &operator=(const ConcurrentAVLTree &) = delete;
+
+    /// @brief Take a snapshot for a series of consistent reads.
+    /// @return Snapshot of the current version.
+    Snapshot snapshot() const { return Snapshot(*this); }
+
+    /// @brief Insert a value into the tree.
+    /// @param t_data Value to be inserted.
+    void insert(T t_data);
+
+    /// @brief Remove one occurrence of a value from the tree.
+    /// @param t_data Value to be removed.
+    /// @return true if the value was in the tree, false otherwise.
+    template <class K>
+    bool remove(const K &t_data);
+
+    /// @brief Check if a value exists in the tree.
+    /// @param t_data Value to be checked.
+    /// @return true if value exists, false otherwise.
+    template <class K>
+    bool search_value(const K &t_data) const { return snapshot().search_value(t_data); }
+
+    /// @brief Size of the tree, meaning number of nodes.
+    /// @return Size of the tree.
+    size_t size() const { return snapshot().size(); }
+
+    /// @brief Calculates the height of the tree.
+    /// @return Height of the tree.
+    size_t height() const { return snapshot().height(); }
+};
+
+// A reader claims a free slot by swapping its 0 for the current epoch, then
+// loads the version. A writer frees nodes retired at epoch e only when no
+// slot holds an epoch <= e, so a reader that could have seen those nodes
+// always keeps them alive. The slot scan starts at a per-thread position
+// to spread readers out. A reader that finds a whole block taken moves on
+// to the next one, appending a new block with a compare-and-swap if there
+// is none, so it never waits for another reader to finish.
+template <class T, class Compare>
+ConcurrentAVLTree<T, Compare>::Snapshot::Snapshot(const ConcurrentAVLTree &t_tree) : m_tree(&t_tree), m_slot(nullptr)
+{
+    size_t start = hash<thread::id>()(this_thread::get_id()) % readers_per_block;
+    ReaderBlock *block = &t_tree.m_readers;
+    while (!m_slot)
+    {
+        for (size_t i = 0; i < readers_per_block && !m_slot; i++)
+        {
+            ReaderSlot &slot = block->slots[(start + i) % readers_per_block];
+            uint64_t expected = 0;
+            if (slot.epoch.compare_exchange_strong(expected, t_tree.m_epoch.load()))
+                m_slot = &slot;
+        }
+        if (m_slot)
+            break;
+
+        ReaderBlock *next = block->next.load();
+        if (!next)
+        {
+            ReaderBlock *fresh = new ReaderBlock;
+            if (block->next.compare_exchange_strong(next, fresh))
+                next = fresh;
+            else
+                delete fresh; // Another reader appended one first; next now holds it
+        }
+        block = next;
+    }
+    m_version = t_tree.m_version.load();
+}
+
+template <class T, class Compare>
+ConcurrentAVLTree<T, Compare>::~ConcurrentAVLTree()
+{
+    Version *version = m_version.load();
+    destroy_subtree(version->root);
+    delete version;
+    for (Retired &retired : m_limbo)
+    {
+        for (Node *node : retired.nodes)
+            delete node;
+        delete retired.version;
+    }
+    for (ReaderBlock *block = m_readers.next.load(); block;)
+    {
+        ReaderBlock *next = block->next.load();
+        delete block;
+        block = next;
+    }
+}
+
+template <class T, class Compare>
+typename ConcurrentAVLTree<T, Compare>::Node *ConcurrentAVLTree<T, Compare>::writable(Node *t_node_ptr)
+{
+    if (t_node_ptr->stamp == m_stamp)
+        return t_node_ptr;
+
+    Node *copy = new Node(*t_node_ptr);
+    copy->stamp = m_stamp;
+    m_retiring.push_back(t_node_ptr);
+    return copy;
+}
+
+template <class T, class Compare>
+typename ConcurrentAVLTree<T, Compare>::Node *ConcurrentAVLTree<T, Compare>::rotate_left(Node *t_node_ptr)
+{
+    Node *Temp = writable(t_node_ptr->right);
+    t_node_ptr->right = Temp->left;
+    Temp->left = t_node_ptr;
+    update_height(t_node_ptr);
+    update_height(Temp);
+    return Temp;
+}
+
+template <class T, class Compare>
+typename ConcurrentAVLTree<T, Compare>::Node *ConcurrentAVLTree<T, Compare>::rotate_right(Node *t_node_ptr)
+{
+    Node *Temp = writable(t_node_ptr->left);
+    t_node_ptr->left = Temp->right;
+    Temp->right = t_node_ptr;
+    update_height(t_node_ptr);
+    update_height(Temp);
+    return Temp;
+}
+
+template <class T, class Compare>
+typename ConcurrentAVLTree<T, Compare>::Node *ConcurrentAVLTree<T, Compare>::rebalance(Node *t_node_ptr)
+{
+    update_height(t_node_ptr);
+    long balance = balance_factor(t_node_ptr);
+    if (balance > 1)
+    {
+        if (balance_factor(t_node_ptr->left) < 0) // left-right case
+            t_node_ptr->left = rotate_left(writable(t_node_ptr->left));
+        return rotate_right(t_node_ptr);
+    }
+    if (balance < -1)
+    {
+        if (balance_factor(t_node_ptr->right) > 0) // right-left case
+            t_node_ptr->right = rotate_right(writable(t_node_ptr->right));
+        return rotate_left(t_node_ptr);
+    }
+    return t_node_ptr;
+}
+
+// Recursion depth is bounded by the AVL height, about 1.44 log2(n).
+template <class T, class Compare>
+template <class V>
+typename ConcurrentAVLTree<T, Compare>::Node *ConcurrentAVLTree<T, Compare>::insert_node(Node *t_node_ptr, V &&t_data, bool &t_added)
+{
+    if (!t_node_ptr)
+    {
+        t_added = true;
+        return new Node(std::forward<V>(t_data), m_stamp);
+    }
+
+    Node *copy = writable(t_node_ptr);
+    if (m_compare(t_data, copy->data))
+        copy->left = insert_node(copy->left, std::forward<V>(t_data), t_added);
+    else if (m_compare(copy->data, t_data))
+        copy->right = insert_node(copy->right, std::forward<V>(t_data), t_added);
+    else
+    {
+        copy->count++; // Update count of duplicate t_data
+        return copy;
+    }
+    return rebalance(copy);
+}
+
+template <class T, class Compare>
+typename ConcurrentAVLTree<T, Compare>::Node *ConcurrentAVLTree<T, Compare>::remove_min(Node *t_node_ptr, Node *&t_min)
+{
+    if (!t_node_ptr->left)
+    {
+        t_min = t_node_ptr;
+        m_retiring.push_back(t_node_ptr);
+        return t_node_ptr->right;
+    }
+    Node *copy = writable(t_node_ptr);
+    copy->left = remove_min(copy->left, t_min);
+    return rebalance(copy);
+}
+
+template <class T, class Compare>
+template <class K>
+typename ConcurrentAVLTree<T, Compare>::Node *ConcurrentAVLTree<T, Compare>::remove_node(Node *t_node_ptr, const K &t_data, bool &t_deleted)
+{
+    if (m_compare(t_data, t_node_ptr->data))
+    {
+        Node *copy = writable(t_node_ptr);
+        copy->left = remove_node(copy->left, t_data, t_deleted);
+        return rebalance(copy);
+    }
+    if (m_compare(t_node_ptr->data, t_data))
+    {
+        Node *copy = writable(t_node_ptr);
+        copy->right = remove_node(copy->right, t_data, t_deleted);
+        return rebalance(copy);
+    }
+
+    if (t_node_ptr->count > 1)
+    {
+        Node *copy = writable(t_node_ptr);
+        copy->count--;
+        return copy;
+    }
+
+    t_deleted = true;
+    m_retiring.push_back(t_node_ptr);
+    if (!t_node_ptr->left)
+        return t_node_ptr->right;
+    if (!t_node_ptr->right)
+        return t_node_ptr->left;
+
+    // Two children: the in-order successor takes the node's place
+    Node *successor = nullptr;
+    Node *right = remove_min(t_node_ptr->right, successor);
+    Node *replacement = new Node(successor->data, m_stamp);
+    replacement->count = successor->count;
+    replacement->left = t_node_ptr->left;
+    replacement->right = right;
+    return rebalance(replacement);
+}
+
+template <class T, class Compare>
+template <class K>
+const typename ConcurrentAVLTree<T, Compare>::Node *ConcurrentAVLTree<T, Compare>::find_node(const Node *t_root, const K &t_data) const
+{
+    const Node *t_node_ptr = t_root;
+    while (t_node_ptr)
+    {
+        if (m_compare(t_data, t_node_ptr->data))
+            t_node_ptr = t_node_ptr->left;
+        else if (m_compare(t_node_ptr->data, t_data))
+            t_node_ptr = t_node_ptr->right;
+        else
+            return t_node_ptr;
+    }
+    return nullptr;
+}
+
+template <class T, class Compare>
+void ConcurrentAVLTree<T, Compare>::insert(T t_data)
+{
+    lock_guard<mutex> lock(m_write_mutex);
+    m_stamp++;
+    Version *current = m_version.load();
+    bool added = false;
+    Node *root = insert_node(current->root, std::move(t_data), added);
+    publish(root, current->size + (added ? 1 : 0));
+}
+
+template <class T, class Compare>
+template <class K>
+bool ConcurrentAVLTree<T, Compare>::remove(const K &t_data)
+{
+    lock_guard<mutex> lock(m_write_mutex);
+    Version *current = m_version.load();
+    if (!find_node(current->root, t_data))
+        return false;
+
+    m_stamp++;
+    bool deleted = false;
+    Node *root = remove_node(current->root, t_data, deleted);
+    publish(root, current->size - (deleted ? 1 : 0));
+    return true;
+}
+
+template <class T, class Compare>
+void ConcurrentAVLTree<T, Compare>::publish(Node *t_root, size_t t_size)
+{
+    Version *version = new Version{t_root, t_size};
+    Version *previous = m_version.exchange(version);
+
+    m_limbo.push_back({m_epoch.load(), std::move(m_retiring), previous});
+    m_retiring.clear();
+    m_epoch.fetch_add(1);
+    reclaim();
+}
+
+template <class T, class Compare>
+void ConcurrentAVLTree<T, Compare>::reclaim()
+{
+    uint64_t oldest = UINT64_MAX;
+    for (ReaderBlock *block = &m_readers; block; block = block->next.load())
+    {
+        for (ReaderSlot &slot : block->slots)
+        {
+            uint64_t epoch = slot.epoch.load();
+            if (epoch)
+                oldest = min(oldest, epoch);
+        }
+    }
+
+    while (!m_limbo.empty() && m_limbo.front().epoch < oldest)
+    {
+        for (Node *node : m_limbo.front().nodes)
+            delete node;
+        delete m_limbo.front().version;
+        m_limbo.pop_front();
+    }
+}
+
+template <class T, class Compare>
+void ConcurrentAVLTree<T, Compare>::destroy_subtree(Node *t_node_ptr)
+{
+    vector<Node *> stack;
+    if (t_node_ptr)
+        stack.push_back(t_node_ptr);
+    while (!stack.empty())
+    {
+        Node *node = stack.back();
+        stack.pop_back();
+        if (node->left)
+            stack.push_back(node->left);
+        if (node->right)
+            stack.push_back(node->right);
+        delete node;
+    }
+}
+
+#endif
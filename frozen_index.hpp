@@ -0,0 +1,121 @@
+/// Header file for the read-only search index exported by the trees
+#ifndef FROZEN_INDEX
+#define FROZEN_INDEX
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <utility>
+#include <algorithm>
+
+using namespace std;
+
+/// @brief An immutable set of distinct keys with occurrence counts, stored
+/// in Eytzinger (breadth-first) order in one contiguous array. The first
+/// levels of the implicit tree share cache lines and the descendants of a
+/// key a few levels down are adjacent, so a lookup can prefetch them while
+/// the current comparison is in flight.
+/// @tparam T The type of the keys.
+/// @tparam Compare Ordering of the keys; see AVLTree.
+template <class T, class Compare = less<>>
+class FrozenIndex
+{
+private:
+    vector<T> m_keys;        // m_keys[k] for k in 1..size(); slot 0 unused
+    vector<size_t> m_counts; // m_counts[k] = occurrences of m_keys[k]
+    Compare m_compare;
+
+    // Number of levels looked ahead when prefetching: the 2^d descendants
+    // d levels below a key are contiguous, so pick d such that they fill
+    // about one cache line.
+    static constexpr size_t prefetch_levels = sizeof(T) <= 4 ? 4 : sizeof(T) <= 8 ? 3 : sizeof(T) <= 16 ? 2 : 1;
+
+    /// @brief Places the sorted keys into Eytzinger order with an in-order
+    /// walk of the implicit tree.
+    /// @param t_keys Sorted keys; moved from.
+    /// @param t_counts Counts matching t_keys.
+    void layout(vector<T> &t_keys, vector<size_t> &t_counts)
+    {
+        size_t n = t_keys.size();
+        if (n == 0)
+            return;
+
+        // Iterative in-order walk of the implicit tree: start at the
+        // leftmost position, then repeatedly step to the in-order successor.
+        size_t k = 1;
+        while (2 * k <= n)
+            k = 2 * k;
+        for (size_t next = 0; next < n; next++)
+        {
+            m_keys[k] = std::move(t_keys[next]);
+            m_counts[k] = t_counts[next];
+            if (2 * k + 1 <= n) // leftmost position of the right subtree
+            {
+                k = 2 * k + 1;
+                while (2 * k <= n)
+                    k = 2 * k;
+            }
+            else // climb past right children, then up once more
+            {
+                while (k & 1)
+                    k >>= 1;
+                k >>= 1;
+            }
+        }
+    }
+
+    /// @brief Finds the Eytzinger position of the first key not less than
+    /// t_key using a branch-free descent.
+    /// @param t_key Key to look for.
+    /// @return Position of the lower bound, 0 if every key is less.
+    template <class K>
+    size_t lower_bound_index(const K &t_key) const
+    {
+        const T *keys = m_keys.data();
+        size_t n = m_keys.size() - 1;
+        size_t k = 1;
+        while (k <= n)
+        {
+            __builtin_prefetch(keys + min(k << prefetch_levels, n));
+            k = 2 * k + (size_t)m_compare(keys[k], t_key);
+        }
+        // Undo the right turns taken after the last left turn
+        k >>= __builtin_ffsll(~k);
+        return k;
+    }
+
+public:
+    /// @brief Creates an empty index.
+    FrozenIndex() : m_keys(1), m_counts(1) {}
+
+    /// @brief Creates an index from sorted, distinct keys.
+    /// @param t_keys Keys in ascending order without duplicates.
+    /// @param t_counts Number of occurrences of each key.
+    /// @param t_compare Ordering the keys are sorted by.
+    FrozenIndex(vector<T> t_keys, vector<size_t> t_counts, Compare t_compare = Compare())
+        : m_keys(t_keys.size() + 1), m_counts(t_keys.size() + 1), m_compare(t_compare)
+    {
+        layout(t_keys, t_counts);
+    }
+
+    /// @brief Number of distinct keys in the index.
+    /// @return Number of keys.
+    size_t size() const { return m_keys.size() - 1; }
+
+    /// @brief Number of occurrences of a key.
+    /// @param t_key Key to look for.
+    /// @return Count of the key, 0 if absent.
+    template <class K>
+    size_t count(const K &t_key) const
+    {
+        size_t k = lower_bound_index(t_key);
+        return (k && !m_compare(t_key, m_keys[k])) ? m_counts[k] : 0;
+    }
+
+    /// @brief Checks if a key is in the index.
+    /// @param t_key Key to look for.
+    /// @return true if the key exists, false otherwise.
+    template <class K>
+    bool contains(const K &t_key) const { return count(t_key) != 0; }
+};
+
+#endif
@@ -0,0 +1,64 @@
+/// Header file for the cached key prefixes of string keyed tree nodes
+#ifndef KEY_PREFIX
+#define KEY_PREFIX
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+using namespace std;
+
+// Comparing two std::string or string_view keys reads their characters,
+// which live outside the node: on the heap for long strings, in a mapped
+// file for string_view. A node of a string keyed tree therefore also
+// stores the first eight bytes of its key as a big-endian integer, padded
+// with zero bytes. Unsigned integer order on the prefixes agrees with the
+// lexicographic order of the strings, so two keys whose prefixes differ
+// are ordered by one integer compare on data already in the node; only
+// keys sharing their first eight bytes fall back to the full comparison.
+// Strings short enough for the small string buffer of std::string are
+// already stored inline and gain only the cheaper compare.
+
+/// @brief Whether nodes of a tree cache a prefix of their keys: std::string
+/// and string_view keys under the default lexicographic ordering. Other
+/// types convertible to string_view, such as const char *, are excluded
+/// because less<> orders them by something other than their characters.
+template <class T, class Compare>
+inline constexpr bool key_prefix_enabled_v = (is_same_v<T, string> || is_same_v<T, string_view>) &&
+                                             (is_same_v<Compare, less<>> || is_same_v<Compare, less<T>>);
+
+/// @brief The first eight bytes of a string as a big-endian integer,
+/// padded with zero bytes.
+inline uint64_t key_prefix(string_view t_key)
+{
+    unsigned char bytes[8] = {};
+    memcpy(bytes, t_key.data(), t_key.size() < 8 ? t_key.size() : 8);
+    uint64_t prefix;
+    memcpy(&prefix, bytes, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    prefix = __builtin_bswap64(prefix);
+#endif
+    return prefix;
+}
+
+/// @brief Prefix field of a node; empty unless Enabled.
+template <class T, bool Enabled>
+struct KeyPrefix
+{
+    KeyPrefix() {}
+    explicit KeyPrefix(const T &) {}
+};
+
+template <class T>
+struct KeyPrefix<T, true>
+{
+    uint64_t value{0};
+
+    KeyPrefix() {}
+    explicit KeyPrefix(const T &t_key) : value(key_prefix(string_view(t_key))) {}
+};
+
+#endif
@@ -7,26 +7,25 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <memory>
 #include <ctime>
 #include <random>
 #include "bst.hpp"
 #include "avlt.hpp"
+#include "btree.hpp"
+#include "word_loader.hpp"
 
 using namespace std;
 
 int main()
 {
-	BinarySearchTree<string> bstree;
-	AVLTree<string> avltree;
-	ifstream infile("words.txt");
-	string word;
-
-	// Read in all words from file
-	while (infile && infile >> word)
-	{
-		bstree.insert(word);
-		avltree.insert(word);
-	}
+	// Map the word file once; both trees hold views into the mapping
+	// instead of their own copies of the words
+	auto words = make_shared<const MappedWordFile>("words.txt");
+	MappedTree<BinarySearchTree<string_view>> bstree(words);
+	MappedTree<AVLTree<string_view>> avltree(words);
+	MappedTree<BTree<string_view>> btree(words);
 
 	cout << "Angel Badillo, Samuel Olatunde\n"
 		 << "CMPS 5243 270 - Project 3\n"
@@ -38,16 +37,19 @@ int main()
 	cout << string(100, '-') << "\n\n";
 
 	// Print out heights of each tree
-	cout << "Height of Binary Search Tree:              " << bstree.height() << '\n';
-	cout << "Height of AVL Tree:                        " << avltree.height() << '\n';
+	cout << "Height of Binary Search Tree:              " << bstree->height() << '\n';
+	cout << "Height of AVL Tree:                        " << avltree->height() << '\n';
+	cout << "Height of B-Tree:                          " << btree->height() << '\n';
 
 	// Print out average node heights of each tree
-	cout << "Average Node Height of Binary Search Tree: " << bstree.average_height() << '\n';
-	cout << "Average Node Height of AVL Tree:           " << avltree.average_height() << '\n';
+	cout << "Average Node Height of Binary Search Tree: " << bstree->average_height() << '\n';
+	cout << "Average Node Height of AVL Tree:           " << avltree->average_height() << '\n';
+	cout << "Average Node Height of B-Tree:             " << btree->average_height() << '\n';
 
 	// Print out total number of nodes in each tree
-	cout << "Number of Nodes in Binary Search Tree:     " << bstree.size() << '\n';
-	cout << "Number of Nodes in AVL Tree:               " << avltree.size() << '\n';
+	cout << "Number of Nodes in Binary Search Tree:     " << bstree->size() << '\n';
+	cout << "Number of Nodes in AVL Tree:               " << avltree->size() << '\n';
+	cout << "Number of Nodes in B-Tree:                 " << btree->node_count() << " (" << btree->size() << " keys)\n";
 	
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,299 @@
+/// Header file for the node allocators used by the tree classes
+#ifndef NODE_POOL
+#define NODE_POOL
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+// A node allocator is a class template taking the node type. The trees
+// instantiate it as Alloc<Node<T>> and use the following interface:
+//   NodeT *allocate()                  raw storage for one node
+//   void deallocate(NodeT *)           return raw storage
+//   NodeT *create(Args &&...)          allocate + construct
+//   void destroy(NodeT *)              destruct + deallocate
+//   void release()                     drop every node at once
+//   void share(const Alloc &)          keep the storage of another
+//                                      allocator's nodes alive, for nodes
+//                                      moved over by split
+//   void adopt(Alloc &)                take over all storage of another
+//                                      allocator, which is left empty, for
+//                                      nodes moved over by join
+//   bool holds_foreign_nodes() const   true if nodes from another
+//                                      allocator may be in use, so release()
+//                                      alone would not hand their storage
+//                                      back
+//   static constexpr bool bulk_release true if release() frees all storage
+
+/// @brief Slab allocator handing out nodes from contiguous blocks. Freed
+/// nodes are recycled through an intrusive free list and release() drops
+/// every block at once, so tearing a tree down costs O(blocks).
+///
+/// Every block belongs to the arena of the pool that allocated it. Pools
+/// that took over nodes through share() hold a reference to the block,
+/// which keeps it alive. When such a pool frees one of those nodes, the
+/// slot goes back to the owning arena under its mutex, and the owner
+/// picks it up before it grows again. Pools whose blocks are shared may
+/// therefore be used from different threads.
+/// @tparam NodeT The node type to allocate.
+template <class NodeT>
+class NodePool
+{
+private:
+    /// @brief Storage for one node; doubles as a free list link when unused.
+    union Slot
+    {
+        Slot *next;
+        alignas(NodeT) unsigned char storage[sizeof(NodeT)];
+    };
+
+    /// @brief Receives the slots of a pool's blocks freed by other pools.
+    struct Arena
+    {
+        atomic<NodePool *> owner;         // Pool handing out the slots, nullptr once released
+        mutex lock;                       // Guards returned
+        Slot *returned{nullptr};          // Slots freed by other pools
+        atomic<bool> has_returned{false}; // Whether returned is non-empty
+
+        explicit Arena(NodePool *t_owner) : owner(t_owner) {}
+    };
+
+    /// @brief Contiguous storage for a number of slots.
+    struct Block
+    {
+        Slot *slots;
+        size_t capacity;
+        shared_ptr<Arena> arena; // Arena the slots are returned to
+
+        Block(size_t t_capacity, shared_ptr<Arena> t_arena)
+            : slots(static_cast<Slot *>(::operator new(t_capacity * sizeof(Slot)))), capacity(t_capacity), arena(std::move(t_arena)) {}
+        Block(const Block &) = delete;
+        Block &operator=(const Block &) = delete;
+        ~Block() { ::operator delete(slots); }
+    };
+
+    static constexpr size_t first_block_nodes = 64;
+    static constexpr size_t max_block_nodes = 65536;
+
+    vector<shared_ptr<Block>> m_blocks;  // Blocks holding nodes of the pool, own or shared, by address
+    vector<shared_ptr<Arena>> m_arenas;  // Arenas owned; new blocks go to the first
+    Slot *m_current{nullptr};            // Newest own block, the one slots are handed out from
+    Slot *m_free{nullptr};               // Head of the free list
+    size_t m_block_used{0};              // Slots handed out from the newest block
+    size_t m_block_capacity{0};          // Slots in the newest block
+    bool m_foreign{false};               // Whether m_blocks holds blocks of other pools
+
+    /// @brief Inserts block references keeping m_blocks ordered by address
+    /// and free of duplicates.
+    void add_blocks(const vector<shared_ptr<Block>> &t_blocks)
+    {
+        m_blocks.insert(m_blocks.end(), t_blocks.begin(), t_blocks.end());
+        sort(m_blocks.begin(), m_blocks.end(), [](const shared_ptr<Block> &t_lhs, const shared_ptr<Block> &t_rhs)
+             { return t_lhs->slots < t_rhs->slots; });
+        m_blocks.erase(unique(m_blocks.begin(), m_blocks.end()), m_blocks.end());
+    }
+
+    /// @brief Allocates a new block, doubling the block size up to a cap.
+    void grow()
+    {
+        if (m_arenas.empty())
+            m_arenas.push_back(make_shared<Arena>(this));
+        m_block_capacity = m_block_capacity ? min(m_block_capacity * 2, max_block_nodes) : first_block_nodes;
+        auto block = make_shared<Block>(m_block_capacity, m_arenas.front());
+        m_current = block->slots;
+        m_blocks.insert(upper_bound(m_blocks.begin(), m_blocks.end(), m_current, [](Slot *t_slots, const shared_ptr<Block> &t_block)
+                                    { return t_slots < t_block->slots; }),
+                        std::move(block));
+        m_block_used = 0;
+    }
+
+    /// @brief Moves the slots other pools returned to the owned arenas onto
+    /// the free list.
+    void reclaim()
+    {
+        for (const shared_ptr<Arena> &arena : m_arenas)
+        {
+            if (!arena->has_returned.load(memory_order_acquire))
+                continue;
+            Slot *slot;
+            {
+                lock_guard<mutex> guard(arena->lock);
+                slot = arena->returned;
+                arena->returned = nullptr;
+                arena->has_returned.store(false, memory_order_relaxed);
+            }
+            while (slot)
+            {
+                Slot *next = slot->next;
+                slot->next = m_free;
+                m_free = slot;
+                slot = next;
+            }
+        }
+    }
+
+    /// @brief The arena a slot belongs to, found by address among the
+    /// blocks of the pool.
+    Arena &arena_of(Slot *t_slot) const
+    {
+        auto it = upper_bound(m_blocks.begin(), m_blocks.end(), t_slot, [](Slot *t_lhs, const shared_ptr<Block> &t_block)
+                              { return t_lhs < t_block->slots; });
+        return *(*--it)->arena;
+    }
+
+public:
+    static constexpr bool bulk_release = true;
+
+    NodePool() {}
+    NodePool(const NodePool &) = delete;
+    NodePool &operator=(const NodePool &) = delete;
+    ~NodePool() { release(); }
+
+    /// @brief Hands out raw storage for one node.
+    /// @return Pointer to uninitialized storage.
+    NodeT *allocate()
+    {
+        if (!m_free && m_block_used == m_block_capacity)
+            reclaim();
+        if (m_free)
+        {
+            Slot *slot = m_free;
+            m_free = slot->next;
+            return reinterpret_cast<NodeT *>(slot);
+        }
+        if (m_block_used == m_block_capacity)
+            grow();
+        return reinterpret_cast<NodeT *>(&m_current[m_block_used++]);
+    }
+
+    /// @brief Returns raw storage of one node to the free list, or to the
+    /// arena of the pool that allocated it.
+    /// @param t_node_ptr Pointer obtained from allocate() of this pool or
+    /// of a pool whose nodes it took over.
+    void deallocate(NodeT *t_node_ptr)
+    {
+        Slot *slot = reinterpret_cast<Slot *>(t_node_ptr);
+        if (m_foreign)
+        {
+            Arena &arena = arena_of(slot);
+            if (arena.owner.load(memory_order_relaxed) != this)
+            {
+                lock_guard<mutex> guard(arena.lock);
+                slot->next = arena.returned;
+                arena.returned = slot;
+                arena.has_returned.store(true, memory_order_release);
+                return;
+            }
+        }
+        slot->next = m_free;
+        m_free = slot;
+    }
+
+    /// @brief Allocates and constructs a node.
+    /// @param t_args Arguments forwarded to the node constructor.
+    /// @return Pointer to the new node.
+    template <class... Args>
+    NodeT *create(Args &&...t_args)
+    {
+        return new (allocate()) NodeT(forward<Args>(t_args)...);
+    }
+
+    /// @brief Destructs a node and recycles its storage.
+    /// @param t_node_ptr Pointer to node.
+    void destroy(NodeT *t_node_ptr)
+    {
+        t_node_ptr->~NodeT();
+        deallocate(t_node_ptr);
+    }
+
+    /// @brief Keeps the blocks of another pool alive as long as this one,
+    /// so nodes moved over from it stay valid after it is released. Nodes
+    /// of those blocks freed here go back to the other pool.
+    /// @param t_other Pool the nodes came from.
+    void share(const NodePool &t_other)
+    {
+        if (&t_other == this || t_other.m_blocks.empty())
+            return;
+        add_blocks(t_other.m_blocks);
+        m_foreign = true;
+    }
+
+    /// @brief Takes over the blocks, arenas and free slots of another pool,
+    /// which is left empty. Slots left unused at the end of its newest
+    /// block are not handed out again.
+    /// @param t_other Pool the nodes came from.
+    void adopt(NodePool &t_other)
+    {
+        if (&t_other == this)
+            return;
+        for (shared_ptr<Arena> &arena : t_other.m_arenas)
+        {
+            arena->owner.store(this, memory_order_relaxed);
+            m_arenas.push_back(std::move(arena));
+        }
+        add_blocks(t_other.m_blocks);
+        m_foreign = m_foreign || t_other.m_foreign;
+        while (Slot *slot = t_other.m_free)
+        {
+            t_other.m_free = slot->next;
+            slot->next = m_free;
+            m_free = slot;
+        }
+        t_other.m_arenas.clear();
+        t_other.release();
+    }
+
+    /// @brief Whether nodes of another pool's blocks may be in use here, in
+    /// which case they have to be destroyed one by one to go back.
+    bool holds_foreign_nodes() const { return m_foreign; }
+
+    /// @brief Drops every block, freeing those no other pool shares. Nodes
+    /// are not destructed, so callers must destroy nodes whose data needs
+    /// it first. Slots other pools return later to the dropped blocks are
+    /// not handed out again.
+    void release()
+    {
+        for (const shared_ptr<Arena> &arena : m_arenas)
+            arena->owner.store(nullptr, memory_order_relaxed);
+        m_arenas.clear();
+        m_blocks.clear();
+        m_current = nullptr;
+        m_free = nullptr;
+        m_block_used = 0;
+        m_block_capacity = 0;
+        m_foreign = false;
+    }
+};
+
+/// @brief Node allocator calling plain new and delete for every node.
+/// @tparam NodeT The node type to allocate.
+template <class NodeT>
+class HeapNodeAllocator
+{
+public:
+    static constexpr bool bulk_release = false;
+
+    HeapNodeAllocator() {}
+    HeapNodeAllocator(const HeapNodeAllocator &) = delete;
+    HeapNodeAllocator &operator=(const HeapNodeAllocator &) = delete;
+
+    NodeT *allocate() { return static_cast<NodeT *>(::operator new(sizeof(NodeT))); }
+    void deallocate(NodeT *t_node_ptr) { ::operator delete(t_node_ptr); }
+
+    template <class... Args>
+    NodeT *create(Args &&...t_args) { return new NodeT(forward<Args>(t_args)...); }
+    void destroy(NodeT *t_node_ptr) { delete t_node_ptr; }
+
+    void release() {}
+    void share(const HeapNodeAllocator &) {}
+    void adopt(HeapNodeAllocator &) {}
+    bool holds_foreign_nodes() const { return false; }
+};
+
+#endif
@@ -0,0 +1,142 @@
+/// Header file for the helpers behind the parallel tree builds
+#ifndef PARALLEL_BUILD
+#define PARALLEL_BUILD
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/// @brief Resolves a requested thread count; 0 means one per hardware thread.
+/// @param t_threads Requested number of threads.
+/// @return Number of threads to use, at least 1.
+inline size_t resolve_thread_count(size_t t_threads)
+{
+    if (t_threads == 0)
+        t_threads = thread::hardware_concurrency();
+    return max<size_t>(t_threads, 1);
+}
+
+/// @brief Runs t_task(i) for every i in [0, t_tasks) on up to t_threads
+/// threads. Threads take the next task index from a shared counter as soon
+/// as they finish one, so uneven tasks balance out. If tasks throw, no
+/// new tasks are started, every thread is joined and the first exception
+/// is rethrown on the calling thread. A thread that cannot be started
+/// leaves its share to the others.
+/// @param t_tasks Number of tasks.
+/// @param t_threads Number of threads, including the calling one.
+/// @param t_task Callable taking the task index.
+template <class Task>
+void parallel_for(size_t t_tasks, size_t t_threads, Task t_task)
+{
+    atomic<size_t> next{0};
+    mutex error_lock;
+    exception_ptr error;
+    auto worker = [&]()
+    {
+        try
+        {
+            for (size_t i = next++; i < t_tasks; i = next++)
+                t_task(i);
+        }
+        catch (...)
+        {
+            next = t_tasks; // Start no more tasks
+            lock_guard<mutex> lock(error_lock);
+            if (!error)
+                error = current_exception();
+        }
+    };
+
+    vector<thread> workers;
+    workers.reserve(min(t_threads, t_tasks));
+    try
+    {
+        for (size_t i = 1; i < min(t_threads, t_tasks); i++)
+            workers.emplace_back(worker);
+    }
+    catch (const system_error &)
+    {
+    }
+    worker();
+    for (thread &w : workers)
+        w.join();
+    if (error)
+        rethrow_exception(error);
+}
+
+/// @brief Sorts a range into buckets with a parallel sample sort. Splitters
+/// drawn from a sample divide the key range into more buckets than threads;
+/// chunks of the input are classified concurrently, then every bucket is
+/// gathered and sorted on its own.
+/// @param t_first Iterator to the first value.
+/// @param t_last Iterator one past the last value.
+/// @param t_compare Ordering of the values.
+/// @param t_threads Number of threads.
+/// @return Sorted buckets in ascending order; equal values share a bucket.
+template <class T, class RandomIt, class Compare>
+vector<vector<T>> parallel_sorted_buckets(RandomIt t_first, RandomIt t_last, const Compare &t_compare, size_t t_threads)
+{
+    constexpr size_t min_parallel_size = 1 << 14;
+    constexpr size_t oversampling = 32;
+
+    size_t n = t_last - t_first;
+    if (t_threads <= 1 || n < min_parallel_size)
+    {
+        vector<vector<T>> single(1, vector<T>(t_first, t_last));
+        sort(single[0].begin(), single[0].end(), t_compare);
+        return single;
+    }
+
+    // Evenly spaced sample; splitter i bounds bucket i from above
+    size_t bucket_count = t_threads * 4;
+    vector<T> sample;
+    size_t sample_size = bucket_count * oversampling;
+    for (size_t i = 0; i < sample_size; i++)
+        sample.push_back(t_first[i * n / sample_size]);
+    sort(sample.begin(), sample.end(), t_compare);
+    vector<T> splitters;
+    for (size_t i = 1; i < bucket_count; i++)
+        splitters.push_back(sample[i * oversampling]);
+
+    // Classify chunks of the input; values equal to a splitter all go to
+    // the bucket after it, so runs of equal values never straddle buckets
+    size_t chunk_count = bucket_count;
+    vector<vector<vector<T>>> pieces(chunk_count, vector<vector<T>>(bucket_count));
+    parallel_for(chunk_count, t_threads, [&](size_t chunk)
+                 {
+        RandomIt it = t_first + chunk * n / chunk_count;
+        RandomIt end = t_first + (chunk + 1) * n / chunk_count;
+        for (; it != end; ++it)
+        {
+            size_t bucket = upper_bound(splitters.begin(), splitters.end(), *it, t_compare) - splitters.begin();
+            pieces[chunk][bucket].push_back(*it);
+        } });
+
+    vector<vector<T>> buckets(bucket_count);
+    parallel_for(bucket_count, t_threads, [&](size_t bucket)
+                 {
+        size_t total = 0;
+        for (size_t chunk = 0; chunk < chunk_count; chunk++)
+            total += pieces[chunk][bucket].size();
+        buckets[bucket].reserve(total);
+        for (size_t chunk = 0; chunk < chunk_count; chunk++)
+        {
+            vector<T> &piece = pieces[chunk][bucket];
+            move(piece.begin(), piece.end(), back_inserter(buckets[bucket]));
+            vector<T>().swap(piece);
+        }
+        sort(buckets[bucket].begin(), buckets[bucket].end(), t_compare); });
+
+    return buckets;
+}
+
+#endif
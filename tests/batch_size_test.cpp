@@ -0,0 +1,64 @@
+// Regression test: contains_batch and count_batch wrote one result per
+// key without checking the length of the result span, so a short span
+// was an out-of-bounds write. Both trees now throw invalid_argument when
+// the lengths differ and leave the span untouched.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O1 -g -fsanitize=address tests/batch_size_test.cpp -o batch_size_test
+//   ./batch_size_test
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../avlt.hpp"
+#include "../bst.hpp"
+
+using namespace std;
+
+template <class Tree>
+bool check_tree(const string &t_name)
+{
+	Tree tree;
+	for (int i = 0; i < 100; i++)
+		tree.insert(i);
+	vector<int> keys(100);
+	for (int i = 0; i < 100; i++)
+		keys[i] = i;
+
+	bool ok = true;
+	bool found[10] = {};
+	vector<size_t> counts(10, 7);
+	try
+	{
+		tree.contains_batch(span<const int>(keys), span<bool>(found));
+		ok = false;
+	}
+	catch (const invalid_argument &)
+	{
+	}
+	try
+	{
+		tree.count_batch(span<const int>(keys), span<size_t>(counts));
+		ok = false;
+	}
+	catch (const invalid_argument &)
+	{
+	}
+	ok = ok && counts[0] == 7;
+
+	// Matching lengths still work
+	vector<size_t> all(keys.size());
+	tree.count_batch(span<const int>(keys), span<size_t>(all));
+	for (size_t count : all)
+		ok = ok && count == 1;
+	cout << t_name << ": " << (ok ? "PASS" : "FAIL") << '\n';
+	return ok;
+}
+
+int main()
+{
+	bool ok = check_tree<AVLTree<int>>("AVLTree");
+	ok = check_tree<BinarySearchTree<int>>("BinarySearchTree") && ok;
+	return ok ? 0 : 1;
+}
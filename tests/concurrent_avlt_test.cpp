@@ -0,0 +1,100 @@
+// Stress test for ConcurrentAVLTree. Reader threads check through
+// snapshots that keys which are never removed stay visible, while a
+// writer keeps inserting and removing other keys. Nodes the writer
+// replaces are freed under the readers' feet by epoch reclamation, so
+// the test is meant to be built with a sanitizer as well.
+//
+// A single thread also holds more snapshots than one block of reader
+// slots, which used to make the next snapshot spin forever.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O1 -g -fsanitize=thread tests/concurrent_avlt_test.cpp -o concurrent_avlt_test
+//   g++ -std=c++20 -O1 -g -fsanitize=address,undefined tests/concurrent_avlt_test.cpp -o concurrent_avlt_test
+//   ./concurrent_avlt_test
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../concurrent_avlt.hpp"
+
+using namespace std;
+
+// Even keys below this are inserted up front and never removed
+static constexpr int stable_keys = 2000;
+
+// Readers check the stable keys and the consistency of each snapshot
+// until the writer is done
+static bool stress(size_t t_readers, size_t t_writes)
+{
+	ConcurrentAVLTree<int> tree;
+	for (int key = 0; key < stable_keys; key += 2)
+		tree.insert(key);
+
+	atomic<bool> done{false};
+	atomic<size_t> failures{0};
+	vector<thread> readers;
+	for (size_t r = 0; r < t_readers; r++)
+		readers.emplace_back([&, r]()
+							 {
+			mt19937 rng((unsigned)r);
+			while (!done.load())
+			{
+				auto snapshot = tree.snapshot();
+				for (int i = 0; i < 64; i++)
+				{
+					int key = (int)(rng() % (stable_keys / 2)) * 2;
+					if (!snapshot.search_value(key) || snapshot.count(key) != 1)
+						failures++;
+				}
+				if (snapshot.size() < stable_keys / 2)
+					failures++;
+			} });
+
+	// The writer only touches odd keys and keys past the stable range
+	mt19937 rng(7);
+	for (size_t i = 0; i < t_writes; i++)
+	{
+		int key = (int)(rng() % (2 * stable_keys));
+		if (key % 2 == 0)
+			key += stable_keys;
+		if (rng() % 2)
+			tree.insert(key);
+		else
+			tree.remove(key);
+	}
+	done.store(true);
+	for (thread &reader : readers)
+		reader.join();
+
+	for (int key = 0; key < stable_keys; key += 2)
+		if (!tree.search_value(key))
+			failures++;
+	return failures.load() == 0;
+}
+
+// More live snapshots in one thread than a block of reader slots holds
+static bool many_snapshots()
+{
+	ConcurrentAVLTree<int> tree;
+	tree.insert(1);
+	vector<unique_ptr<ConcurrentAVLTree<int>::Snapshot>> held;
+	for (int i = 0; i < 300; i++)
+		held.push_back(make_unique<ConcurrentAVLTree<int>::Snapshot>(tree));
+	tree.insert(2);
+	bool ok = tree.search_value(2) && held.back()->search_value(1) && !held.back()->search_value(2);
+	held.clear();
+	tree.remove(1);
+	return ok && !tree.search_value(1);
+}
+
+int main()
+{
+	size_t readers = max<size_t>(2, thread::hardware_concurrency() - 1);
+	bool ok = stress(readers, 200000);
+	cout << "readers against one writer: " << (ok ? "PASS" : "FAIL") << '\n';
+	bool nested = many_snapshots();
+	cout << "snapshots beyond one slot block: " << (nested ? "PASS" : "FAIL") << '\n';
+	return ok && nested ? 0 : 1;
+}
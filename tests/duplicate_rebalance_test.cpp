@@ -0,0 +1,57 @@
+// Regression test: a BinarySearchTree kept every copy of a value in the
+// left subtree of the others, so k copies always formed a chain of depth
+// k - 1. Rebalancing could not make such a tree shallower and with
+// set_auto_rebalance every insert of a duplicate rebuilt a subtree,
+// which made duplicate-heavy workloads quadratic.
+//
+// Copies may now sit on either side of each other. The test inserts
+// 40000 values over 4 keys with auto-rebalancing on and checks that the
+// height stays within the scapegoat bound, that an explicit rebalance
+// gives a complete tree and that count_batch still finds every copy.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O2 tests/duplicate_rebalance_test.cpp -o duplicate_rebalance_test
+//   ./duplicate_rebalance_test
+#include <cmath>
+#include <iostream>
+#include <span>
+#include <vector>
+#include "../bst.hpp"
+
+using namespace std;
+
+// Checks the copies of every key and of one absent key
+static bool check_counts(const BinarySearchTree<int> &t_tree, size_t t_copies)
+{
+	vector<int> keys{0, 1, 2, 3, 4};
+	vector<size_t> counts(keys.size());
+	t_tree.count_batch(span<const int>(keys), span<size_t>(counts));
+	for (size_t i = 0; i < keys.size(); i++)
+		if (counts[i] != (keys[i] < 4 ? t_copies : 0))
+			return false;
+	return true;
+}
+
+int main()
+{
+	const double alpha = 0.75;
+	const size_t inserts = 40000;
+	BinarySearchTree<int> tree;
+	tree.set_auto_rebalance(alpha);
+	for (size_t i = 0; i < inserts; i++)
+		tree.insert((int)(i % 4));
+
+	bool ok = (double)tree.height() <= log2((double)inserts) / -log2(alpha) + 1;
+	ok = ok && check_counts(tree, inserts / 4);
+	cout << "auto-rebalanced duplicates: " << (ok ? "PASS" : "FAIL") << '\n';
+
+	tree.rebalance();
+	bool balanced = tree.height() == (size_t)log2((double)inserts) && check_counts(tree, inserts / 4);
+	cout << "rebalanced duplicates: " << (balanced ? "PASS" : "FAIL") << '\n';
+
+	for (size_t i = 0; i < inserts / 2; i++)
+		tree.remove((int)(i % 4));
+	bool removed = tree.size() == inserts / 2 && check_counts(tree, inserts / 8);
+	cout << "removed duplicates: " << (removed ? "PASS" : "FAIL") << '\n';
+	return ok && balanced && removed ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+// Regression test: trees of const char * keys order them by pointer under
+// less<>, so the cached string prefixes of key_prefix.hpp must stay off
+// for them. With the prefixes on, inserts and lookups compared the
+// characters while rank, lower_bound and count_range compared addresses.
+//
+// The keys are stored in an array in reverse alphabetical order, so
+// pointer order and string order disagree. Every query is checked
+// against the position of the key in iteration order.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O2 tests/pointer_key_test.cpp -o pointer_key_test
+//   ./pointer_key_test
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../avlt.hpp"
+#include "../bst.hpp"
+
+using namespace std;
+
+static const char keys[][3] = {"zz", "mm", "bb", "aa"};
+
+// Checks the ordered queries of one tree against its iteration order
+template <class Tree>
+bool check_tree(const string &t_name)
+{
+	Tree tree;
+	for (const char *key : keys)
+		tree.insert(key);
+
+	vector<const char *> order(tree.begin(), tree.end());
+	bool ok = order.size() == 4;
+	for (size_t i = 0; ok && i < order.size(); i++)
+	{
+		const char *key = order[i];
+		ok = ok && tree.contains(key) && tree.rank(key) == i && *tree.lower_bound(key) == key;
+		ok = ok && tree.count_range(order[0], key) == i + 1;
+	}
+	cout << t_name << ": " << (ok ? "PASS" : "FAIL") << '\n';
+	return ok;
+}
+
+int main()
+{
+	bool ok = check_tree<AVLTree<const char *>>("AVLTree<const char *>");
+	ok = check_tree<BinarySearchTree<const char *>>("BinarySearchTree<const char *>") && ok;
+	return ok ? 0 : 1;
+}
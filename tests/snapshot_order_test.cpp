@@ -0,0 +1,87 @@
+// Regression test: loading a snapshot only checked the bytes and the
+// shape, so a snapshot written under another Compare, or one holding an
+// AVL tree far out of balance, loaded into a tree whose lookups then
+// silently missed keys.
+//
+// Loads an AVLTree<int, greater<>> and a BinarySearchTree<int, greater<>>
+// snapshot into trees ordered by less<>, and an AVL snapshot of a chain
+// whose balance factors match its shape. Every load has to throw
+// runtime_error and leave the tree empty, while a snapshot of the
+// matching order still loads.
+//
+// Build and run from the repository root:
+//   g++ -std=c++20 -O2 tests/snapshot_order_test.cpp -o snapshot_order_test
+//   ./snapshot_order_test
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include "../avlt.hpp"
+#include "../bst.hpp"
+
+using namespace std;
+
+// Node of a hand-built tree handed to write_snapshot
+struct ChainNode
+{
+	int data;
+	ChainNode *left;
+	ChainNode *right;
+	long balance_factor;
+};
+
+template <class Tree>
+bool rejects(const string &t_name, const string &t_bytes)
+{
+	Tree tree;
+	tree.insert(42);
+	bool thrown = false;
+	try
+	{
+		tree.load_snapshot(t_bytes);
+	}
+	catch (const runtime_error &)
+	{
+		thrown = true;
+	}
+	bool ok = thrown && tree.size() == 0;
+	cout << t_name << ": " << (ok ? "PASS" : "FAIL") << '\n';
+	return ok;
+}
+
+// Snapshot bytes of a tree of the given type holding 0 to 99
+template <class Tree>
+string snapshot_of()
+{
+	Tree tree;
+	for (int i = 0; i < 100; i++)
+		tree.insert(i);
+	string path = "snapshot_order_test.snap";
+	tree.save(path);
+	ifstream in(path, ios::binary);
+	string bytes(istreambuf_iterator<char>(in), {});
+	remove(path.c_str());
+	return bytes;
+}
+
+int main()
+{
+	bool ok = rejects<AVLTree<int>>("AVLTree reversed order", snapshot_of<AVLTree<int, greater<>>>());
+	ok = rejects<BinarySearchTree<int>>("BinarySearchTree reversed order", snapshot_of<BinarySearchTree<int, greater<>>>()) && ok;
+
+	// A right chain of three ordered keys, with the balance factors its
+	// shape really has
+	ChainNode c{3, nullptr, nullptr, 0}, b{2, nullptr, &c, -1}, a{1, nullptr, &b, -2};
+	stringstream chain;
+	write_snapshot<int>(&a, 3, SnapshotKind::avl, chain);
+	ok = rejects<AVLTree<int>>("AVLTree unbalanced chain", chain.str()) && ok;
+
+	AVLTree<int> same;
+	same.load_snapshot(snapshot_of<AVLTree<int>>());
+	bool loads = same.size() == 100 && same.contains(0) && same.contains(99);
+	cout << "AVLTree matching order: " << (loads ? "PASS" : "FAIL") << '\n';
+	return ok && loads ? 0 : 1;
+}
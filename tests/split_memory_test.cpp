@@ -0,0 +1,61 @@
+// Regression test: nodes that AVLTree::split moves into another tree go
+// back to the pool of the tree they came from once that tree is cleared,
+// so repeated split and discard keeps the heap flat.
+//
+// A tree is kept at 10000 values. Each round splits off the upper half
+// into a temporary tree, destroys it and inserts the values again. The
+// heap in use after the last round must stay within twice that after
+// the first round; before the fix it grew about sixtyfold.
+//
+// Build and run from the repository root (glibc only):
+//   g++ -std=c++20 -O2 tests/split_memory_test.cpp -o split_memory_test
+//   ./split_memory_test
+#include <iostream>
+#include <malloc.h>
+#include "../avlt.hpp"
+
+using namespace std;
+
+// Bytes in use from the heap, mmap-ed chunks of the large blocks included
+static size_t heap_in_use()
+{
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+int main()
+{
+	const int value_count = 10000;
+	const int rounds = 200;
+	AVLTree<int> tree;
+	for (int i = 0; i < value_count; i++)
+		tree.insert(i);
+
+	size_t first_round = 0;
+	for (int round = 0; round < rounds; round++)
+	{
+		{
+			AVLTree<int> greater;
+			tree.split(value_count / 2, greater);
+			if (greater.size() != (size_t)value_count / 2)
+			{
+				cerr << "split moved " << greater.size() << " values\n";
+				return 1;
+			}
+		}
+		for (int i = value_count / 2; i < value_count; i++)
+			tree.insert(i);
+		if (round == 0)
+			first_round = heap_in_use();
+	}
+
+	size_t last_round = heap_in_use();
+	cout << "heap in use after round 1: " << first_round << " bytes, after round " << rounds << ": " << last_round << " bytes\n";
+	if (tree.size() != (size_t)value_count || last_round > 2 * first_round)
+	{
+		cerr << "FAIL: heap grew with repeated split and discard\n";
+		return 1;
+	}
+	cout << "PASS\n";
+	return 0;
+}
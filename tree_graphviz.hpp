@@ -0,0 +1,153 @@
+/// Header file for the GraphViz export shared by the tree classes
+#ifndef TREE_GRAPHVIZ
+#define TREE_GRAPHVIZ
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "tree_sink.hpp"
+
+using namespace std;
+
+/// @brief Limits that keep the DOT output of large trees small.
+struct GraphVizOptions
+{
+    size_t max_depth{SIZE_MAX}; // Deepest level drawn; deeper subtrees become one summary box
+    double sample_rate{1.0};    // Fraction of the subtrees kept from sample_depth on, clamped to [0, 1]
+    size_t sample_depth{0};     // Level from which subtrees are sampled
+    size_t collapse_chains{0};  // Runs of single-child nodes longer than this become one box; 0 keeps them
+    uint64_t seed{0};           // Seed of the subtree sampling
+};
+
+/// @brief Writes a DOT graph of a tree in one iterative pre-order pass.
+/// Nodes get numeric IDs in visiting order, so labels can hold any text
+/// and duplicates stay distinct. Subtrees cut off by max_depth or by
+/// sampling, and collapsed chains, are drawn as dashed boxes labelled with
+/// the number of values they hide. Levels are counted as drawn, so a
+/// collapsed chain counts as one.
+/// @tparam NodeT Node type exposing left, right and subtree_size.
+/// @param t_root Pointer to root of the tree.
+/// @param t_out Destination stream.
+/// @param t_options Depth, sampling and chain limits.
+/// @param t_label Callable taking (BufferedSink &, const NodeT &) that
+/// writes the escaped label text of a node.
+template <class NodeT, class Label>
+void write_graph_viz(const NodeT *t_root, ostream &t_out, const GraphVizOptions &t_options, Label t_label)
+{
+    struct Frame
+    {
+        const NodeT *node;
+        uint64_t parent_id; // 0 for the root, which has no parent
+        size_t depth;
+    };
+
+    BufferedSink sink(t_out);
+    uint64_t next_id = 1;
+    // Rates outside [0, 1] are clamped first, NaN to 0, since converting
+    // an out of range double to an integer is undefined
+    double sample_rate = t_options.sample_rate;
+    uint64_t sample_threshold = !(sample_rate > 0.0) ? 0 : sample_rate >= 1.0 ? UINT64_MAX : (uint64_t)(sample_rate * 18446744073709551616.0);
+
+    auto edge = [&](uint64_t t_from, uint64_t t_to)
+    {
+        if (!t_from)
+            return;
+        sink.write("  n");
+        sink.write_integer(t_from);
+        sink.write(" -> n");
+        sink.write_integer(t_to);
+        sink.write(";\n");
+    };
+    auto summary = [&](uint64_t t_parent, size_t t_hidden, const char *t_what)
+    {
+        uint64_t id = next_id++;
+        sink.write("  n");
+        sink.write_integer(id);
+        sink.write(" [label=\"");
+        sink.write_integer(t_hidden);
+        sink.write(t_what);
+        sink.write("\", shape=box, style=dashed];\n");
+        edge(t_parent, id);
+        return id;
+    };
+    // Deterministic per-node coin flip (splitmix64 of the next ID)
+    auto sampled_out = [&]()
+    {
+        uint64_t x = next_id + t_options.seed + 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x >= sample_threshold;
+    };
+
+    sink.write("digraph g { \n");
+    vector<Frame> stack;
+    if (t_root)
+        stack.push_back({t_root, 0, 0});
+    while (!stack.empty())
+    {
+        Frame frame = stack.back();
+        stack.pop_back();
+        const NodeT *node = frame.node;
+
+        if (frame.depth > t_options.max_depth)
+        {
+            summary(frame.parent_id, node->subtree_size, " more");
+            continue;
+        }
+        if (frame.parent_id && frame.depth >= t_options.sample_depth && sampled_out())
+        {
+            summary(frame.parent_id, node->subtree_size, " sampled out");
+            continue;
+        }
+
+        // A run of nodes with exactly one child collapses into one box
+        // that links straight to the node ending the run
+        if (t_options.collapse_chains && node->left != node->right && (!node->left || !node->right))
+        {
+            const NodeT *end = node;
+            size_t run = 0;
+            while (end->left != end->right && (!end->left || !end->right))
+            {
+                end = end->left ? end->left : end->right;
+                run++;
+            }
+            if (run > t_options.collapse_chains)
+            {
+                uint64_t box = summary(frame.parent_id, run, " chained nodes");
+                stack.push_back({end, box, frame.depth + 1});
+                continue;
+            }
+        }
+
+        uint64_t id = next_id++;
+        sink.write("  n");
+        sink.write_integer(id);
+        sink.write(" [label=\"");
+        t_label(sink, *node);
+        sink.write("\"];\n");
+        edge(frame.parent_id, id);
+
+        if (node->right)
+            stack.push_back({node->right, id, frame.depth + 1});
+        if (node->left)
+            stack.push_back({node->left, id, frame.depth + 1});
+    }
+    sink.write("} \n");
+}
+
+/// @brief Writes the DOT graph of a tree to a file; see write_graph_viz.
+/// @param t_file_path Path of the file, overwritten if it exists.
+/// @param t_root Pointer to root of the tree.
+/// @param t_options Depth, sampling and chain limits.
+/// @param t_label Label writer, as for write_graph_viz.
+template <class NodeT, class Label>
+void write_graph_viz_file(const string &t_file_path, const NodeT *t_root, const GraphVizOptions &t_options, Label t_label)
+{
+    ofstream out(t_file_path, ios::binary);
+    write_graph_viz(t_root, out, t_options, t_label);
+}
+
+#endif
@@ -0,0 +1,122 @@
+/// Header file for the in-order iterator shared by the tree classes
+#ifndef TREE_ITERATOR
+#define TREE_ITERATOR
+#include <cstddef>
+#include <iterator>
+
+using namespace std;
+
+/// @brief Bidirectional in-order iterator over a binary tree whose nodes
+/// keep a parent pointer. Each step follows child and parent links only,
+/// so it allocates nothing and costs O(1) amortized. The end iterator is
+/// the null node; decrementing it moves to the last node, which is found
+/// through the tree's root.
+/// @tparam NodeT Node type exposing data, left, right and parent.
+/// @tparam T Type of the values stored in the nodes.
+template <class NodeT, class T>
+class TreeIterator
+{
+private:
+    const NodeT *m_node{nullptr};        // Current node, nullptr at the end
+    const NodeT *const *m_root{nullptr}; // Root pointer of the tree, for --end()
+
+    static const NodeT *leftmost(const NodeT *t_node_ptr)
+    {
+        while (t_node_ptr->left)
+            t_node_ptr = t_node_ptr->left;
+        return t_node_ptr;
+    }
+
+    static const NodeT *rightmost(const NodeT *t_node_ptr)
+    {
+        while (t_node_ptr->right)
+            t_node_ptr = t_node_ptr->right;
+        return t_node_ptr;
+    }
+
+public:
+    using iterator_category = bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    TreeIterator() {}
+
+    /// @brief Creates an iterator to a node of a tree.
+    /// @param t_node_ptr Node to point at; nullptr for the end.
+    /// @param t_root Address of the root pointer of the tree.
+    TreeIterator(const NodeT *t_node_ptr, const NodeT *const *t_root) : m_node(t_node_ptr), m_root(t_root) {}
+
+    /// @brief Iterator to the smallest value of a tree.
+    /// @param t_root Address of the root pointer of the tree.
+    static TreeIterator first(const NodeT *const *t_root) { return TreeIterator(*t_root ? leftmost(*t_root) : nullptr, t_root); }
+
+    reference operator*() const { return m_node->data; }
+    pointer operator->() const { return &m_node->data; }
+
+    /// @brief Number of occurrences of the current value; always 1 for
+    /// trees that store duplicates as separate nodes.
+    size_t count() const
+    {
+        if constexpr (requires { m_node->count; })
+            return m_node->count;
+        else
+            return 1;
+    }
+
+    TreeIterator &operator++()
+    {
+        if (m_node->right)
+            m_node = leftmost(m_node->right);
+        else
+        {
+            const NodeT *child = m_node;
+            m_node = m_node->parent;
+            while (m_node && child == m_node->right)
+            {
+                child = m_node;
+                m_node = m_node->parent;
+            }
+        }
+        return *this;
+    }
+
+    TreeIterator &operator--()
+    {
+        if (!m_node)
+            m_node = rightmost(*m_root);
+        else if (m_node->left)
+            m_node = rightmost(m_node->left);
+        else
+        {
+            const NodeT *child = m_node;
+            m_node = m_node->parent;
+            while (m_node && child == m_node->left)
+            {
+                child = m_node;
+                m_node = m_node->parent;
+            }
+        }
+        return *this;
+    }
+
+    TreeIterator operator++(int)
+    {
+        TreeIterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    TreeIterator operator--(int)
+    {
+        TreeIterator old = *this;
+        --*this;
+        return old;
+    }
+
+    bool operator==(const TreeIterator &t_other) const { return m_node == t_other.m_node; }
+    bool operator!=(const TreeIterator &t_other) const { return m_node != t_other.m_node; }
+};
+
+#endif
@@ -0,0 +1,118 @@
+/// Header file for the link primitives shared by the tree classes
+#ifndef TREE_LINKS
+#define TREE_LINKS
+
+using namespace std;
+
+// These functions only move pointers: child links and parent pointers. A
+// tree refreshes whatever it caches in its nodes (sizes, heights, balance
+// data) around them, since that is the part where the trees differ.
+
+/// @brief The link pointing at a node: a child pointer of its parent, or
+/// the root pointer of the tree.
+/// @tparam NodeT Node type exposing left, right and parent pointers.
+/// @param t_node_ptr Pointer to node.
+/// @param t_root Root pointer of the tree holding the node.
+/// @return Reference to the link.
+template <class NodeT>
+NodeT *&parent_link(NodeT *t_node_ptr, NodeT *&t_root)
+{
+    NodeT *parent = t_node_ptr->parent;
+    return parent ? (parent->left == t_node_ptr ? parent->left : parent->right) : t_root;
+}
+
+/// @brief Finds the leftmost node of a subtree, the in-order successor of
+/// its parent when the subtree is a right subtree.
+/// @param t_node_ptr Pointer to root of subtree, not nullptr.
+/// @return Pointer to the leftmost node.
+template <class NodeT>
+NodeT *leftmost(NodeT *t_node_ptr)
+{
+    while (t_node_ptr->left)
+        t_node_ptr = t_node_ptr->left;
+    return t_node_ptr;
+}
+
+/// @brief Rotates the subtree behind a link left, promoting the right
+/// child, and fixes the parent pointers of the three nodes that move.
+/// @param t_link Link to the root of the subtree; set to the promoted node.
+/// @return The promoted node; the old root is now its left child.
+template <class NodeT>
+NodeT *rotate_link_left(NodeT *&t_link)
+{
+    NodeT *node = t_link;
+    NodeT *child = node->right;
+    node->right = child->left;
+    if (child->left)
+        child->left->parent = node;
+    child->left = node;
+    child->parent = node->parent;
+    node->parent = child;
+    t_link = child;
+    return child;
+}
+
+/// @brief Rotates the subtree behind a link right, promoting the left
+/// child, and fixes the parent pointers of the three nodes that move.
+/// @param t_link Link to the root of the subtree; set to the promoted node.
+/// @return The promoted node; the old root is now its right child.
+template <class NodeT>
+NodeT *rotate_link_right(NodeT *&t_link)
+{
+    NodeT *node = t_link;
+    NodeT *child = node->left;
+    node->left = child->right;
+    if (child->right)
+        child->right->parent = node;
+    child->right = node;
+    child->parent = node->parent;
+    node->parent = child;
+    t_link = child;
+    return child;
+}
+
+/// @brief Unlinks the node behind a link when it has at most one child;
+/// the child takes its place. The node itself is left untouched.
+/// @param t_link Link to the node.
+/// @return The child now in the node's place, nullptr if none.
+template <class NodeT>
+NodeT *splice_link(NodeT *&t_link)
+{
+    NodeT *node = t_link;
+    NodeT *child = node->left ? node->left : node->right;
+    if (child)
+        child->parent = node->parent;
+    t_link = child;
+    return child;
+}
+
+/// @brief Destroys every node of a subtree without recursion or an
+/// explicit stack: left children are rotated up until the leftmost
+/// remaining node is at the top, which is destroyed before moving on to
+/// its right subtree. Parent pointers are not maintained on the way.
+/// @param t_root Link to the root of the subtree; set to nullptr.
+/// @param t_destroy Callable taking a node pointer that frees the node.
+template <class NodeT, class Destroy>
+void destroy_links(NodeT *&t_root, Destroy t_destroy)
+{
+    NodeT *node = t_root;
+    while (node)
+    {
+        if (node->left)
+        {
+            NodeT *left = node->left;
+            node->left = left->right;
+            left->right = node;
+            node = left;
+        }
+        else
+        {
+            NodeT *right = node->right;
+            t_destroy(node);
+            node = right;
+        }
+    }
+    t_root = nullptr;
+}
+
+#endif
@@ -0,0 +1,167 @@
+/// Header file for tree shape analytics shared by the tree classes
+#ifndef TREE_SHAPE
+#define TREE_SHAPE
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+using namespace std;
+
+/// @brief Summary of the shape of a binary tree, gathered in a single pass.
+struct TreeShape
+{
+    size_t nodes{0};                     // Number of nodes in the tree
+    size_t height{0};                    // Height of the tree (leaf = 0)
+    size_t leaves{0};                    // Number of nodes without children
+    double average_height{0};            // Mean height over all nodes
+    double average_depth{0};             // Mean depth over all nodes (root = 0)
+    vector<size_t> level_counts;         // level_counts[d] = nodes at depth d
+    vector<size_t> leaf_depth_histogram; // leaf_depth_histogram[d] = leaves at depth d
+
+    /// @brief Serializes the report as a single JSON object.
+    /// @return JSON text.
+    string to_json() const;
+};
+
+/// @brief Computes the shape of the subtree rooted at a node with one
+/// iterative post-order pass, so it runs in O(n) time and never recurses.
+/// @tparam NodeT Node type exposing left and right child pointers.
+/// @param t_root Pointer to root of the subtree.
+/// @return Shape report of the subtree.
+template <class NodeT>
+TreeShape compute_shape(const NodeT *t_root)
+{
+    TreeShape shape;
+    if (!t_root)
+        return shape;
+
+    // Each frame remembers how far the visit of its node has progressed:
+    // 0 = not yet descended, 1 = left subtree done, 2 = both subtrees done.
+    struct Frame
+    {
+        const NodeT *node;
+        size_t depth;
+        long left_height;
+        int stage;
+    };
+
+    vector<Frame> stack;
+    stack.push_back({t_root, 0, -1, 0});
+    size_t total_height = 0;
+    size_t total_depth = 0;
+    long child_height = -1; // Height of the subtree most recently finished
+
+    while (!stack.empty())
+    {
+        Frame &frame = stack.back();
+        const NodeT *node = frame.node;
+
+        if (frame.stage == 0)
+        {
+            if (shape.level_counts.size() <= frame.depth)
+                shape.level_counts.resize(frame.depth + 1, 0);
+            shape.level_counts[frame.depth]++;
+            total_depth += frame.depth;
+
+            if (!node->left && !node->right)
+            {
+                if (shape.leaf_depth_histogram.size() <= frame.depth)
+                    shape.leaf_depth_histogram.resize(frame.depth + 1, 0);
+                shape.leaf_depth_histogram[frame.depth]++;
+                shape.leaves++;
+            }
+
+            frame.stage = 1;
+            if (node->left)
+            {
+                stack.push_back({node->left, frame.depth + 1, -1, 0});
+                continue;
+            }
+            child_height = -1;
+        }
+
+        if (frame.stage == 1)
+        {
+            frame.left_height = child_height;
+            frame.stage = 2;
+            if (node->right)
+            {
+                stack.push_back({node->right, frame.depth + 1, -1, 0});
+                continue;
+            }
+            child_height = -1;
+        }
+
+        long node_height = max(frame.left_height, child_height) + 1;
+        total_height += node_height;
+        shape.nodes++;
+        child_height = node_height;
+        stack.pop_back();
+    }
+
+    shape.height = child_height;
+    shape.average_height = (double)total_height / (double)shape.nodes;
+    shape.average_depth = (double)total_depth / (double)shape.nodes;
+    return shape;
+}
+
+/// @brief Computes the height of the subtree rooted at a node one level at
+/// a time, so even a degenerate chain is measured without recursion.
+/// Cheaper than compute_shape when only the height is needed.
+/// @tparam NodeT Node type exposing left and right child pointers.
+/// @param t_root Pointer to root of the subtree.
+/// @return Height of the subtree (leaf = 0, empty = 0).
+template <class NodeT>
+size_t subtree_height(const NodeT *t_root)
+{
+    if (!t_root)
+        return 0;
+
+    vector<const NodeT *> level{t_root};
+    vector<const NodeT *> next_level;
+    size_t levels = 0;
+    while (!level.empty())
+    {
+        levels += 1;
+        next_level.clear();
+        for (const NodeT *node : level)
+        {
+            if (node->left)
+                next_level.push_back(node->left);
+            if (node->right)
+                next_level.push_back(node->right);
+        }
+        level.swap(next_level);
+    }
+    return levels - 1;
+}
+
+inline string TreeShape::to_json() const
+{
+    auto append_array = [](string &out, const vector<size_t> &values)
+    {
+        out += '[';
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            if (i)
+                out += ',';
+            out += to_string(values[i]);
+        }
+        out += ']';
+    };
+
+    string out = "{\"nodes\":" + to_string(nodes) +
+                 ",\"height\":" + to_string(height) +
+                 ",\"leaves\":" + to_string(leaves) +
+                 ",\"average_height\":" + to_string(average_height) +
+                 ",\"average_depth\":" + to_string(average_depth) +
+                 ",\"level_counts\":";
+    append_array(out, level_counts);
+    out += ",\"leaf_depth_histogram\":";
+    append_array(out, leaf_depth_histogram);
+    out += '}';
+    return out;
+}
+
+#endif
@@ -0,0 +1,270 @@
+/// Header file for the buffered output sink used by the tree dumps
+#ifndef TREE_SINK
+#define TREE_SINK
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+using namespace std;
+
+/// @brief Output formats of the tree dumps.
+/// text    the format of the print functions
+/// csv     one header line, then one row per node
+/// ndjson  one JSON object per node and line
+enum class DumpFormat
+{
+    text,
+    csv,
+    ndjson
+};
+
+/// @brief Collects output in a large block and hands it to the stream in
+/// one write() per block. Integers and floating point numbers are
+/// formatted with to_chars straight into the block; strings are copied.
+/// Other types fall back to their operator<<.
+class BufferedSink
+{
+private:
+    static constexpr size_t buffer_size = 1 << 18;
+
+    ostream &m_out;
+    unique_ptr<char[]> m_buffer{new char[buffer_size]};
+    size_t m_used{0};
+    ostringstream m_scratch; // Formats values without to_chars support
+
+    template <class V>
+    static constexpr bool is_character_v = is_same_v<V, char> || is_same_v<V, signed char> || is_same_v<V, unsigned char> ||
+                                           is_same_v<V, wchar_t> || is_same_v<V, char8_t> || is_same_v<V, char16_t> || is_same_v<V, char32_t>;
+
+    /// @brief Integral types that to_chars formats the way operator<< does.
+    template <class V>
+    static constexpr bool is_plain_integer_v = is_integral_v<V> && !is_same_v<V, bool> && !is_character_v<V>;
+
+    /// @brief Makes room for t_bytes more bytes, flushing if needed.
+    /// @return Pointer to where they go, or nullptr if they exceed the block.
+    char *reserve(size_t t_bytes)
+    {
+        if (m_used + t_bytes > buffer_size)
+            flush();
+        return t_bytes <= buffer_size ? m_buffer.get() + m_used : nullptr;
+    }
+
+    /// @brief Formats a value the way operator<< does.
+    template <class V>
+    string_view stream_format(const V &t_value)
+    {
+        m_scratch.str(string());
+        m_scratch << t_value;
+        return m_scratch.view();
+    }
+
+    /// @brief Writes text with CSV quoting when it contains a separator,
+    /// quote or line break.
+    void write_csv_field(string_view t_text);
+
+    /// @brief Writes text as a JSON string literal.
+    void write_json_string(string_view t_text);
+
+    /// @brief Writes text for use inside a quoted GraphViz string.
+    void write_dot_string(string_view t_text);
+
+public:
+    /// @brief Creates a sink writing into a stream.
+    /// @param t_out Destination stream; written in blocks.
+    explicit BufferedSink(ostream &t_out) : m_out(t_out) {}
+
+    /// @brief Flushes what is left.
+    ~BufferedSink() { flush(); }
+
+    BufferedSink(const BufferedSink &) = delete;
+    BufferedSink &operator=(const BufferedSink &) = delete;
+
+    /// @brief Hands the collected block to the stream.
+    void flush()
+    {
+        if (m_used)
+            m_out.write(m_buffer.get(), m_used);
+        m_used = 0;
+    }
+
+    void put(char t_char)
+    {
+        reserve(1)[0] = t_char;
+        m_used++;
+    }
+
+    void write(string_view t_text)
+    {
+        if (char *out = reserve(t_text.size()))
+        {
+            memcpy(out, t_text.data(), t_text.size());
+            m_used += t_text.size();
+        }
+        else
+            m_out.write(t_text.data(), t_text.size());
+    }
+
+    /// @brief Writes an integer with to_chars.
+    template <class I>
+    void write_integer(I t_value)
+    {
+        char *out = reserve(24);
+        m_used = to_chars(out, out + 24, t_value).ptr - m_buffer.get();
+    }
+
+    /// @brief Writes a value as the print functions would: through
+    /// to_chars for integers, copied for strings, with operator<< otherwise.
+    template <class V>
+    void write_text(const V &t_value)
+    {
+        if constexpr (is_plain_integer_v<V>)
+            write_integer(t_value);
+        else if constexpr (is_convertible_v<const V &, string_view>)
+            write(string_view(t_value));
+        else
+            write(stream_format(t_value));
+    }
+
+    /// @brief Writes a value as one field of a CSV row.
+    template <class V>
+    void write_csv(const V &t_value)
+    {
+        if constexpr (is_plain_integer_v<V>)
+            write_integer(t_value);
+        else if constexpr (is_floating_point_v<V>)
+        {
+            char *out = reserve(32);
+            m_used = to_chars(out, out + 32, t_value).ptr - m_buffer.get();
+        }
+        else if constexpr (is_convertible_v<const V &, string_view>)
+            write_csv_field(string_view(t_value));
+        else
+            write_csv_field(stream_format(t_value));
+    }
+
+    /// @brief Writes a value as a JSON number or string.
+    template <class V>
+    void write_json(const V &t_value)
+    {
+        if constexpr (is_plain_integer_v<V>)
+            write_integer(t_value);
+        else if constexpr (is_same_v<V, bool>)
+            write(t_value ? "true" : "false");
+        else if constexpr (is_floating_point_v<V>)
+        {
+            if (t_value != t_value || t_value - t_value != 0) // NaN or infinite
+                write("null");
+            else
+            {
+                char *out = reserve(32);
+                m_used = to_chars(out, out + 32, t_value).ptr - m_buffer.get();
+            }
+        }
+        else if constexpr (is_convertible_v<const V &, string_view>)
+            write_json_string(string_view(t_value));
+        else
+            write_json_string(stream_format(t_value));
+    }
+
+    /// @brief Writes a value for use inside a quoted GraphViz label; quotes,
+    /// backslashes and line breaks are escaped.
+    template <class V>
+    void write_dot(const V &t_value)
+    {
+        if constexpr (is_plain_integer_v<V>)
+            write_integer(t_value);
+        else if constexpr (is_convertible_v<const V &, string_view>)
+            write_dot_string(string_view(t_value));
+        else
+            write_dot_string(stream_format(t_value));
+    }
+};
+
+inline void BufferedSink::write_csv_field(string_view t_text)
+{
+    if (t_text.find_first_of(",\"\r\n") == string_view::npos)
+    {
+        write(t_text);
+        return;
+    }
+    put('"');
+    for (size_t start = 0;;)
+    {
+        size_t quote = t_text.find('"', start);
+        write(t_text.substr(start, quote == string_view::npos ? string_view::npos : quote + 1 - start));
+        if (quote == string_view::npos)
+            break;
+        put('"'); // Quotes are doubled
+        start = quote + 1;
+    }
+    put('"');
+}
+
+inline void BufferedSink::write_json_string(string_view t_text)
+{
+    static const char hex[] = "0123456789abcdef";
+    put('"');
+    size_t run = 0; // Start of the pending run of characters needing no escape
+    for (size_t i = 0; i < t_text.size(); i++)
+    {
+        unsigned char c = t_text[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        write(t_text.substr(run, i - run));
+        run = i + 1;
+        put('\\');
+        switch (c)
+        {
+        case '"':
+            put('"');
+            break;
+        case '\\':
+            put('\\');
+            break;
+        case '\n':
+            put('n');
+            break;
+        case '\r':
+            put('r');
+            break;
+        case '\t':
+            put('t');
+            break;
+        default:
+            write("u00");
+            put(hex[c >> 4]);
+            put(hex[c & 15]);
+        }
+    }
+    write(t_text.substr(run));
+    put('"');
+}
+
+inline void BufferedSink::write_dot_string(string_view t_text)
+{
+    size_t run = 0;
+    for (size_t i = 0; i < t_text.size(); i++)
+    {
+        char c = t_text[i];
+        if (c != '"' && c != '\\' && c != '\n' && c != '\r')
+            continue;
+        write(t_text.substr(run, i - run));
+        run = i + 1;
+        if (c == '\n')
+            write("\\n");
+        else if (c != '\r')
+        {
+            put('\\');
+            put(c);
+        }
+    }
+    write(t_text.substr(run));
+}
+
+#endif
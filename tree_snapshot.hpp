@@ -0,0 +1,371 @@
+/// Header file for the binary snapshot format shared by the tree classes
+#ifndef TREE_SNAPSHOT
+#define TREE_SNAPSHOT
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "tree_sink.hpp"
+#include "tree_traversal.hpp"
+
+using namespace std;
+
+// Layout of a snapshot file, all integers in native byte order:
+//   SnapshotHeader                 48 bytes
+//   SnapshotRecord[node_count]     24 bytes each, nodes in preorder
+//   key pool                       pool_bytes bytes of key data
+// A record says which children its node has, so the preorder sequence
+// alone fixes the shape of the tree. String keys are stored as their
+// characters, other keys as their object bytes; either way a record
+// points at its key with an offset and length into the pool. The
+// checksum covers everything after the header.
+
+/// @brief Kind of tree a snapshot was written from.
+enum class SnapshotKind : uint32_t
+{
+    avl = 1,
+    bst = 2
+};
+
+inline constexpr char snapshot_magic[8] = {'T', 'R', 'E', 'E', 'S', 'N', 'A', 'P'};
+inline constexpr uint32_t snapshot_version = 1;
+inline constexpr uint32_t snapshot_byte_order = 0x01020304; // Reads back swapped on another byte order
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;       // SnapshotKind
+    uint32_t key_size;   // sizeof the key for object keys, 0 for string keys
+    uint32_t byte_order; // snapshot_byte_order as written
+    uint64_t node_count;
+    uint64_t pool_bytes;
+    uint64_t checksum;
+};
+
+struct SnapshotRecord
+{
+    static constexpr uint8_t has_left = 1;
+    static constexpr uint8_t has_right = 2;
+
+    uint64_t count;         // Occurrences of the key; 1 for BST nodes
+    uint64_t key_offset;    // Start of the key in the pool
+    uint32_t key_length;    // Length of the key in bytes
+    int16_t balance_factor; // 0 for BST nodes
+    uint8_t children;       // has_left | has_right
+    uint8_t reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 48 && sizeof(SnapshotRecord) == 24);
+
+/// @brief Whether keys of a type are stored as characters rather than as
+/// object bytes.
+template <class T>
+inline constexpr bool snapshot_string_key_v = is_convertible_v<const T &, string_view> && is_constructible_v<T, string_view>;
+
+/// @brief Whether keys of a type can be stored in a snapshot at all.
+/// Pointer keys such as const char * are trivially copyable, but their
+/// bytes are an address that means nothing to the process loading them.
+template <class T>
+inline constexpr bool snapshot_key_v = snapshot_string_key_v<T> || (is_trivially_copyable_v<T> && !is_pointer_v<T> && !is_member_pointer_v<T>);
+
+/// @brief Whether keys of a type read from a snapshot point into the
+/// snapshot bytes, which then have to outlive the tree.
+template <class T>
+inline constexpr bool snapshot_view_key_v = snapshot_string_key_v<T> && is_trivially_copyable_v<T>;
+
+/// @brief Running checksum over a byte stream fed in arbitrary pieces.
+/// Mixes eight bytes per multiply, so it keeps up with reading the file.
+class SnapshotChecksum
+{
+private:
+    uint64_t m_hash{0x243f6a8885a308d3ULL};
+    uint64_t m_length{0};
+    unsigned char m_tail[8]{}; // Bytes not yet forming a whole word
+    size_t m_tail_bytes{0};
+
+    static uint64_t mix(uint64_t t_hash, uint64_t t_word)
+    {
+        t_hash = (t_hash ^ t_word) * 0x9e3779b97f4a7c15ULL;
+        return t_hash ^ (t_hash >> 29);
+    }
+
+public:
+    void update(const char *t_data, size_t t_size)
+    {
+        m_length += t_size;
+        while (t_size && m_tail_bytes)
+        {
+            m_tail[m_tail_bytes++] = *t_data++;
+            t_size--;
+            if (m_tail_bytes == 8)
+            {
+                uint64_t word;
+                memcpy(&word, m_tail, 8);
+                m_hash = mix(m_hash, word);
+                m_tail_bytes = 0;
+            }
+        }
+        for (; t_size >= 8; t_data += 8, t_size -= 8)
+        {
+            uint64_t word;
+            memcpy(&word, t_data, 8);
+            m_hash = mix(m_hash, word);
+        }
+        memcpy(m_tail + m_tail_bytes, t_data, t_size);
+        m_tail_bytes += t_size;
+    }
+
+    uint64_t value() const
+    {
+        uint64_t hash = m_hash;
+        if (m_tail_bytes)
+        {
+            uint64_t word = 0;
+            memcpy(&word, m_tail, m_tail_bytes);
+            hash = mix(hash, word);
+        }
+        hash = mix(hash, m_length);
+        return hash ^ (hash >> 32);
+    }
+};
+
+/// @brief The bytes a key is stored as.
+template <class T>
+string_view snapshot_key_bytes(const T &t_key)
+{
+    if constexpr (snapshot_string_key_v<T>)
+        return string_view(t_key);
+    else
+    {
+        static_assert(snapshot_key_v<T>, "snapshot keys must be strings or trivially copyable non-pointers");
+        return string_view(reinterpret_cast<const char *>(&t_key), sizeof(T));
+    }
+}
+
+/// @brief Rebuilds a key from the bytes it was stored as.
+template <class T>
+T snapshot_key(string_view t_bytes)
+{
+    if constexpr (snapshot_string_key_v<T>)
+        return T(t_bytes);
+    else
+    {
+        static_assert(snapshot_key_v<T>, "snapshot keys must be strings or trivially copyable non-pointers");
+        T key;
+        memcpy(&key, t_bytes.data(), sizeof(T));
+        return key;
+    }
+}
+
+/// @brief Writes a snapshot of a tree in two preorder passes: the records,
+/// then the key pool. The header is written last, once the checksum is
+/// known, so the stream has to be seekable.
+/// @tparam T Type of the keys.
+/// @tparam NodeT Node type exposing data, left and right, and optionally
+/// count and balance_factor.
+/// @param t_root Pointer to root of the tree.
+/// @param t_node_count Number of nodes in the tree.
+/// @param t_kind Kind of tree.
+/// @param t_out Destination stream, positioned at its start.
+/// @return false if the stream failed.
+template <class T, class NodeT>
+bool write_snapshot(const NodeT *t_root, size_t t_node_count, SnapshotKind t_kind, ostream &t_out)
+{
+    SnapshotHeader header{};
+    memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+    header.version = snapshot_version;
+    header.kind = (uint32_t)t_kind;
+    header.key_size = snapshot_string_key_v<T> ? 0 : sizeof(T);
+    header.byte_order = snapshot_byte_order;
+    header.node_count = t_node_count;
+
+    SnapshotChecksum checksum;
+    {
+        BufferedSink sink(t_out);
+        auto write = [&](const void *t_data, size_t t_size)
+        {
+            checksum.update(static_cast<const char *>(t_data), t_size);
+            sink.write(string_view(static_cast<const char *>(t_data), t_size));
+        };
+        sink.write(string_view(reinterpret_cast<const char *>(&header), sizeof(header))); // Placeholder
+
+        uint64_t offset = 0;
+        visit_nodes(t_root, TraversalOrder::pre_order, [&](const NodeT &t_node, size_t)
+                    {
+            SnapshotRecord record{};
+            if constexpr (requires { t_node.count; })
+                record.count = t_node.count;
+            else
+                record.count = 1;
+            if constexpr (requires { t_node.balance_factor; })
+                record.balance_factor = (int16_t)t_node.balance_factor;
+            string_view key = snapshot_key_bytes(t_node.data);
+            record.key_offset = offset;
+            record.key_length = (uint32_t)key.size();
+            record.children = (t_node.left ? SnapshotRecord::has_left : 0) | (t_node.right ? SnapshotRecord::has_right : 0);
+            offset += key.size();
+            write(&record, sizeof(record)); });
+        visit_nodes(t_root, TraversalOrder::pre_order, [&](const NodeT &t_node, size_t)
+                    {
+            string_view key = snapshot_key_bytes(t_node.data);
+            write(key.data(), key.size()); });
+        header.pool_bytes = offset;
+    }
+    header.checksum = checksum.value();
+    t_out.seekp(0);
+    t_out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    t_out.flush();
+    return (bool)t_out;
+}
+
+/// @brief Checks a snapshot and links its nodes in one linear pass.
+/// Everything that can be wrong with the bytes is checked before the
+/// first node is created, so on failure nothing is left to free. The
+/// cached per-node values and the key order are left to the caller,
+/// which checks and refreshes them bottom-up by walking t_preorder
+/// backwards.
+/// @tparam T Type of the keys.
+/// @param t_bytes Whole snapshot; view keys point into it.
+/// @param t_kind Kind of tree expected.
+/// @param t_create Callable taking (T key, const SnapshotRecord &) and
+/// returning a new node.
+/// @param t_preorder Filled with the nodes in preorder.
+/// @return Pointer to root of the tree.
+/// @throws runtime_error if the bytes are not a valid snapshot of the kind.
+template <class T, class NodeT, class Create>
+NodeT *read_snapshot(string_view t_bytes, SnapshotKind t_kind, Create t_create, vector<NodeT *> &t_preorder)
+{
+    auto fail = [](const char *t_what)
+    { throw runtime_error(string("read_snapshot: ") + t_what); };
+
+    SnapshotHeader header;
+    if (t_bytes.size() < sizeof(header))
+        fail("file too short");
+    memcpy(&header, t_bytes.data(), sizeof(header));
+    if (memcmp(header.magic, snapshot_magic, sizeof(header.magic)) != 0)
+        fail("not a tree snapshot");
+    if (header.byte_order != snapshot_byte_order)
+        fail("written on a machine of another byte order");
+    if (header.version != snapshot_version)
+        fail("unsupported version");
+    if (header.kind != (uint32_t)t_kind)
+        fail("snapshot is of another kind of tree");
+    if (header.key_size != (snapshot_string_key_v<T> ? 0 : sizeof(T)))
+        fail("snapshot has another key type");
+
+    string_view payload = t_bytes.substr(sizeof(header));
+    if (header.node_count > payload.size() / sizeof(SnapshotRecord) ||
+        header.pool_bytes != payload.size() - header.node_count * sizeof(SnapshotRecord))
+        fail("size does not match the header");
+    SnapshotChecksum checksum;
+    checksum.update(payload.data(), payload.size());
+    if (checksum.value() != header.checksum)
+        fail("checksum mismatch");
+
+    const char *records = payload.data();
+    string_view pool = payload.substr(header.node_count * sizeof(SnapshotRecord));
+    auto record_at = [&](size_t t_index)
+    {
+        SnapshotRecord record;
+        memcpy(&record, records + t_index * sizeof(SnapshotRecord), sizeof(record));
+        return record;
+    };
+
+    // The shape is valid if every child announced is filled by the next
+    // record and none are left open at the end
+    size_t open = header.node_count ? 1 : 0;
+    for (size_t i = 0; i < header.node_count; i++)
+    {
+        SnapshotRecord record = record_at(i);
+        if (!open || record.key_offset > pool.size() || record.key_length > pool.size() - record.key_offset ||
+            (header.key_size && record.key_length != header.key_size) || record.count == 0)
+            fail("corrupt record");
+        open += ((record.children & SnapshotRecord::has_left) ? 1 : 0) + ((record.children & SnapshotRecord::has_right) ? 1 : 0) - 1;
+    }
+    if (open)
+        fail("corrupt record");
+
+    // Links waiting for a child; the left link is on top so the next
+    // preorder record fills it first
+    NodeT *root = nullptr;
+    vector<NodeT **> links{&root};
+    vector<NodeT *> parents{nullptr};
+    t_preorder.clear();
+    t_preorder.reserve(header.node_count);
+    for (size_t i = 0; i < header.node_count; i++)
+    {
+        SnapshotRecord record = record_at(i);
+        NodeT *node = t_create(snapshot_key<T>(pool.substr(record.key_offset, record.key_length)), record);
+        *links.back() = node;
+        node->parent = parents.back();
+        links.pop_back();
+        parents.pop_back();
+        if (record.children & SnapshotRecord::has_right)
+        {
+            links.push_back(&node->right);
+            parents.push_back(node);
+        }
+        if (record.children & SnapshotRecord::has_left)
+        {
+            links.push_back(&node->left);
+            parents.push_back(node);
+        }
+        t_preorder.push_back(node);
+    }
+    return root;
+}
+
+/// @brief Checks the key order of a tree fed its nodes in reverse
+/// preorder, in which both subtrees of a node come just before it. Each
+/// subtree leaves its first and last node in in-order on a stack, with
+/// the left subtree on top, so every node is compared once with its
+/// in-order predecessor and once with its successor.
+/// @tparam NodeT Node type exposing data, left and right.
+template <class NodeT>
+class SnapshotOrderCheck
+{
+private:
+    struct Range
+    {
+        const NodeT *first;
+        const NodeT *last;
+    };
+    vector<Range> m_ranges;
+
+public:
+    /// @brief Takes the next node in reverse preorder.
+    /// @param t_ordered Callable taking (const T &, const T &) and telling
+    /// whether the first key may come before the second.
+    /// @return false if the node is out of order with its subtrees.
+    template <class Ordered>
+    bool visit(const NodeT *t_node, Ordered t_ordered)
+    {
+        Range range{t_node, t_node};
+        if (t_node->left)
+        {
+            Range left = m_ranges.back();
+            m_ranges.pop_back();
+            if (!t_ordered(left.last->data, t_node->data))
+                return false;
+            range.first = left.first;
+        }
+        if (t_node->right)
+        {
+            Range right = m_ranges.back();
+            m_ranges.pop_back();
+            if (!t_ordered(t_node->data, right.first->data))
+                return false;
+            range.last = right.last;
+        }
+        m_ranges.push_back(range);
+        return true;
+    }
+};
+
+#endif
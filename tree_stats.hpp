@@ -0,0 +1,217 @@
+/// Header file for the operation statistics policies of the tree classes
+#ifndef TREE_STATS
+#define TREE_STATS
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+// A stats policy is the last template parameter of the trees. The trees
+// call the following hooks on it:
+//   Scope begin(TreeOp, n = 1)       start n operations; they end with Scope
+//   void comparison()                one key comparison
+//   void visit(n = 1)                n nodes entered
+//   void path_depth(size_t)          length of a root-to-node path walked
+//   void rotation(bool t_double)     one single or double rotation
+//   void allocation(n = 1)           n nodes handed out by the allocator
+//   void deallocation(n = 1)         n nodes returned to the allocator
+//   void recomputation()             one whole-subtree recompute pass
+//   StatsSnapshot snapshot() const   copy of the counters
+//   void reset()                     zero the counters
+// NullStats implements every hook as an empty inline function and has no
+// data members, so a tree without statistics compiles to the same code.
+
+/// @brief Kinds of tree operations the statistics are broken down by.
+enum class TreeOp : size_t
+{
+    insert,
+    search,
+    remove,
+    build,
+    clear,
+    split_join,
+    set_operation,
+    rebalance
+};
+
+inline constexpr size_t tree_op_count = 8;
+
+/// @brief Name of an operation kind, as used in the JSON report.
+inline const char *tree_op_name(TreeOp t_op)
+{
+    static const char *const names[tree_op_count] = {"insert", "search", "remove", "build", "clear", "split_join", "set_operation", "rebalance"};
+    return names[(size_t)t_op];
+}
+
+/// @brief Counters of one kind of operation.
+struct OpStats
+{
+    // latency_histogram[b] counts calls taking [2^b, 2^(b+1)) nanoseconds
+    static constexpr size_t latency_buckets = 40;
+
+    uint64_t operations{0};       // Operations started
+    uint64_t comparisons{0};      // Key comparisons
+    uint64_t node_visits{0};      // Nodes entered
+    uint64_t max_path_depth{0};   // Longest root-to-node path walked
+    uint64_t single_rotations{0}; // Single rotations
+    uint64_t double_rotations{0}; // Double rotations
+    uint64_t allocations{0};      // Nodes allocated
+    uint64_t deallocations{0};    // Nodes freed
+    uint64_t recomputations{0};   // Whole-subtree recompute passes
+    array<uint64_t, latency_buckets> latency_histogram{};
+
+    /// @brief Estimates a latency percentile from the histogram.
+    /// @param t_fraction Percentile as a fraction, e.g. 0.99.
+    /// @return Upper bound in nanoseconds of the bucket holding it.
+    uint64_t latency_percentile(double t_fraction) const;
+};
+
+/// @brief Counters of every kind of operation, copied out of a policy.
+struct StatsSnapshot
+{
+    array<OpStats, tree_op_count> ops{};
+
+    const OpStats &operator[](TreeOp t_op) const { return ops[(size_t)t_op]; }
+    OpStats &operator[](TreeOp t_op) { return ops[(size_t)t_op]; }
+
+    /// @brief Serializes the counters as a JSON object keyed by operation.
+    /// @return JSON text.
+    string to_json() const;
+};
+
+/// @brief Stats policy that records nothing; the default of the trees.
+struct NullStats
+{
+    static constexpr bool enabled = false;
+
+    struct Scope
+    {
+        ~Scope() {} // User-provided so an unused scope draws no warning
+    };
+
+    Scope begin(TreeOp, uint64_t = 1) { return {}; }
+    void comparison() {}
+    void visit(uint64_t = 1) {}
+    void path_depth(size_t) {}
+    void rotation(bool) {}
+    void allocation(uint64_t = 1) {}
+    void deallocation(uint64_t = 1) {}
+    void recomputation() {}
+    StatsSnapshot snapshot() const { return {}; }
+    void reset() {}
+};
+
+/// @brief Stats policy counting every hook, attributed to the operation
+/// currently running, and timing each operation into a log2 histogram.
+/// Not thread-safe: const lookups update the counters too, so a tree
+/// using it must not be read from several threads at once.
+class CountingStats
+{
+private:
+    StatsSnapshot m_totals;
+    TreeOp m_current{TreeOp::search}; // Operation the hooks are charged to
+
+    OpStats &current() { return m_totals[m_current]; }
+
+public:
+    static constexpr bool enabled = true;
+
+    /// @brief Charges hooks to one operation while alive and records the
+    /// operation's latency when destroyed.
+    class Scope
+    {
+    private:
+        CountingStats *m_stats;
+        TreeOp m_previous;
+        uint64_t m_operations;
+        chrono::steady_clock::time_point m_start;
+
+    public:
+        Scope(CountingStats *t_stats, TreeOp t_op, uint64_t t_operations)
+            : m_stats(t_stats), m_previous(t_stats->m_current), m_operations(t_operations), m_start(chrono::steady_clock::now())
+        {
+            m_stats->m_current = t_op;
+            m_stats->current().operations += t_operations;
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        ~Scope()
+        {
+            uint64_t elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - m_start).count();
+            uint64_t per_operation = m_operations ? elapsed / m_operations : elapsed;
+            size_t bucket = per_operation ? 63 - __builtin_clzll(per_operation) : 0;
+            m_stats->current().latency_histogram[min(bucket, OpStats::latency_buckets - 1)] += m_operations;
+            m_stats->m_current = m_previous;
+        }
+    };
+
+    Scope begin(TreeOp t_op, uint64_t t_operations = 1) { return Scope(this, t_op, t_operations); }
+    void comparison() { current().comparisons++; }
+    void visit(uint64_t t_nodes = 1) { current().node_visits += t_nodes; }
+    void path_depth(size_t t_depth) { current().max_path_depth = max<uint64_t>(current().max_path_depth, t_depth); }
+    void rotation(bool t_double) { (t_double ? current().double_rotations : current().single_rotations)++; }
+    void allocation(uint64_t t_nodes = 1) { current().allocations += t_nodes; }
+    void deallocation(uint64_t t_nodes = 1) { current().deallocations += t_nodes; }
+    void recomputation() { current().recomputations++; }
+    StatsSnapshot snapshot() const { return m_totals; }
+    void reset() { m_totals = StatsSnapshot(); }
+};
+
+inline uint64_t OpStats::latency_percentile(double t_fraction) const
+{
+    uint64_t total = 0;
+    for (uint64_t calls : latency_histogram)
+        total += calls;
+    if (!total)
+        return 0;
+
+    uint64_t rank = (uint64_t)(t_fraction * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < latency_buckets; bucket++)
+    {
+        seen += latency_histogram[bucket];
+        if (seen >= rank)
+            return (uint64_t)1 << (bucket + 1);
+    }
+    return (uint64_t)1 << latency_buckets;
+}
+
+inline string StatsSnapshot::to_json() const
+{
+    string out = "{";
+    for (size_t i = 0; i < tree_op_count; i++)
+    {
+        const OpStats &op = ops[i];
+        if (i)
+            out += ',';
+        out += "\"" + string(tree_op_name((TreeOp)i)) + "\":{\"operations\":" + to_string(op.operations) +
+               ",\"comparisons\":" + to_string(op.comparisons) +
+               ",\"node_visits\":" + to_string(op.node_visits) +
+               ",\"max_path_depth\":" + to_string(op.max_path_depth) +
+               ",\"single_rotations\":" + to_string(op.single_rotations) +
+               ",\"double_rotations\":" + to_string(op.double_rotations) +
+               ",\"allocations\":" + to_string(op.allocations) +
+               ",\"deallocations\":" + to_string(op.deallocations) +
+               ",\"recomputations\":" + to_string(op.recomputations) +
+               ",\"latency_p50_ns\":" + to_string(op.latency_percentile(0.50)) +
+               ",\"latency_p99_ns\":" + to_string(op.latency_percentile(0.99)) +
+               ",\"latency_histogram\":[";
+        for (size_t bucket = 0; bucket < OpStats::latency_buckets; bucket++)
+        {
+            if (bucket)
+                out += ',';
+            out += to_string(op.latency_histogram[bucket]);
+        }
+        out += "]}";
+    }
+    out += '}';
+    return out;
+}
+
+#endif
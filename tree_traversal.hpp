@@ -0,0 +1,119 @@
+/// Header file for the generic node traversals shared by the tree classes
+#ifndef TREE_TRAVERSAL
+#define TREE_TRAVERSAL
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+/// @brief Order in which a traversal visits the nodes.
+enum class TraversalOrder
+{
+    in_order,
+    pre_order,
+    post_order,
+    level_order
+};
+
+/// @brief Calls t_visit(node, depth) for every node of a subtree in the
+/// given order. All orders are iterative with one reused explicit stack
+/// (or queue for level order), so deep trees never overflow the call
+/// stack.
+/// @tparam NodeT Node type exposing left and right child pointers.
+/// @param t_root Pointer to root of the subtree.
+/// @param t_order Traversal order.
+/// @param t_visit Callable taking (const NodeT &, size_t depth).
+template <class NodeT, class Visit>
+void visit_nodes(const NodeT *t_root, TraversalOrder t_order, Visit &&t_visit)
+{
+    if (!t_root)
+        return;
+
+    struct Frame
+    {
+        const NodeT *node;
+        size_t depth;
+    };
+    vector<Frame> stack;
+
+    switch (t_order)
+    {
+    case TraversalOrder::in_order:
+    {
+        const NodeT *node = t_root;
+        size_t depth = 0;
+        while (node || !stack.empty())
+        {
+            while (node)
+            {
+                stack.push_back({node, depth});
+                node = node->left;
+                depth++;
+            }
+            Frame top = stack.back();
+            stack.pop_back();
+            t_visit(*top.node, top.depth);
+            node = top.node->right;
+            depth = top.depth + 1;
+        }
+        break;
+    }
+    case TraversalOrder::pre_order:
+        stack.push_back({t_root, 0});
+        while (!stack.empty())
+        {
+            Frame top = stack.back();
+            stack.pop_back();
+            t_visit(*top.node, top.depth);
+            if (top.node->right)
+                stack.push_back({top.node->right, top.depth + 1});
+            if (top.node->left)
+                stack.push_back({top.node->left, top.depth + 1});
+        }
+        break;
+    case TraversalOrder::post_order:
+    {
+        const NodeT *node = t_root;
+        const NodeT *last_visited = nullptr;
+        size_t depth = 0;
+        while (node || !stack.empty())
+        {
+            while (node)
+            {
+                stack.push_back({node, depth});
+                node = node->left;
+                depth++;
+            }
+            Frame top = stack.back();
+            // Descend into the right subtree first unless it was just finished
+            if (top.node->right && top.node->right != last_visited)
+            {
+                node = top.node->right;
+                depth = top.depth + 1;
+            }
+            else
+            {
+                t_visit(*top.node, top.depth);
+                last_visited = top.node;
+                stack.pop_back();
+            }
+        }
+        break;
+    }
+    case TraversalOrder::level_order:
+        // The stack vector doubles as the queue; head marks its front
+        stack.push_back({t_root, 0});
+        for (size_t head = 0; head < stack.size(); head++)
+        {
+            Frame front = stack[head];
+            t_visit(*front.node, front.depth);
+            if (front.node->left)
+                stack.push_back({front.node->left, front.depth + 1});
+            if (front.node->right)
+                stack.push_back({front.node->right, front.depth + 1});
+        }
+        break;
+    }
+}
+
+#endif
@@ -0,0 +1,244 @@
+/// Header file for zero-copy loading of word lists into the tree classes
+#ifndef WORD_LOADER
+#define WORD_LOADER
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define WORD_LOADER_MMAP 1
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/// @brief A read-only view of a whole text file, memory-mapped where the
+/// platform supports it and read into one buffer otherwise. Words handed
+/// out as string_view point into the view and stay valid for the lifetime
+/// of the object.
+class MappedWordFile
+{
+private:
+    const char *m_data{nullptr}; // Start of the file contents
+    size_t m_size{0};            // Length of the file contents
+    bool m_open{false};          // Whether the file could be read
+#ifdef WORD_LOADER_MMAP
+    void *m_mapping{nullptr}; // Address returned by mmap, if mapped
+#endif
+    string m_buffer; // Contents when the file is not mapped
+
+    /// @brief Checks if a byte is whitespace in the sense of operator>>.
+    static bool is_space(unsigned char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+public:
+    /// @brief Maps a file. Check is_open() afterwards, as with ifstream.
+    /// @param file_path Path of the file.
+    explicit MappedWordFile(const string &file_path);
+
+    /// @brief Unmaps the file.
+    ~MappedWordFile();
+
+    MappedWordFile(const MappedWordFile &) = delete;
+    MappedWordFile &operator=(const MappedWordFile &) = delete;
+
+    /// @brief Whether the file could be opened and read.
+    /// @return true if the contents are available, false otherwise.
+    bool is_open() const { return m_open; }
+
+    /// @brief The whole file.
+    /// @return View of the file contents.
+    string_view contents() const { return string_view(m_data, m_size); }
+
+    /// @brief Calls t_visit(word) for every whitespace separated word in
+    /// file order. Whitespace is located 16 bytes at a time with SSE2 when
+    /// available.
+    /// @param t_visit Callable taking a string_view into the file.
+    template <class Visit>
+    void for_each_word(Visit t_visit) const;
+
+    /// @brief Collects every word of the file.
+    /// @return Views of the words in file order.
+    vector<string_view> words() const
+    {
+        vector<string_view> result;
+        for_each_word([&](string_view word)
+                      { result.push_back(word); });
+        return result;
+    }
+};
+
+inline MappedWordFile::MappedWordFile(const string &file_path)
+{
+#ifdef WORD_LOADER_MMAP
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat info;
+        if (fstat(fd, &info) == 0)
+        {
+            m_size = info.st_size;
+            if (m_size == 0)
+                m_open = true;
+            else
+            {
+                void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping != MAP_FAILED)
+                {
+                    madvise(mapping, m_size, MADV_SEQUENTIAL);
+                    m_mapping = mapping;
+                    m_data = static_cast<const char *>(mapping);
+                    m_open = true;
+                }
+            }
+        }
+        close(fd);
+        if (m_open)
+            return;
+        m_size = 0;
+    }
+#endif
+    // No mmap available or mapping failed: read the file into one buffer
+    ifstream infile(file_path, ios::binary);
+    if (!infile)
+        return;
+    m_buffer.assign(istreambuf_iterator<char>(infile), istreambuf_iterator<char>());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    m_open = true;
+}
+
+inline MappedWordFile::~MappedWordFile()
+{
+#ifdef WORD_LOADER_MMAP
+    if (m_mapping)
+        munmap(m_mapping, m_size);
+#endif
+}
+
+template <class Visit>
+void MappedWordFile::for_each_word(Visit t_visit) const
+{
+    const char *data = m_data;
+    size_t pos = 0;
+    size_t word_start = 0;
+    bool in_word = false;
+
+#ifdef __SSE2__
+    // Build a 16-bit mask with one bit per whitespace byte, then walk the
+    // word boundaries inside the block with count-trailing-zeros. Blocks
+    // entirely inside a word or entirely whitespace are skipped at once.
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i control_span = _mm_set1_epi8('\r' - '\t');
+    for (; pos + 16 <= m_size; pos += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        __m128i shifted = _mm_sub_epi8(block, tab); // '\t'..'\r' -> 0..4
+        __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, control_span), shifted);
+        __m128i is_blank = _mm_or_si128(_mm_cmpeq_epi8(block, space), is_control);
+        uint32_t whitespace = (uint32_t)_mm_movemask_epi8(is_blank);
+
+        uint32_t offset = 0;
+        while (offset < 16)
+        {
+            uint32_t boundary = (in_word ? whitespace : ~whitespace & 0xFFFF) >> offset;
+            if (!boundary)
+                break;
+            offset += __builtin_ctz(boundary);
+            if (in_word)
+                t_visit(string_view(data + word_start, pos + offset - word_start));
+            else
+                word_start = pos + offset;
+            in_word = !in_word;
+        }
+    }
+#endif
+
+    for (; pos < m_size; pos++)
+    {
+        bool blank = is_space((unsigned char)data[pos]);
+        if (in_word && blank)
+            t_visit(string_view(data + word_start, pos - word_start));
+        else if (!in_word && !blank)
+            word_start = pos;
+        in_word = !blank;
+    }
+    if (in_word)
+        t_visit(string_view(data + word_start, m_size - word_start));
+}
+
+/// @brief What a file mapped for a MappedTree holds.
+/// words     whitespace separated words, inserted one by one
+/// snapshot  a tree snapshot written by save(), loaded in place
+enum class MappedContents
+{
+    words,
+    snapshot
+};
+
+/// @brief A tree keyed by string_view together with the mapped file its
+/// keys point into. The file is shared, so several trees can be loaded
+/// from one mapping, and it is released only after the last tree using it
+/// has been destroyed.
+/// @tparam Tree Tree type, e.g. AVLTree<string_view>.
+template <class Tree>
+class MappedTree
+{
+private:
+    shared_ptr<const MappedWordFile> m_file; // Declared first: destroyed after m_tree
+    Tree m_tree;
+
+public:
+    /// @brief Maps a file and fills the tree from it.
+    /// @param file_path Path of the file.
+    /// @param t_contents Whether the file holds words or a snapshot.
+    explicit MappedTree(const string &file_path, MappedContents t_contents = MappedContents::words)
+        : MappedTree(make_shared<const MappedWordFile>(file_path), t_contents) {}
+
+    /// @brief Fills the tree from an already mapped file. A snapshot is
+    /// loaded in one linear pass with the keys left in the mapping.
+    /// @param t_file Mapped file shared with other trees.
+    /// @param t_contents Whether the file holds words or a snapshot.
+    /// @throws runtime_error if a snapshot is missing or invalid, and
+    /// invalid_argument if the tree type cannot load snapshots.
+    explicit MappedTree(shared_ptr<const MappedWordFile> t_file, MappedContents t_contents = MappedContents::words) : m_file(std::move(t_file))
+    {
+        if (t_contents == MappedContents::snapshot)
+        {
+            if constexpr (requires { m_tree.load_snapshot(string_view()); })
+                m_tree.load_snapshot(m_file->contents());
+            else
+                throw invalid_argument("MappedTree: tree type has no snapshot format");
+        }
+        else
+            m_file->for_each_word([this](string_view word)
+                                  { m_tree.insert(word); });
+    }
+
+    /// @brief Whether the file could be opened and read.
+    bool is_open() const { return m_file->is_open(); }
+
+    /// @brief The mapped file the keys point into.
+    const MappedWordFile &file() const { return *m_file; }
+
+    Tree &tree() { return m_tree; }
+    const Tree &tree() const { return m_tree; }
+    Tree *operator->() { return &m_tree; }
+    const Tree *operator->() const { return &m_tree; }
+};
+
+#endif